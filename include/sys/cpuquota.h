@@ -0,0 +1,55 @@
+// File: include/sys/cpuquota.h
+// Purpose: per-process CPU bandwidth limits
+// SPDX-License-Identifier: MIT
+#ifndef __SYS_CPUQUOTA_H__
+#define __SYS_CPUQUOTA_H__
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+#include <sys/types.h> // for uint64_t
+
+// The shortest period of a CPU quota in nanoseconds.
+#define CPUQUOTA_PERIOD_MIN 1000000ULL
+
+// The longest period of a CPU quota in nanoseconds.
+#define CPUQUOTA_PERIOD_MAX 1000000000ULL
+
+// CPU bandwidth limit of a process.
+//
+// The process may run for at most quota_ns nanoseconds within each
+// period_ns nanoseconds. Once it exhausts its quota, the scheduler
+// does not run it (i.e., throttles it) until the next period begins.
+struct cpuquota {
+	// CPU time the process may consume in each period or zero for no limit.
+	uint64_t quota_ns;
+
+	// The length of the period.
+	uint64_t period_ns;
+};
+
+__BEGIN_DECLS
+
+// Gets the CPU bandwidth limit of the given process.
+//
+// The pid argument is the ID of the thread of a process or zero for
+// the calling process.
+//
+// Returns zero on success. On failure, the libc wrapper returns -1 and
+// sets errno (e.g., ESRCH if pid is not a process), while the system
+// call itself returns the negated errno value.
+int cpuquota_get(int pid, struct cpuquota *quota) __NOEXCEPT;
+
+// Sets the CPU bandwidth limit of the given process, which starts a new period.
+//
+// The pid argument is the ID of the thread of a process or zero for
+// the calling process. A zero quota_ns removes the limit.
+//
+// Returns zero on success. On failure, the libc wrapper returns -1 and
+// sets errno to EINVAL unless quota_ns is zero or 0 < quota_ns <= period_ns
+// and CPUQUOTA_PERIOD_MIN <= period_ns <= CPUQUOTA_PERIOD_MAX, to ESRCH
+// if pid is not a process, and to EFAULT if quota is not readable, while
+// the system call itself returns the negated errno value (e.g., `-EINVAL`).
+int cpuquota_set(int pid, const struct cpuquota *quota) __NOEXCEPT;
+
+__END_DECLS
+
+#endif // __SYS_CPUQUOTA_H__
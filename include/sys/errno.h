@@ -19,6 +19,9 @@
 // Bad file descriptor.
 #define EBADF 9
 
+// No child processes.
+#define ECHILD 10
+
 // Resource temporarily unavailable.
 #define EAGAIN 11
 
@@ -31,10 +34,16 @@
 // Bad address.
 #define EFAULT 14
 
+// Device or resource busy.
+#define EBUSY 16
+
 // Invalid argument.
 #define EINVAL 22
 
 // Function not implemented.
 #define ENOSYS 38
 
+// Connection timed out.
+#define ETIMEDOUT 110
+
 #endif // __SYS_ERRNO_H__
@@ -0,0 +1,47 @@
+// File: include/sys/futex.h
+// Purpose: fast userspace synchronization primitives
+// SPDX-License-Identifier: MIT
+#ifndef __SYS_FUTEX_H__
+#define __SYS_FUTEX_H__
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+#include <sys/types.h> // for uint32_t
+
+__BEGIN_DECLS
+
+// Suspends the calling thread while the 32-bit word at uaddr contains val.
+//
+// Userspace synchronization primitives keep their state in such a word
+// and only call into the kernel when they must wait, so the uncontended
+// path does not need system calls. We compare the word and suspend the
+// thread atomically with respect to futex_wake on the same word, hence
+// a thread cannot miss a wakeup occurring after it read the word.
+//
+// We identify the word by its physical address, so threads can share a
+// futex using different virtual addresses of the same memory.
+//
+// The timeout is relative and expressed in nanoseconds, and zero
+// means that we wait without a timeout.
+//
+// Returns zero when woken up. On failure, the libc wrapper returns -1
+// and sets errno to EAGAIN if the word did not contain val, ETIMEDOUT if
+// the timeout expired, EINVAL if uaddr is not aligned to 4 bytes, and
+// EFAULT if uaddr is not mapped, while the system call itself returns
+// the negated errno value (e.g., `-EAGAIN`).
+//
+// Spurious wakeups are possible, so callers should read the word
+// again after this function returns.
+int futex_wait(uint32_t *uaddr, uint32_t val, uint64_t timeout_ns) __NOEXCEPT;
+
+// Wakes up to count threads waiting on the 32-bit word at uaddr in
+// the order in which they started waiting.
+//
+// Returns the number of threads we woke up. On failure, the libc wrapper
+// returns -1 and sets errno to EINVAL if uaddr is not aligned to 4 bytes
+// and EFAULT if uaddr is not mapped, while the system call itself returns
+// the negated errno value.
+int futex_wake(uint32_t *uaddr, int count) __NOEXCEPT;
+
+__END_DECLS
+
+#endif // __SYS_FUTEX_H__
@@ -14,10 +14,23 @@
 // Alias for MM_PAGE_SIZE.
 #define PAGE_SIZE MM_PAGE_SIZE
 
-// Maximum number of runnable threads.
-#define SCHED_MAX_THREADS 32
+// Size of a cache line on the arm64 CPUs we support.
+#define CACHE_LINE_SIZE 64
+
+// Maximum number of live threads.
+//
+// We allocate threads dynamically, so this only bounds the memory
+// used by threads, which is roughly 12.5 KiB per thread, including
+// the guard page below each kernel stack.
+#define SCHED_MAX_THREADS 1024
 
 // Alias for SCHED_MAX_THREADS.
 #define MAX_THREADS SCHED_MAX_THREADS
 
+// Maximum number of CPUs we bring online.
+#define SMP_MAX_CPUS 4
+
+// Alias for SMP_MAX_CPUS.
+#define MAX_CPUS SMP_MAX_CPUS
+
 #endif // __SYS_PARAM_H__
@@ -0,0 +1,33 @@
+// File: include/sys/resource.h
+// Purpose: stripped down sys/resource.h header
+// SPDX-License-Identifier: MIT
+#ifndef __SYS_RESOURCE_H__
+#define __SYS_RESOURCE_H__
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+
+// The who argument is a thread ID or zero for the calling thread.
+#define PRIO_PROCESS 0
+
+// The nice value giving a thread the largest CPU share.
+#define PRIO_MIN (-20)
+
+// The nice value giving a thread the smallest CPU share.
+#define PRIO_MAX 19
+
+__BEGIN_DECLS
+
+// Returns the nice value of the given thread.
+//
+// The system call returns `20 - nice` or a negative errno value, so the
+// result is never ambiguous, and the libc wrapper converts it back.
+int getpriority(int which, int who) __NOEXCEPT;
+
+// Sets the nice value of the given thread.
+//
+// Values outside of [PRIO_MIN, PRIO_MAX] are clamped.
+int setpriority(int which, int who, int prio) __NOEXCEPT;
+
+__END_DECLS
+
+#endif // __SYS_RESOURCE_H__
@@ -0,0 +1,67 @@
+// File: include/sys/schedstat.h
+// Purpose: scheduler accounting and latency statistics
+// SPDX-License-Identifier: MIT
+#ifndef __SYS_SCHEDSTAT_H__
+#define __SYS_SCHEDSTAT_H__
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+#include <sys/types.h> // for uint64_t
+
+// Scheduler accounting of a thread.
+//
+// All times are in nanoseconds and come from the monotonic clock,
+// which is based on the generic counter.
+struct schedstat_thread {
+	// CPU time the thread has consumed.
+	uint64_t runtime_ns;
+
+	// Time the thread has spent runnable waiting for a CPU.
+	uint64_t wait_ns;
+
+	// Number of times the thread blocked, yielded, or exited.
+	uint64_t nr_voluntary;
+
+	// Number of times the scheduler preempted the thread.
+	uint64_t nr_involuntary;
+
+	// Monotonic time when the thread last started running.
+	uint64_t last_run_ns;
+
+	// The CPU on which the thread last ran.
+	uint64_t last_cpu;
+
+	// Longest time between waking up and running.
+	uint64_t max_latency_ns;
+
+	// Number of times the thread exhausted the CPU quota of its process.
+	uint64_t nr_throttled;
+};
+
+// Number of buckets of the wakeup-to-run latency histogram.
+#define SCHEDSTAT_LATENCY_BUCKETS 20
+
+// Histogram of the time between a thread waking up and running.
+//
+// Bucket zero counts latencies below 1 us, bucket i counts latencies in
+// [2^(i-1), 2^i) us, and the last bucket also counts all longer latencies.
+struct schedstat_latency {
+	uint64_t buckets[SCHEDSTAT_LATENCY_BUCKETS];
+};
+
+__BEGIN_DECLS
+
+// Gets the scheduler accounting of the given thread.
+//
+// The tid argument is a thread ID or zero for the calling thread.
+//
+// Returns zero on success and a negative value on failure.
+int schedstat_thread(int tid, struct schedstat_thread *stats) __NOEXCEPT;
+
+// Gets the wakeup-to-run latency histogram summed over all the CPUs.
+//
+// Returns zero on success and a negative value on failure.
+int schedstat_latency(struct schedstat_latency *hist) __NOEXCEPT;
+
+__END_DECLS
+
+#endif // __SYS_SCHEDSTAT_H__
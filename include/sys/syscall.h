@@ -13,4 +13,30 @@
 // The write(1) system call
 #define SYS_write 1
 
+// The getpriority(2) system call
+#define SYS_getpriority 140
+
+// The setpriority(2) system call
+#define SYS_setpriority 141
+
+// System calls without a Linux counterpart start at 1000
+
+// The schedstat_thread system call
+#define SYS_schedstat_thread 1000
+
+// The schedstat_latency system call
+#define SYS_schedstat_latency 1001
+
+// The futex_wait system call
+#define SYS_futex_wait 1002
+
+// The futex_wake system call
+#define SYS_futex_wake 1003
+
+// The cpuquota_get system call
+#define SYS_cpuquota_get 1004
+
+// The cpuquota_set system call
+#define SYS_cpuquota_set 1005
+
 #endif // __SYS_SYSCALL_H__
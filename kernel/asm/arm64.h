@@ -76,6 +76,26 @@ static inline void disable_fp_simd(void) {
 	__enable_disable_fp_simd(false);
 }
 
+// Allow or trap FP/SIMD usage at EL0, while always allowing it at EL1.
+//
+// We use this to switch the user FP/SIMD state lazily. The kernel never uses
+// FP/SIMD registers, since we compile it with -mgeneral-regs-only, but needs
+// to access them to save and restore the user state.
+static inline void cpu_fp_set_user_access(bool allow) {
+	uint64_t cpacr;
+	__asm__ volatile("mrs %0, cpacr_el1" : "=r"(cpacr));
+	cpacr = (cpacr & ~(3ULL << 20)) | (allow ? (3ULL << 20) : (1ULL << 20));
+	__asm__ volatile("msr cpacr_el1, %0" ::"r"(cpacr));
+	isb();
+}
+
+// Returns whether FP/SIMD usage is allowed at EL0.
+static inline bool cpu_fp_user_access(void) {
+	uint64_t cpacr;
+	__asm__ volatile("mrs %0, cpacr_el1" : "=r"(cpacr));
+	return ((cpacr >> 20) & 3) == 3;
+}
+
 // DMB: data memory barrier using `sy.`
 static inline void dmb_sy(void) {
 	__asm__ volatile("dmb sy" ::: "memory");
@@ -91,6 +111,11 @@ static inline void dmb_ishst(void) {
 	__asm__ volatile("dmb ishst" ::: "memory");
 }
 
+// DMB: data memory barrier using `ishld`.
+static inline void dmb_ishld(void) {
+	__asm__ volatile("dmb ishld" ::: "memory");
+}
+
 // Disable IRQ interrupts by setting the I-bit in PSTATE.DAIF.
 //
 // DAIF = Debug mask (bit 9), SError mask (bit 8), IRQ mask (bit 7), FIQ mask (bit 6).
@@ -119,6 +144,18 @@ static inline void dsb_ishst(void) {
 	__asm__ volatile("dsb ishst" ::: "memory");
 }
 
+// DSB: data synchronization barrier using ish.
+//
+// Required to wait for TLB maintenance broadcast to the other CPUs.
+static inline void dsb_ish(void) {
+	__asm__ volatile("dsb ish" ::: "memory");
+}
+
+// TLBI: invalidate the translations of vaddr for all the ASIDs on all the CPUs.
+static inline void tlbi_vaae1is(uintptr_t vaddr) {
+	__asm__ volatile("tlbi vaae1is, %0" ::"r"(vaddr >> 12) : "memory");
+}
+
 // Write MAIR_EL1
 static inline void msr_mair_el1(uint64_t val) {
 	__asm__ volatile("msr mair_el1, %0" ::"r"(val) : "memory");
@@ -173,6 +210,22 @@ static inline void msr_cntp_ctl_el0(uint64_t v) {
 	__asm__ volatile("msr cntp_ctl_el0, %0" ::"r"(v));
 }
 
+// Program the clock to fire when the counter reaches the given value.
+static inline void msr_cntp_cval_el0(uint64_t v) {
+	__asm__ volatile("msr cntp_cval_el0, %0" ::"r"(v));
+}
+
+// Returns the current value of the physical counter.
+//
+// We place an `isb` barrier before the read so that the counter
+// is not read speculatively ahead of the preceding instructions.
+static inline uint64_t mrs_cntpct_el0(void) {
+	isb();
+	uint64_t v;
+	__asm__ volatile("mrs %0, cntpct_el0" : "=r"(v));
+	return v;
+}
+
 // Perform a MMIO uint32_t read at the given address.
 //
 // We place a `dmb_ish` barrier after the load.
@@ -216,11 +269,121 @@ static inline void mmio_write_uint8(volatile uint8_t *address, uint8_t value) {
 	*address = value;
 }
 
+// Read MAIR_EL1
+static inline uint64_t mrs_mair_el1(void) {
+	uint64_t v;
+	__asm__ volatile("mrs %0, mair_el1" : "=r"(v));
+	return v;
+}
+
+// Read TCR_EL1
+static inline uint64_t mrs_tcr_el1(void) {
+	uint64_t v;
+	__asm__ volatile("mrs %0, tcr_el1" : "=r"(v));
+	return v;
+}
+
+// Read TPIDR_EL1, which holds the pointer to the current CPU state.
+static inline uint64_t mrs_tpidr_el1(void) {
+	uint64_t v;
+	__asm__ volatile("mrs %0, tpidr_el1" : "=r"(v));
+	return v;
+}
+
+// Write TPIDR_EL1, which holds the pointer to the current CPU state.
+static inline void msr_tpidr_el1(uint64_t v) {
+	__asm__ volatile("msr tpidr_el1, %0" ::"r"(v) : "memory");
+}
+
+// Read MPIDR_EL1, which contains the CPU affinity.
+static inline uint64_t mrs_mpidr_el1(void) {
+	uint64_t v;
+	__asm__ volatile("mrs %0, mpidr_el1" : "=r"(v));
+	return v;
+}
+
+// Cleans and invalidates the data cache lines covering [start, end)
+// to the point of coherency.
+//
+// Use this to publish data to a CPU that reads memory with the MMU and
+// the caches disabled (e.g., a secondary CPU that is booting).
+static inline void dcache_clean_inval_range(uintptr_t start, uintptr_t end) {
+	// CTR_EL0.DminLine is the log2 of the number of words in the smallest line
+	uint64_t ctr;
+	__asm__ volatile("mrs %0, ctr_el0" : "=r"(ctr));
+	uintptr_t line = 4ULL << ((ctr >> 16) & 0xF);
+
+	for (uintptr_t addr = start & ~(line - 1); addr < end; addr += line) {
+		__asm__ volatile("dc civac, %0" ::"r"(addr) : "memory");
+	}
+	dsb_sy();
+}
+
+// Returns the pointer to the state of the CPU we're running on.
+static inline uintptr_t cpu_local_base(void) {
+	return (uintptr_t)mrs_tpidr_el1();
+}
+
+// Sets the pointer to the state of the CPU we're running on.
+static inline void cpu_set_local_base(uintptr_t base) {
+	msr_tpidr_el1((uint64_t)base);
+}
+
 // Puts the CPU in low-power state until an interrupt occurs.
 static inline void cpu_sleep_until_interrupt(void) {
 	wfi();
 }
 
+// Hints the CPU that we are spinning, waiting for another CPU.
+static inline void cpu_relax(void) {
+	__asm__ volatile("yield" ::: "memory");
+}
+
+// Sets the event register of this CPU, so that the next wfe returns immediately.
+static inline void sevl(void) {
+	__asm__ volatile("sevl" ::: "memory");
+}
+
+// Waits for an event, which another CPU generates, among other ways, by
+// writing an address that we marked using a load-acquire exclusive.
+static inline void wfe(void) {
+	__asm__ volatile("wfe" ::: "memory");
+}
+
+// Loads the given uint16_t with acquire semantics and marks its address
+// for exclusive access, so that a write by another CPU wakes up wfe.
+static inline uint16_t load_acquire_exclusive_uint16(volatile uint16_t *address) {
+	uint16_t v;
+	__asm__ volatile("ldaxrh %w0, %1" : "=r"(v) : "Q"(*address) : "memory");
+	return v;
+}
+
+// Like load_acquire_exclusive_uint16 but loads a uint32_t.
+static inline uint32_t load_acquire_exclusive_uint32(volatile uint32_t *address) {
+	uint32_t v;
+	__asm__ volatile("ldaxr %w0, %1" : "=r"(v) : "Q"(*address) : "memory");
+	return v;
+}
+
+// Waits until another CPU sets the given uint16_t to the given value, which
+// we then observe with acquire semantics, sleeping in wfe between the checks
+// rather than hammering the cache line.
+static inline void cpu_wait_until_uint16(volatile uint16_t *address, uint16_t value) {
+	// The first wfe returns immediately so we check before sleeping
+	sevl();
+	do {
+		wfe();
+	} while (load_acquire_exclusive_uint16(address) != value);
+}
+
+// Like cpu_wait_until_uint16 but waits on a uint32_t.
+static inline void cpu_wait_until_uint32(volatile uint32_t *address, uint32_t value) {
+	sevl();
+	do {
+		wfe();
+	} while (load_acquire_exclusive_uint32(address) != value);
+}
+
 // Disables interrupts unconditionally.
 static inline void local_irq_disable(void) {
 	msr_daifset_2();
@@ -231,4 +394,36 @@ static inline void local_irq_enable(void) {
 	msr_daifclr_2();
 }
 
+// Read the DAIF interrupt mask bits.
+static inline uint64_t mrs_daif(void) {
+	uint64_t v;
+	__asm__ volatile("mrs %0, daif" : "=r"(v));
+	return v;
+}
+
+// Write the DAIF interrupt mask bits.
+static inline void msr_daif(uint64_t v) {
+	__asm__ volatile("msr daif, %0" ::"r"(v) : "memory");
+}
+
+// Disables interrupts and returns the previous interrupt state.
+//
+// Use this function when the caller may already be running with
+// interrupts disabled (e.g., inside an interrupt handler).
+static inline uint64_t local_irq_save(void) {
+	uint64_t flags = mrs_daif();
+	msr_daifset_2();
+	return flags;
+}
+
+// Restores the interrupt state saved by local_irq_save.
+static inline void local_irq_restore(uint64_t flags) {
+	msr_daif(flags);
+}
+
+// Returns whether interrupts are enabled (i.e., the I-bit of PSTATE.DAIF is clear).
+static inline bool local_irq_enabled(void) {
+	return (mrs_daif() & (1 << 7)) == 0;
+}
+
 #endif // KERNEL_ASM_ARM64
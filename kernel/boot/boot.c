@@ -3,14 +3,18 @@
 // SPDX-License-Identifier: MIT
 // Adapted from: https://github.com/nuta/operating-system-in-1000-lines
 
-#include <kernel/boot/boot.h>   // whole subsystem API
-#include <kernel/core/panic.h>  // for panic
-#include <kernel/core/printk.h> // for printk
-#include <kernel/init/switch.h> // for switch_to_userspace
-#include <kernel/mm/vm.h>       // for vm_switch
-#include <kernel/sched/sched.h> // for sched_thread_start
-#include <kernel/trap/trap.h>   // for trap_init_irqs
-#include <kernel/tty/uart.h>    // for uart_init_early
+#include <kernel/boot/boot.h>       // whole subsystem API
+#include <kernel/clock/clock.h>     // for clock_init_early
+#include <kernel/core/panic.h>      // for panic
+#include <kernel/core/printk.h>     // for printk
+#include <kernel/init/switch.h>     // for switch_to_userspace
+#include <kernel/mm/vm.h>           // for vm_switch
+#include <kernel/sched/bench.h>     // for sched_bench_run
+#include <kernel/sched/sched.h>     // for sched_thread_start
+#include <kernel/sched/workqueue.h> // for sched_workqueue_init
+#include <kernel/smp/smp.h>         // for smp_init_early
+#include <kernel/trap/trap.h>       // for trap_init_irqs
+#include <kernel/tty/uart.h>        // for uart_init_early
 
 #include <sys/types.h> // for size_t
 
@@ -19,14 +23,29 @@
 static void __kernel_init_thread(void *opaque) {
 	(void)opaque;
 
-	// 1. Initialize the IRQ manager.
+	// 1. Start the workqueue worker threads.
+	//
+	// Needs to happen after we have threads.
+	sched_workqueue_init();
+
+	// 2. Initialize the IRQ manager.
 	//
 	// This will also initialize IRQs for other subsystems.
 	//
 	// Needs to happen after we have threads.
 	trap_init_irqs();
 
-	// 2. Hand off to init subsystem to switch to userspace.
+	// 3. Start the secondary CPUs.
+	//
+	// Needs to happen after the boot CPU has configured the IRQs.
+	smp_start_secondaries();
+
+#ifdef SCHED_BENCH
+	// 4. Run the scheduler microbenchmarks.
+	sched_bench_run();
+#endif
+
+	// 5. Hand off to init subsystem to switch to userspace.
 	switch_to_userspace();
 }
 
@@ -34,21 +53,33 @@ static void __kernel_init_thread(void *opaque) {
 	// 1. Zero the BSS section.
 	memset(__bss, 0, (size_t)(__bss_end - __bss));
 
-	// 2. Initialize an early serial console.
+	// 2. Initialize the boot CPU state.
+	//
+	// Needs to happen before anyone acquires a spinlock, which
+	// disables preemption using the state of the current CPU.
+	smp_init_early();
+
+	// 3. Initialize an early serial console.
 	uart_init_early();
 
-	// 3. Initialize the physical page allocator.
+	// 4. Initialize the physical page allocator.
 	page_init_early();
 
-	// 4. Initialize trap handling structs.
+	// 5. Initialize trap handling structs.
 	trap_init_early();
 
-	// 5. Switch to the virtual address space.
+	// 6. Switch to the virtual address space.
 	//
 	// This is the place that makes everyone very nervous.
 	vm_switch();
 
-	// 6. Create the kernel init thread.
+	// 7. Initialize the clocksource.
+	clock_init_early();
+
+	// 8. Initialize the scheduler.
+	sched_init_early();
+
+	// 9. Create the kernel init thread.
 	//
 	// This will enable interrupts and finish bringing the kernel up and running
 	__thread_id_t ketid = 0;
@@ -56,9 +87,23 @@ static void __kernel_init_thread(void *opaque) {
 	KERNEL_ASSERT(rc == 0);
 	printk("created __kernel_init_thread: %d\n", ketid);
 
-	// 7. Run the thread scheduler.
+	// 10. Run the thread scheduler.
 	//
 	// Needs to happen before we enable interrupts.
 	sched_thread_run();
 	panic("unreachable code\n");
 }
+
+[[noreturn]] void __kernel_main_secondary(struct smp_cpu *cpu) {
+	// 1. Initialize this CPU state.
+	//
+	// The boot code has already switched to the kernel address space.
+	smp_init_secondary(cpu);
+
+	// 2. Initialize the IRQs of this CPU.
+	trap_init_irqs_secondary();
+
+	// 3. Run the thread scheduler on this CPU.
+	sched_thread_run();
+	panic("unreachable code\n");
+}
@@ -52,7 +52,16 @@ extern char __shell_start[];
 // End of the embedded shell inside the `.rodata` section.
 extern char __shell_end[];
 
+// Entry point of the secondary CPUs started by the smp subsystem.
+extern char __boot_secondary[];
+
 // The machine independent initialization function.
 [[noreturn]] void __kernel_main(void);
 
+// Forward declaration of the per-CPU state.
+struct smp_cpu;
+
+// The machine independent initialization function for secondary CPUs.
+[[noreturn]] void __kernel_main_secondary(struct smp_cpu *cpu);
+
 #endif // KERNEL_BOOT_BOOT_H
@@ -4,16 +4,117 @@
 #ifndef KERNEL_CLOCK_CLOCK_H
 #define KERNEL_CLOCK_CLOCK_H
 
-// Initialize the ticker and arm the first tick.
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+#include <sys/param.h> // for HZ
+#include <sys/types.h> // for __duration64_t
+
+__BEGIN_DECLS
+
+// Number of nanoseconds in a second.
+#define CLOCK_NSEC_PER_SEC 1000000000ULL
+
+// Number of nanoseconds in a microsecond.
+#define CLOCK_NSEC_PER_USEC 1000ULL
+
+// Number of nanoseconds in a jiffy.
+#define CLOCK_NSEC_PER_JIFFY (CLOCK_NSEC_PER_SEC / HZ)
+
+// Consistent copy of the state needed to compute the monotonic time.
+//
+// The clock computes nanoseconds as base_ns plus the counter ticks
+// elapsed since base_cycles scaled by mult >> shift, carrying the
+// fraction of nanosecond in base_frac so no rounding error accumulates.
+struct clock_snapshot {
+	// The counter value when we last updated the snapshot.
+	uint64_t base_cycles;
+
+	// The monotonic time corresponding to base_cycles.
+	__duration64_t base_ns;
+
+	// The fraction of nanosecond at base_cycles, in units of 2^-shift.
+	uint64_t base_frac;
+
+	// The jiffies elapsed at base_cycles.
+	__duration64_t jiffies;
+
+	// The monotonic time when the current jiffy began.
+	__duration64_t jiffy_ns;
+
+	// Factor to convert counter ticks to nanoseconds.
+	uint64_t mult;
+
+	// Fixed-point shift of mult.
+	uint32_t shift;
+};
+
+// Initialize the clocksource.
+//
+// Called by the boot subsystem before using the clock.
+void clock_init_early(void) __NOEXCEPT;
+
+// Copies the current timekeeping state into the given snapshot.
+//
+// Does not write any shared cache line, so many CPUs can read
+// the state concurrently without contention.
+//
+// Safe to call from any context.
+void clock_read_snapshot(struct clock_snapshot *snap) __NOEXCEPT;
+
+// Returns the monotonic time corresponding to the given counter value
+// according to the given snapshot.
+//
+// Counter values preceding the base of the snapshot, which another CPU
+// may have updated after we read the counter, map to its base time.
+static inline __duration64_t clock_snapshot_ns(const struct clock_snapshot *snap, uint64_t cycles) __NOEXCEPT {
+	uint64_t delta = (cycles > snap->base_cycles) ? cycles - snap->base_cycles : 0;
+	unsigned __int128 scaled = (unsigned __int128)delta * snap->mult + snap->base_frac;
+	return snap->base_ns + (__duration64_t)(scaled >> snap->shift);
+}
+
+// Moves the base of the timekeeping state to the current counter value.
+//
+// We invoke this function from the clock interrupt so that the counter
+// ticks elapsed since the base stay small and the jiffies stay current.
+// It writes the state at most once per jiffy.
+void clock_update(void) __NOEXCEPT;
+
+// Returns the number of nanoseconds elapsed since clock_init_early.
+//
+// The value is computed from the hardware counter, hence it does not depend
+// on clock interrupts and its resolution is the one of the counter.
+//
+// Safe to call from any context.
+__duration64_t clock_monotonic_ns(void) __NOEXCEPT;
+
+// Returns the number of jiffies elapsed since clock_init_early.
+//
+// Safe to call from any context.
+__duration64_t clock_jiffies(void) __NOEXCEPT;
+
+// Initialize the clockevent and arm the first tick one jiffy from now.
 //
 // The tick will emit an interrupt.
 //
+// Returns the monotonic time at which the first tick fires.
+//
 // Requires the trap subsystem to be ready.
-void clock_tick_start(void);
+__duration64_t clock_tick_start(void) __NOEXCEPT;
 
-// Re-arm the clock for emitting the next interrupt.
+// Program the clock to emit an interrupt at the given monotonic time.
 //
-// Only meaningful after the first tick.
-void clock_tick_rearm(void);
+// The clock is one-shot: after the interrupt fires, you need to program
+// it again. If the given time is not in the future, the interrupt
+// fires immediately. The interrupt never fires earlier than the
+// given time, so the handler observes an expired deadline.
+//
+// Only meaningful after clock_tick_start.
+void clock_tick_program(__duration64_t deadline_ns) __NOEXCEPT;
+
+// Stop emitting clock interrupts until the next clock_tick_program.
+//
+// Only meaningful after clock_tick_start.
+void clock_tick_stop(void) __NOEXCEPT;
+
+__END_DECLS
 
 #endif // KERNEL_CLOCK_CLOCK_H
@@ -2,35 +2,141 @@
 // Purpose: ARM64 clocksource and clockevent.
 // SPDX-License-Identifier: MIT
 
-#include <kernel/asm/arm64.h>	// for mrs_cntfrq_el0
-#include <kernel/clock/clock.h> // for clock_init_early
-#include <kernel/core/printk.h> // for printk
+#include <kernel/asm/arm64.h>    // for mrs_cntfrq_el0
+#include <kernel/clock/clock.h>   // for clock_init_early
+#include <kernel/core/assert.h>   // for KERNEL_ASSERT
+#include <kernel/core/printk.h>   // for printk
+#include <kernel/core/seqlock.h> // for struct seqlock
 
-#include <sys/param.h> // for HZ
+// CNTP_CTL_EL0 bit enabling the timer.
+#define CNTP_CTL_ENABLE (1 << 0)
 
-static uint64_t ticks_per_interval = 0;
+// CNTP_CTL_EL0 bit masking the timer interrupt.
+#define CNTP_CTL_IMASK (1 << 1)
 
-void clock_tick_start(void) {
+// Fixed-point shift used by the conversion factors below.
+#define CLOCK_SHIFT 32
+
+// Seqlock publishing the timekeeping state.
+//
+// Every CPU reads the state to compute the time, while we write it at
+// most once per jiffy, so readers copy it without taking any lock.
+static struct seqlock tk_lock = SEQLOCK_INITIALIZER;
+
+// The timekeeping state, protected by tk_lock.
+//
+// We compute nanoseconds using a 128-bit product of the elapsed ticks
+// and the mult factor, which avoids divisions on the hot path.
+static struct clock_snapshot tk;
+
+// Factor to convert nanoseconds to counter ticks.
+static uint64_t ns2cyc = 0;
+
+// Returns (value * mult) >> CLOCK_SHIFT without overflowing.
+static inline uint64_t __clock_scale(uint64_t value, uint64_t mult) {
+	return (uint64_t)(((unsigned __int128)value * mult) >> CLOCK_SHIFT);
+}
+
+void clock_init_early(void) {
 	// Get the number of ticks per second used by the hardware.
 	uint64_t freq = mrs_cntfrq_el0();
+	KERNEL_ASSERT(freq > 0 && freq <= CLOCK_NSEC_PER_SEC);
 
-	// Scale the number to obtain a frequency of HZ Hertz.
-	ticks_per_interval = freq / HZ;
+	// Precompute the fixed-point conversion factors and remember
+	// when we started counting.
+	uint64_t flags = seqlock_write_begin(&tk_lock);
+	tk = (struct clock_snapshot){
+	    .base_cycles = mrs_cntpct_el0(),
+	    .mult = (CLOCK_NSEC_PER_SEC << CLOCK_SHIFT) / freq,
+	    .shift = CLOCK_SHIFT,
+	};
+	seqlock_write_end(&tk_lock, flags);
+	ns2cyc = (freq << CLOCK_SHIFT) / CLOCK_NSEC_PER_SEC;
 
-	// Program first expiry relative to now
-	msr_cntp_tval_el0(ticks_per_interval);
+	// Let the user know about the resolution.
+	printk("clock0: counter running at %lld Hz\n", freq);
+}
 
-	// Enable timer and unmask its interrupt (bit 0 = enable, bit 1 = IMASK)
-	msr_cntp_ctl_el0(1);
+void clock_read_snapshot(struct clock_snapshot *snap) {
+	uint32_t sequence;
+	do {
+		sequence = seqlock_read_begin(&tk_lock);
+		*snap = tk;
+	} while (seqlock_read_retry(&tk_lock, sequence));
+}
 
-	// Ensure the new control/tval are visible to the core before continuing.
-	isb();
+void clock_update(void) {
+	// 1. avoid writing the shared state unless a new jiffy began
+	struct clock_snapshot snap;
+	clock_read_snapshot(&snap);
+	if (clock_snapshot_ns(&snap, mrs_cntpct_el0()) - snap.jiffy_ns < CLOCK_NSEC_PER_JIFFY) {
+		return;
+	}
+
+	// 2. move the base to now, carrying the fraction of nanosecond, which
+	// keeps the time exactly what we would compute from the old base
+	uint64_t flags = seqlock_write_begin(&tk_lock);
+	uint64_t now = mrs_cntpct_el0();
+	if (now > tk.base_cycles) {
+		unsigned __int128 scaled = (unsigned __int128)(now - tk.base_cycles) * tk.mult + tk.base_frac;
+		tk.base_cycles = now;
+		tk.base_ns += (__duration64_t)(scaled >> tk.shift);
+		tk.base_frac = (uint64_t)(scaled & ((1ULL << tk.shift) - 1));
+		tk.jiffies = tk.base_ns / CLOCK_NSEC_PER_JIFFY;
+		tk.jiffy_ns = tk.jiffies * CLOCK_NSEC_PER_JIFFY;
+	}
+	seqlock_write_end(&tk_lock, flags);
+}
 
-	// Let the user know we programmed the ticker.
-	printk("clock0: ticking %lld times per second\n", HZ);
+__duration64_t clock_monotonic_ns(void) {
+	struct clock_snapshot snap;
+	clock_read_snapshot(&snap);
+	return clock_snapshot_ns(&snap, mrs_cntpct_el0());
+}
+
+__duration64_t clock_jiffies(void) {
+	// Avoid the division while the jiffy of the snapshot is current
+	struct clock_snapshot snap;
+	clock_read_snapshot(&snap);
+	__duration64_t now_ns = clock_snapshot_ns(&snap, mrs_cntpct_el0());
+	if (now_ns - snap.jiffy_ns < CLOCK_NSEC_PER_JIFFY) {
+		return snap.jiffies;
+	}
+	return now_ns / CLOCK_NSEC_PER_JIFFY;
+}
+
+__duration64_t clock_tick_start(void) {
+	// Program the first expiry relative to now rather than to the epoch,
+	// since secondary CPUs boot later and would get a spurious interrupt
+	__duration64_t deadline_ns = clock_monotonic_ns() + CLOCK_NSEC_PER_JIFFY;
+	clock_tick_program(deadline_ns);
+	return deadline_ns;
+}
+
+void clock_tick_program(__duration64_t deadline_ns) {
+	// 1. convert the time remaining until the deadline to counter ticks.
+	//
+	// Converting the delta, which is small, rather than the absolute time
+	// keeps the fixed-point rounding error negligible, and we add one tick
+	// so that we never fire before the deadline.
+	struct clock_snapshot snap;
+	clock_read_snapshot(&snap);
+	uint64_t now = mrs_cntpct_el0();
+	__duration64_t now_ns = clock_snapshot_ns(&snap, now);
+	__duration64_t delta_ns = (deadline_ns > now_ns) ? deadline_ns - now_ns : 0;
+
+	// 2. use an absolute compare value rather than a relative timer value
+	// so that the interrupt latency does not accumulate as drift.
+	msr_cntp_cval_el0(now + __clock_scale(delta_ns, ns2cyc) + 1);
+
+	// 3. enable timer and unmask its interrupt.
+	msr_cntp_ctl_el0(CNTP_CTL_ENABLE);
+
+	// 4. ensure the new control/cval are visible to the core before continuing.
+	isb();
 }
 
-void clock_tick_rearm(void) {
-	msr_cntp_tval_el0(ticks_per_interval);
+void clock_tick_stop(void) {
+	msr_cntp_ctl_el0(CNTP_CTL_IMASK);
 	isb();
 }
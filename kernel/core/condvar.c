@@ -0,0 +1,44 @@
+// File: kernel/core/condvar.c
+// Purpose: sleeping condition variables.
+// SPDX-License-Identifier: MIT
+
+#include <kernel/core/assert.h>  // for KERNEL_ASSERT
+#include <kernel/core/condvar.h> // the subsystem's API
+#include <kernel/core/mutex.h>   // for mutex_unlock
+#include <kernel/core/waiter.h>  // for struct sync_waiter
+
+void condvar_wait(struct condvar *cv, struct mutex *mtx) {
+	KERNEL_ASSERT(mutex_held(mtx));
+
+	// 1. link ourselves while still holding the mutex
+	struct sync_waiter waiter;
+	__sync_waiter_init(&waiter);
+	uint64_t flags = __sync_lock(&cv->lock);
+	list_push_back(&cv->waiters, &waiter.node);
+	__sync_unlock(&cv->lock, flags);
+
+	// 2. release the mutex and sleep until someone signals us
+	mutex_unlock(mtx);
+	__sync_waiter_sleep(&waiter, &cv->lock);
+
+	// 3. acquire the mutex again before checking the condition
+	mutex_lock(mtx);
+}
+
+void condvar_signal(struct condvar *cv) {
+	uint64_t flags = __sync_lock(&cv->lock);
+	struct list_node *node = list_front(&cv->waiters);
+	if (node != 0) {
+		__sync_waiter_grant_locked(list_entry(node, struct sync_waiter, node));
+	}
+	__sync_unlock(&cv->lock, flags);
+}
+
+void condvar_broadcast(struct condvar *cv) {
+	uint64_t flags = __sync_lock(&cv->lock);
+	struct list_node *node = 0;
+	while ((node = list_front(&cv->waiters)) != 0) {
+		__sync_waiter_grant_locked(list_entry(node, struct sync_waiter, node));
+	}
+	__sync_unlock(&cv->lock, flags);
+}
@@ -0,0 +1,66 @@
+// File: kernel/core/condvar.h
+// Purpose: sleeping condition variables.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_CORE_CONDVAR_H
+#define KERNEL_CORE_CONDVAR_H
+
+#include <kernel/core/list.h>     // for struct list_node
+#include <kernel/core/mutex.h>    // for struct mutex
+#include <kernel/core/spinlock.h> // for struct spinlock
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+
+__BEGIN_DECLS
+
+// Condition variable on which threads sleep until a condition, which
+// a mutex protects, becomes true.
+//
+// The typical usage pattern is:
+//
+//	mutex_lock(&mtx);
+//	while (!condition()) {
+//		condvar_wait(&cv, &mtx);
+//	}
+//	mutex_unlock(&mtx);
+//
+// Initialize using condvar_init or CONDVAR_INITIALIZER.
+struct condvar {
+	// The threads sleeping on the condition variable in FIFO order (see struct sync_waiter).
+	struct list_node waiters;
+
+	// Spinlock protecting the waiters.
+	struct spinlock lock;
+};
+
+// Use this macro to statically initialize a condition variable.
+#define CONDVAR_INITIALIZER(name) {.waiters = LIST_INITIALIZER((name).waiters), .lock = SPINLOCK_INITIALIZER}
+
+// Initialize the condition variable before using it.
+static inline void condvar_init(struct condvar *cv) __NOEXCEPT {
+	list_init(&cv->waiters);
+	spinlock_init(&cv->lock);
+}
+
+// Atomically releases the mutex and sleeps until condvar_signal or
+// condvar_broadcast wakes us up, then acquires the mutex again.
+//
+// We link ourselves before releasing the mutex, so a thread changing
+// the condition while holding the mutex cannot miss us. The condition
+// may be false again by the time we hold the mutex, so check it again.
+//
+// Must be invoked by the thread holding the mutex.
+void condvar_wait(struct condvar *cv, struct mutex *mtx) __NOEXCEPT;
+
+// Wakes up the thread that has been waiting for longer, if any.
+//
+// Safe to call from interrupt context.
+void condvar_signal(struct condvar *cv) __NOEXCEPT;
+
+// Wakes up all the waiting threads.
+//
+// Safe to call from interrupt context.
+void condvar_broadcast(struct condvar *cv) __NOEXCEPT;
+
+__END_DECLS
+
+#endif // KERNEL_CORE_CONDVAR_H
@@ -0,0 +1,186 @@
+// File: kernel/core/heap.h
+// Purpose: intrusive pairing heap.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_CORE_HEAP_H
+#define KERNEL_CORE_HEAP_H
+
+#include <sys/cdefs.h> // for __NOEXCEPT
+#include <sys/types.h> // for size_t
+
+__BEGIN_DECLS
+
+// Node of an intrusive pairing heap.
+//
+// You embed a node inside the structure you want to order and use
+// list_entry (or an equivalent cast) to go back to the containing
+// structure. A zero-initialized node is not linked into any heap.
+struct heap_node {
+	// The first child of this node.
+	struct heap_node *child;
+
+	// The next sibling of this node.
+	struct heap_node *next;
+
+	// The previous sibling or the parent if this is the first child.
+	//
+	// This is zero for the root and for unlinked nodes.
+	struct heap_node *prev;
+};
+
+// Function returning whether a must be popped before b.
+typedef bool(heap_less_t)(const struct heap_node *a, const struct heap_node *b);
+
+// Min-heap ordered by a user-provided comparison function.
+//
+// Insertion is constant time while popping and removing arbitrary
+// nodes cost O(log n) amortized, which makes this data structure a
+// good fit for timer queues where most timers are cancelled before
+// they expire and for schedulers ordering threads by a key.
+//
+// Initialize using heap_init or HEAP_INITIALIZER.
+struct heap {
+	// The node with the minimum key or zero.
+	struct heap_node *root;
+
+	// Number of nodes in the heap.
+	size_t count;
+
+	// The ordering function.
+	heap_less_t *less;
+};
+
+// Use this macro to statically initialize a heap.
+#define HEAP_INITIALIZER(lessfunc) {.root = 0, .count = 0, .less = (lessfunc)}
+
+// Initialize an empty heap ordered by less.
+static inline void heap_init(struct heap *heap, heap_less_t *less) __NOEXCEPT {
+	heap->root = 0;
+	heap->count = 0;
+	heap->less = less;
+}
+
+// Initialize an unlinked heap node.
+static inline void heap_node_init(struct heap_node *node) __NOEXCEPT {
+	node->child = 0;
+	node->next = 0;
+	node->prev = 0;
+}
+
+// Returns whether the heap is empty.
+static inline bool heap_empty(const struct heap *heap) __NOEXCEPT {
+	return heap->root == 0;
+}
+
+// Returns whether node is currently linked into heap.
+static inline bool heap_linked(const struct heap *heap, const struct heap_node *node) __NOEXCEPT {
+	return node->prev != 0 || heap->root == node;
+}
+
+// Returns the node with the minimum key or zero if the heap is empty.
+static inline struct heap_node *heap_min(const struct heap *heap) __NOEXCEPT {
+	return heap->root;
+}
+
+// Internal function to meld two heap roots, either of which may be zero.
+static inline struct heap_node *__heap_meld(struct heap *heap, struct heap_node *a, struct heap_node *b) __NOEXCEPT {
+	// 1. handle the trivial cases
+	if (a == 0) {
+		return b;
+	}
+	if (b == 0) {
+		return a;
+	}
+
+	// 2. the root with the larger key becomes the first child of the other one
+	if (heap->less(b, a)) {
+		struct heap_node *tmp = a;
+		a = b;
+		b = tmp;
+	}
+	b->prev = a;
+	b->next = a->child;
+	if (a->child != 0) {
+		a->child->prev = b;
+	}
+	a->child = b;
+	a->next = 0;
+	a->prev = 0;
+	return a;
+}
+
+// Internal function to meld a list of siblings into a single root using the
+// classic two-pass strategy, which gives the pairing heap its amortized bounds.
+static inline struct heap_node *__heap_merge_pairs(struct heap *heap, struct heap_node *first) __NOEXCEPT {
+	// 1. meld siblings pairwise from left to right, building a stack
+	// of the resulting roots that we link through their prev field
+	struct heap_node *stack = 0;
+	while (first != 0) {
+		struct heap_node *a = first;
+		struct heap_node *b = a->next;
+		first = (b != 0) ? b->next : 0;
+		a->next = a->prev = 0;
+		if (b != 0) {
+			b->next = b->prev = 0;
+		}
+		struct heap_node *root = __heap_meld(heap, a, b);
+		root->prev = stack;
+		stack = root;
+	}
+
+	// 2. meld the resulting roots from right to left
+	struct heap_node *result = 0;
+	while (stack != 0) {
+		struct heap_node *next = stack->prev;
+		stack->prev = 0;
+		result = __heap_meld(heap, result, stack);
+		stack = next;
+	}
+	return result;
+}
+
+// Inserts node, which MUST NOT be linked, into the heap.
+static inline void heap_insert(struct heap *heap, struct heap_node *node) __NOEXCEPT {
+	heap_node_init(node);
+	heap->root = __heap_meld(heap, heap->root, node);
+	heap->count++;
+}
+
+// Removes node, which MUST be linked into the heap.
+static inline void heap_remove(struct heap *heap, struct heap_node *node) __NOEXCEPT {
+	// 1. the root is replaced by the meld of its children
+	if (node == heap->root) {
+		heap->root = __heap_merge_pairs(heap, node->child);
+		heap->count--;
+		heap_node_init(node);
+		return;
+	}
+
+	// 2. otherwise detach node from its parent or previous sibling
+	if (node->prev->child == node) {
+		node->prev->child = node->next;
+	} else {
+		node->prev->next = node->next;
+	}
+	if (node->next != 0) {
+		node->next->prev = node->prev;
+	}
+
+	// 3. and meld its children back into the heap
+	struct heap_node *subtree = __heap_merge_pairs(heap, node->child);
+	heap->root = __heap_meld(heap, heap->root, subtree);
+	heap->count--;
+	heap_node_init(node);
+}
+
+// Removes and returns the node with the minimum key or zero if the heap is empty.
+static inline struct heap_node *heap_pop(struct heap *heap) __NOEXCEPT {
+	struct heap_node *node = heap->root;
+	if (node != 0) {
+		heap_remove(heap, node);
+	}
+	return node;
+}
+
+__END_DECLS
+
+#endif // KERNEL_CORE_HEAP_H
@@ -0,0 +1,42 @@
+// File: kernel/core/irqthread.c
+// Purpose: threaded interrupt handlers.
+// SPDX-License-Identifier: MIT
+
+#include <kernel/core/assert.h>     // for KERNEL_ASSERT
+#include <kernel/core/irqthread.h>  // the subsystem's API
+#include <kernel/sched/sched.h>     // for sched_thread_start
+#include <kernel/sched/waitqueue.h> // for sched_waitqueue_wait
+
+#include <sys/types.h> // for __status_t
+
+void irq_thread_init(struct irq_thread *it, irq_thread_func_t *func, void *opaque) {
+	KERNEL_ASSERT(it != 0 && func != 0);
+	sched_waitqueue_init(&it->wq);
+	it->pending = 0;
+	it->func = func;
+	it->opaque = opaque;
+	it->tid = 0;
+}
+
+// Invokes func after each interrupt.
+[[noreturn]] static void __irq_thread_main(void *opaque) {
+	struct irq_thread *it = (struct irq_thread *)opaque;
+	for (;;) {
+		uint64_t gen = sched_waitqueue_prepare(&it->wq);
+		if (__atomic_exchange_n(&it->pending, 0, __ATOMIC_ACQ_REL) != 0) {
+			it->func(it->opaque);
+			continue;
+		}
+		sched_waitqueue_wait(&it->wq, gen);
+	}
+}
+
+__status_t irq_thread_start(struct irq_thread *it) {
+	KERNEL_ASSERT(it != 0 && it->func != 0);
+	return sched_thread_start(&it->tid, __irq_thread_main, it, SCHED_THREAD_FLAG_FIFO);
+}
+
+void irq_thread_wake(struct irq_thread *it) {
+	__atomic_store_n(&it->pending, 1, __ATOMIC_RELEASE);
+	sched_waitqueue_wake_one(&it->wq);
+}
@@ -0,0 +1,65 @@
+// File: kernel/core/irqthread.h
+// Purpose: threaded interrupt handlers.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_CORE_IRQTHREAD_H
+#define KERNEL_CORE_IRQTHREAD_H
+
+#include <kernel/sched/waitqueue.h> // for struct sched_waitqueue
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+#include <sys/types.h> // for __thread_id_t
+
+__BEGIN_DECLS
+
+// The type of the function implementing a threaded handler.
+typedef void(irq_thread_func_t)(void *opaque);
+
+// Kernel thread running the bottom half of an interrupt handler.
+//
+// The interrupt handler masks the interrupt at the device and wakes up the
+// thread, which does the work with interrupts and preemption enabled, so
+// it may sleep, and unmasks the interrupt when done. The thread uses the
+// SCHED_POLICY_FIFO policy, so it preempts the normal threads.
+//
+// Initialize using irq_thread_init and then start using irq_thread_start.
+//
+// The fields are private, so do not access them directly.
+struct irq_thread {
+	// Queue on which the thread waits for interrupts.
+	struct sched_waitqueue wq;
+
+	// Nonzero when an interrupt occurred since the thread last ran func.
+	uint32_t pending;
+
+	// The function to invoke after each interrupt.
+	irq_thread_func_t *func;
+
+	// The opaque argument for func.
+	void *opaque;
+
+	// The ID of the thread.
+	__thread_id_t tid;
+};
+
+// Initialize the threaded handler before using it.
+//
+// You retain ownership of opaque.
+void irq_thread_init(struct irq_thread *it, irq_thread_func_t *func, void *opaque) __NOEXCEPT;
+
+// Starts the thread.
+//
+// Returns a negative errno value on failure and zero on success.
+//
+// Must be invoked after the scheduler can start threads.
+__status_t irq_thread_start(struct irq_thread *it) __NOEXCEPT;
+
+// Wakes up the thread so that it invokes func.
+//
+// Wakeups occurring before the thread invokes func coalesce.
+//
+// Safe to call from any context.
+void irq_thread_wake(struct irq_thread *it) __NOEXCEPT;
+
+__END_DECLS
+
+#endif // KERNEL_CORE_IRQTHREAD_H
@@ -0,0 +1,119 @@
+// File: kernel/core/list.h
+// Purpose: intrusive doubly-linked circular list.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_CORE_LIST_H
+#define KERNEL_CORE_LIST_H
+
+#include <sys/cdefs.h> // for __NOEXCEPT
+#include <sys/types.h> // for uintptr_t
+
+__BEGIN_DECLS
+
+// Node of an intrusive doubly-linked circular list.
+//
+// You embed a node inside the structure you want to link and use
+// list_entry to go back from the node to the containing structure.
+//
+// The same type is used for the list head, which is a sentinel node
+// that is not embedded into any element. An empty list head points
+// to itself. Use list_init or LIST_INITIALIZER to initialize it.
+//
+// An element node that is not linked into any list also points to
+// itself, which allows to cheaply check with list_linked.
+struct list_node {
+	struct list_node *prev;
+	struct list_node *next;
+};
+
+// Use this macro to statically initialize a list head or node.
+#define LIST_INITIALIZER(name) {.prev = &(name), .next = &(name)}
+
+// Obtain the structure containing the given node.
+#define list_entry(node, type, member) ((type *)((uintptr_t)(node) - __builtin_offsetof(type, member)))
+
+// Initialize a list head or an unlinked node.
+static inline void list_init(struct list_node *node) __NOEXCEPT {
+	node->prev = node;
+	node->next = node;
+}
+
+// Returns whether the list headed by head is empty.
+static inline bool list_empty(const struct list_node *head) __NOEXCEPT {
+	return head->next == head;
+}
+
+// Returns whether the given node is currently linked into a list.
+//
+// A zero-initialized node is considered as not linked.
+static inline bool list_linked(const struct list_node *node) __NOEXCEPT {
+	return node->next != 0 && node->next != node;
+}
+
+// Internal function to link node between prev and next.
+static inline void __list_link(struct list_node *node, struct list_node *prev, struct list_node *next) __NOEXCEPT {
+	node->prev = prev;
+	node->next = next;
+	prev->next = node;
+	next->prev = node;
+}
+
+// Appends node at the end of the list headed by head.
+static inline void list_push_back(struct list_node *head, struct list_node *node) __NOEXCEPT {
+	__list_link(node, head->prev, head);
+}
+
+// Prepends node at the beginning of the list headed by head.
+static inline void list_push_front(struct list_node *head, struct list_node *node) __NOEXCEPT {
+	__list_link(node, head, head->next);
+}
+
+// Unlinks node from the list it belongs to and makes it point to itself.
+static inline void list_remove(struct list_node *node) __NOEXCEPT {
+	node->prev->next = node->next;
+	node->next->prev = node->prev;
+	list_init(node);
+}
+
+// Like list_push_back but publishes the node to readers traversing the
+// list without locks (see `./kernel/core/rcu.h`), so that they observe
+// the node and the element containing it initialized.
+static inline void list_push_back_rcu(struct list_node *head, struct list_node *node) __NOEXCEPT {
+	struct list_node *prev = head->prev;
+	node->prev = prev;
+	node->next = head;
+	__atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+	head->prev = node;
+}
+
+// Like list_remove but leaves the node pointing to its successor, so that
+// readers traversing the list without locks can move past it.
+//
+// Reinitialize the node with list_init only after a grace period.
+static inline void list_remove_rcu(struct list_node *node) __NOEXCEPT {
+	__atomic_store_n(&node->prev->next, node->next, __ATOMIC_RELAXED);
+	node->next->prev = node->prev;
+}
+
+// Returns the node following the given node for readers traversing
+// the list without locks.
+static inline struct list_node *list_next_rcu(const struct list_node *node) __NOEXCEPT {
+	return __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+}
+
+// Returns the first node of the list or zero if the list is empty.
+static inline struct list_node *list_front(const struct list_node *head) __NOEXCEPT {
+	return list_empty(head) ? 0 : head->next;
+}
+
+// Removes and returns the first node of the list or zero if the list is empty.
+static inline struct list_node *list_pop_front(struct list_node *head) __NOEXCEPT {
+	struct list_node *node = list_front(head);
+	if (node != 0) {
+		list_remove(node);
+	}
+	return node;
+}
+
+__END_DECLS
+
+#endif // KERNEL_CORE_LIST_H
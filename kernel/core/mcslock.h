@@ -0,0 +1,112 @@
+// File: kernel/core/mcslock.h
+// Purpose: MCS queued spinlock implementation.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_CORE_MCSLOCK_H
+#define KERNEL_CORE_MCSLOCK_H
+
+#include <kernel/asm/asm.h>      // for cpu_wait_until_uint32
+#include <kernel/core/preempt.h> // for preempt_disable
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+#include <sys/errno.h> // for EAGAIN
+#include <sys/types.h> // for uint32_t
+
+__BEGIN_DECLS
+
+// Queue node through which a CPU waits for a struct mcs_lock.
+//
+// The node usually lives on the stack of the code acquiring the lock
+// and must remain valid until the matching mcs_lock_release.
+struct mcs_node {
+	// The CPU waiting after us, if any.
+	struct mcs_node *next;
+
+	// Nonzero while we must wait for the CPU before us.
+	volatile uint32_t locked;
+};
+
+// Spinlock where each waiting CPU spins on its own struct mcs_node
+// rather than on the lock, so releasing the lock only touches the
+// cache line of the next waiter. CPUs acquire the lock in arrival order.
+//
+// Prefer this lock over struct spinlock for heavily contended locks,
+// where every release of a struct spinlock wakes up all the waiters.
+struct mcs_lock {
+	// The last CPU in the queue or zero when nobody holds the lock.
+	struct mcs_node *tail;
+};
+
+// Use this macro to intialize a static MCS lock.
+#define MCS_LOCK_INITIALIZER {.tail = 0}
+
+// Initialize the MCS lock before using it.
+static inline void mcs_lock_init(struct mcs_lock *lock) {
+	lock->tail = 0;
+}
+
+// Continue spinning until we've acquired the lock.
+//
+// Disables preemption until mcs_lock_release, like spinlock_acquire.
+static inline void mcs_lock_acquire(struct mcs_lock *lock, struct mcs_node *node) {
+	// 1. prepare the node before publishing it
+	preempt_disable();
+	node->next = 0;
+	node->locked = 1;
+
+	// 2. append ourselves to the queue and return if it was empty
+	struct mcs_node *prev = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+	if (prev == 0) {
+		return;
+	}
+
+	// 3. let the previous CPU know about us and wait for it to hand off the lock
+	__atomic_store_n(&prev->next, node, __ATOMIC_RELEASE);
+	cpu_wait_until_uint32(&node->locked, 0);
+}
+
+// Attempt to acquire the lock.
+//
+// Return 0 on success and -EAGAIN on failure.
+//
+// Disables preemption until mcs_lock_release on success.
+static inline __status_t mcs_lock_try_acquire(struct mcs_lock *lock, struct mcs_node *node) {
+	preempt_disable();
+	node->next = 0;
+	node->locked = 1;
+	struct mcs_node *empty = 0;
+	if (!__atomic_compare_exchange_n(&lock->tail, &empty, node, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		preempt_enable();
+		return -EAGAIN;
+	}
+	return 0;
+}
+
+// Release the lock handing it off to the next waiting CPU, if any.
+//
+// The node must be the one used to acquire the lock.
+//
+// Enables preemption again, which may switch to another thread.
+static inline void mcs_lock_release(struct mcs_lock *lock, struct mcs_node *node) {
+	// 1. if nobody is waiting, try to mark the lock as free
+	struct mcs_node *next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+	if (next == 0) {
+		struct mcs_node *expected = node;
+		if (__atomic_compare_exchange_n(&lock->tail, &expected, 0, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+			preempt_enable();
+			return;
+		}
+
+		// 2. a CPU has appended itself but has not linked itself to us yet
+		while ((next = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)) == 0) {
+			cpu_relax();
+		}
+	}
+
+	// 3. hand off the lock to the next CPU
+	__atomic_store_n(&next->locked, 0, __ATOMIC_RELEASE);
+	preempt_enable();
+}
+
+__END_DECLS
+
+#endif // KERNEL_CORE_MCSLOCK_H
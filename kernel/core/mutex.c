@@ -0,0 +1,111 @@
+// File: kernel/core/mutex.c
+// Purpose: sleeping mutual exclusion locks.
+// SPDX-License-Identifier: MIT
+
+#include <kernel/asm/asm.h>     // for cpu_relax
+#include <kernel/core/assert.h> // for KERNEL_ASSERT
+#include <kernel/core/mutex.h>  // the subsystem's API
+#include <kernel/core/waiter.h> // for struct sync_waiter
+#include <kernel/sched/sched.h> // for sched_thread_running
+
+#include <sys/errno.h> // for EAGAIN
+#include <sys/types.h> // for __thread_id_t
+
+// How many times we check whether a running owner has released
+// the mutex before giving up spinning and going to sleep.
+#define MUTEX_SPIN_LIMIT 1024
+
+// The owner of the mutexes acquired before the CPU runs threads.
+#define MUTEX_OWNER_EARLY UINT64_MAX
+
+// Returns the ID we use as the owner when the calling thread acquires a mutex.
+static inline __thread_id_t __mutex_self(void) {
+	__thread_id_t tid = sched_thread_current_id();
+	return (tid != 0) ? tid : MUTEX_OWNER_EARLY;
+}
+
+// Acquires the mutex if it is not held by anyone.
+static inline bool __mutex_try_acquire(struct mutex *mtx, __thread_id_t self) {
+	__thread_id_t unlocked = 0;
+	return __atomic_compare_exchange_n(&mtx->owner, &unlocked, self, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+// Spins while the owner of the mutex is running on another CPU.
+//
+// Returns whether we acquired the mutex.
+static bool __mutex_spin(struct mutex *mtx, __thread_id_t self) {
+	for (size_t idx = 0; idx < MUTEX_SPIN_LIMIT; idx++) {
+		__thread_id_t owner = __atomic_load_n(&mtx->owner, __ATOMIC_RELAXED);
+		if (owner == 0 && __mutex_try_acquire(mtx, self)) {
+			return true;
+		}
+		if (owner != 0 && owner != MUTEX_OWNER_EARLY && !sched_thread_running(owner)) {
+			return false;
+		}
+		cpu_relax();
+	}
+	return false;
+}
+
+void mutex_lock(struct mutex *mtx) {
+	// 1. take the mutex right away if nobody holds it
+	__thread_id_t self = __mutex_self();
+	if (__mutex_try_acquire(mtx, self)) {
+		return;
+	}
+
+	// 2. spin while the owner runs, since it is likely to release
+	// the mutex before we could sleep and wake up again
+	if (__mutex_spin(mtx, self)) {
+		return;
+	}
+
+	// 3. we cannot sleep before the CPU runs threads
+	if (self == MUTEX_OWNER_EARLY) {
+		while (!__mutex_try_acquire(mtx, self)) {
+			cpu_relax();
+		}
+		return;
+	}
+
+	// 4. try again and link ourselves holding the spinlock, so that either
+	// we see the mutex unlocked or mutex_unlock sees us and hands it off
+	struct sync_waiter waiter;
+	__sync_waiter_init(&waiter);
+	uint64_t flags = __sync_lock(&mtx->lock);
+	if (__mutex_try_acquire(mtx, self)) {
+		__sync_unlock(&mtx->lock, flags);
+		return;
+	}
+	list_push_back(&mtx->waiters, &waiter.node);
+	__sync_unlock(&mtx->lock, flags);
+
+	// 5. sleep until mutex_unlock hands off the mutex to us
+	__sync_waiter_sleep(&waiter, &mtx->lock);
+	KERNEL_ASSERT(__atomic_load_n(&mtx->owner, __ATOMIC_RELAXED) == self);
+}
+
+__status_t mutex_trylock(struct mutex *mtx) {
+	return __mutex_try_acquire(mtx, __mutex_self()) ? 0 : -EAGAIN;
+}
+
+void mutex_unlock(struct mutex *mtx) {
+	uint64_t flags = __sync_lock(&mtx->lock);
+	KERNEL_ASSERT(mtx->owner == __mutex_self());
+
+	// Hand off the mutex to the first waiter, which prevents other
+	// threads from stealing it before the waiter gets to run
+	struct list_node *node = list_front(&mtx->waiters);
+	if (node == 0) {
+		__atomic_store_n(&mtx->owner, 0, __ATOMIC_RELEASE);
+	} else {
+		struct sync_waiter *waiter = list_entry(node, struct sync_waiter, node);
+		__atomic_store_n(&mtx->owner, waiter->tid, __ATOMIC_RELEASE);
+		__sync_waiter_grant_locked(waiter);
+	}
+	__sync_unlock(&mtx->lock, flags);
+}
+
+bool mutex_held(struct mutex *mtx) {
+	return __atomic_load_n(&mtx->owner, __ATOMIC_RELAXED) == __mutex_self();
+}
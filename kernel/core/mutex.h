@@ -0,0 +1,70 @@
+// File: kernel/core/mutex.h
+// Purpose: sleeping mutual exclusion locks.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_CORE_MUTEX_H
+#define KERNEL_CORE_MUTEX_H
+
+#include <kernel/core/list.h>     // for struct list_node
+#include <kernel/core/spinlock.h> // for struct spinlock
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+#include <sys/types.h> // for __thread_id_t
+
+__BEGIN_DECLS
+
+// Lock that puts the threads waiting for it to sleep.
+//
+// Use a mutex rather than a spinlock for critical sections that may be
+// long or may sleep. While the owner is running on another CPU, we spin
+// for a while, since the owner is likely to release the mutex before we
+// could sleep and wake up again. Releasing the mutex hands it off to the
+// thread that has been waiting for longer.
+//
+// Initialize using mutex_init or MUTEX_INITIALIZER.
+struct mutex {
+	// The ID of the thread holding the mutex or zero.
+	__thread_id_t owner;
+
+	// The threads sleeping on the mutex in FIFO order (see struct sync_waiter).
+	struct list_node waiters;
+
+	// Spinlock protecting the waiters.
+	struct spinlock lock;
+};
+
+// Use this macro to statically initialize a mutex.
+#define MUTEX_INITIALIZER(name) {.owner = 0, .waiters = LIST_INITIALIZER((name).waiters), .lock = SPINLOCK_INITIALIZER}
+
+// Initialize the mutex before using it.
+static inline void mutex_init(struct mutex *mtx) __NOEXCEPT {
+	mtx->owner = 0;
+	list_init(&mtx->waiters);
+	spinlock_init(&mtx->lock);
+}
+
+// Acquires the mutex, sleeping until it becomes available.
+//
+// Before this CPU runs threads, we spin rather than sleeping.
+//
+// Interrupt handlers MUST NOT use this function.
+void mutex_lock(struct mutex *mtx) __NOEXCEPT;
+
+// Attempts to acquire the mutex without sleeping.
+//
+// Returns 0 on success and -EAGAIN on failure.
+//
+// Safe to call from interrupt context, as long as the interrupt
+// handler releases the mutex before returning.
+__status_t mutex_trylock(struct mutex *mtx) __NOEXCEPT;
+
+// Releases the mutex, handing it off to the first waiter if any.
+//
+// Must be invoked by the thread holding the mutex.
+void mutex_unlock(struct mutex *mtx) __NOEXCEPT;
+
+// Returns whether the calling thread holds the mutex.
+bool mutex_held(struct mutex *mtx) __NOEXCEPT;
+
+__END_DECLS
+
+#endif // KERNEL_CORE_MUTEX_H
@@ -0,0 +1,61 @@
+// File: kernel/core/preempt.h
+// Purpose: kernel preemption control.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_CORE_PREEMPT_H
+#define KERNEL_CORE_PREEMPT_H
+
+#include <kernel/asm/asm.h> // for local_irq_save
+#include <kernel/smp/smp.h> // for smp_this_cpu
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+#include <sys/types.h> // for uint64_t
+
+__BEGIN_DECLS
+
+// Switches to another thread if this CPU should reschedule and
+// the code running on it has not disabled preemption.
+//
+// Implemented by the scheduler.
+//
+// Must be invoked with interrupts enabled.
+void __preempt_schedule(void) __NOEXCEPT;
+
+// Returns how many times the code running on this CPU has disabled preemption.
+static inline uint64_t preempt_count(void) __NOEXCEPT {
+	uint64_t flags = local_irq_save();
+	uint64_t count = smp_this_cpu()->preempt_count;
+	local_irq_restore(flags);
+	return count;
+}
+
+// Prevents the scheduler from switching this CPU to another thread
+// until the matching preempt_enable, which makes it safe to use the
+// per-CPU state and to hold a spinlock with interrupts enabled.
+//
+// Calls nest and each needs a matching preempt_enable.
+static inline void preempt_disable(void) __NOEXCEPT {
+	// We disable interrupts so that we cannot migrate to another
+	// CPU between reading the CPU state and updating the counter
+	uint64_t flags = local_irq_save();
+	smp_this_cpu()->preempt_count++;
+	local_irq_restore(flags);
+}
+
+// Undoes a preempt_disable and, when this enables preemption again,
+// switches to another thread if an interrupt asked this CPU to
+// reschedule in the meanwhile.
+static inline void preempt_enable(void) __NOEXCEPT {
+	// The counter is nonzero so we cannot migrate, and interrupts
+	// restore the counter before returning, so we do not need to
+	// disable interrupts while updating it. However, the compiler
+	// must not move the critical section after the update.
+	__atomic_signal_fence(__ATOMIC_SEQ_CST);
+	uint64_t count = --smp_this_cpu()->preempt_count;
+	if (count == 0 && local_irq_enabled()) {
+		__preempt_schedule();
+	}
+}
+
+__END_DECLS
+
+#endif // KERNEL_CORE_PREEMPT_H
@@ -0,0 +1,139 @@
+// File: kernel/core/rcu.c
+// Purpose: quiescent-state-based read-copy-update.
+// SPDX-License-Identifier: MIT
+
+#include <kernel/asm/asm.h>        // for local_irq_save
+#include <kernel/core/assert.h>    // for KERNEL_ASSERT
+#include <kernel/core/list.h>      // for struct list_node
+#include <kernel/core/preempt.h>   // for preempt_count
+#include <kernel/core/rcu.h>       // the subsystem's API
+#include <kernel/core/semaphore.h> // for struct semaphore
+#include <kernel/core/spinlock.h>  // for struct spinlock
+#include <kernel/smp/smp.h>        // for smp_cpu_online
+#include <kernel/trap/trap.h>      // for trap_send_reschedule_ipi
+
+#include <sys/param.h> // for SMP_MAX_CPUS
+#include <sys/types.h> // for uint64_t
+
+static_assert(SMP_MAX_CPUS <= 64, "__rcu_qs_pending must have a bit per CPU");
+
+// Spinlock protecting the grace periods and the callbacks.
+static struct spinlock lock = SPINLOCK_INITIALIZER;
+
+// Number of grace periods we have started.
+static uint64_t gp_started;
+
+// Number of grace periods that have ended.
+//
+// A grace period is in progress when it differs from gp_started.
+static uint64_t gp_completed;
+
+// Written holding the spinlock and read locklessly, so that
+// CPUs that have nothing to report do not take the spinlock.
+uint64_t __rcu_qs_pending;
+
+// Callbacks waiting for their grace period in the order they were queued,
+// which is also the order of their grace periods.
+static struct list_node callbacks = LIST_INITIALIZER(callbacks);
+
+// Starts a grace period and asks the online CPUs to report.
+//
+// Interrupting a CPU is enough for it to report, unless it is
+// reading, in which case it reports once it stops reading.
+//
+// Must be invoked while holding the spinlock.
+static void __rcu_gp_start_locked(void) {
+	gp_started++;
+	uint64_t pending = 0;
+	for (size_t id = 0; id < SMP_MAX_CPUS; id++) {
+		if (smp_cpu_online(id)) {
+			pending |= 1ULL << id;
+		}
+	}
+	__atomic_store_n(&__rcu_qs_pending, pending, __ATOMIC_RELAXED);
+	for (size_t id = 0; id < SMP_MAX_CPUS; id++) {
+		if ((pending & (1ULL << id)) != 0) {
+			trap_send_reschedule_ipi(id);
+		}
+	}
+}
+
+void call_rcu(struct rcu_head *head, rcu_callback_t *func) {
+	KERNEL_ASSERT(head != 0 && func != 0);
+	uint64_t flags = spinlock_acquire_irqsave(&lock);
+
+	// A grace period already in progress may have begun before the
+	// caller removed the element, so we must wait for the next one
+	head->func = func;
+	head->gp = gp_started + 1;
+	list_push_back(&callbacks, &head->node);
+	if (gp_started == gp_completed) {
+		__rcu_gp_start_locked();
+	}
+	spinlock_release_irqrestore(&lock, flags);
+}
+
+void rcu_quiescent_state(void) {
+	// 1. avoid taking the spinlock unless the grace period waits for us
+	uint64_t self = 1ULL << smp_cpu_id();
+	if ((__atomic_load_n(&__rcu_qs_pending, __ATOMIC_RELAXED) & self) == 0) {
+		return;
+	}
+
+	// 2. report and, if we were the last CPU, end the grace period,
+	// collect the callbacks waiting for it and start the next one
+	struct list_node ready = LIST_INITIALIZER(ready);
+	spinlock_acquire(&lock);
+	uint64_t pending = __rcu_qs_pending & ~self;
+	__atomic_store_n(&__rcu_qs_pending, pending, __ATOMIC_RELAXED);
+	if (pending == 0 && gp_started != gp_completed) {
+		gp_completed = gp_started;
+		struct list_node *node;
+		while ((node = list_front(&callbacks)) != 0 && rcu_entry(node, struct rcu_head, node)->gp <= gp_completed) {
+			list_remove(node);
+			list_push_back(&ready, node);
+		}
+		if (!list_empty(&callbacks)) {
+			__rcu_gp_start_locked();
+		}
+	}
+	spinlock_release(&lock);
+
+	// 3. invoke the callbacks without holding the spinlock, since they
+	// may queue other callbacks
+	struct list_node *node;
+	while ((node = list_pop_front(&ready)) != 0) {
+		struct rcu_head *head = rcu_entry(node, struct rcu_head, node);
+		head->func(head);
+	}
+}
+
+void __rcu_read_unlock_slow(void) {
+	uint64_t flags = local_irq_save();
+	if (smp_this_cpu()->preempt_count == 0) {
+		rcu_quiescent_state();
+	}
+	local_irq_restore(flags);
+}
+
+// Grace period synchronize_rcu waits for.
+struct rcu_sync {
+	// The callback ending the wait.
+	struct rcu_head head;
+
+	// Semaphore the callback releases.
+	struct semaphore done;
+};
+
+// Wakes up the thread waiting in synchronize_rcu.
+static void __rcu_sync_done(struct rcu_head *head) {
+	semaphore_up(&rcu_entry(head, struct rcu_sync, head)->done);
+}
+
+void synchronize_rcu(void) {
+	KERNEL_ASSERT(preempt_count() == 0);
+	struct rcu_sync sync;
+	semaphore_init(&sync.done, 0);
+	call_rcu(&sync.head, __rcu_sync_done);
+	semaphore_down(&sync.done);
+}
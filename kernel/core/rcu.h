@@ -0,0 +1,110 @@
+// File: kernel/core/rcu.h
+// Purpose: quiescent-state-based read-copy-update.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_CORE_RCU_H
+#define KERNEL_CORE_RCU_H
+
+#include <kernel/core/list.h>    // for struct list_node
+#include <kernel/core/preempt.h> // for preempt_disable
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+#include <sys/types.h> // for uint64_t
+
+__BEGIN_DECLS
+
+// Read-copy-update lets readers of read-mostly structures run without
+// locks, while writers, which still serialize using a lock, unlink the
+// elements they remove and defer freeing them until no reader can be
+// using them anymore.
+//
+// Readers run with preemption disabled, so a CPU that switches context,
+// or that we interrupt while preemption is enabled, is not reading. We
+// call that a quiescent state. A grace period ends when every online
+// CPU has passed through a quiescent state since it began, and we free
+// the elements removed before it began only after it ends.
+
+// Forward declaration.
+struct rcu_head;
+
+// Function invoked after a grace period (see call_rcu).
+typedef void rcu_callback_t(struct rcu_head *head);
+
+// Deferred callback embedded into the structure to free.
+struct rcu_head {
+	// Links the callback into the list of pending callbacks.
+	struct list_node node;
+
+	// The function to invoke.
+	rcu_callback_t *func;
+
+	// The grace period that must end before we invoke func.
+	uint64_t gp;
+};
+
+// Obtain the structure containing the given struct rcu_head.
+#define rcu_entry(head, type, member) ((type *)((uintptr_t)(head) - __builtin_offsetof(type, member)))
+
+// Reads a pointer that writers publish using rcu_assign_pointer.
+#define rcu_dereference(ptr) __atomic_load_n(&(ptr), __ATOMIC_ACQUIRE)
+
+// Publishes a pointer to readers, who observe the pointee initialized.
+#define rcu_assign_pointer(ptr, value) __atomic_store_n(&(ptr), (value), __ATOMIC_RELEASE)
+
+// Bitmask of the CPUs that must pass through a quiescent
+// state before the current grace period ends.
+//
+// Use rcu_read_unlock instead of accessing this directly.
+extern uint64_t __rcu_qs_pending;
+
+// Reports a quiescent state if we are not reading anymore.
+//
+// Use rcu_read_unlock instead of calling this directly.
+void __rcu_read_unlock_slow(void) __NOEXCEPT;
+
+// Begins a read-side critical section, which may nest.
+//
+// The elements we reach within the critical section remain valid until
+// the matching rcu_read_unlock. Code within it MUST NOT sleep.
+static inline void rcu_read_lock(void) __NOEXCEPT {
+	preempt_disable();
+}
+
+// Ends a read-side critical section.
+//
+// If a grace period is waiting for this CPU and we are not reading
+// anymore, we report the quiescent state right away, since otherwise a
+// CPU running a thread without clock interrupts would delay it forever.
+static inline void rcu_read_unlock(void) __NOEXCEPT {
+	preempt_enable();
+	if (__atomic_load_n(&__rcu_qs_pending, __ATOMIC_RELAXED) != 0) {
+		__rcu_read_unlock_slow();
+	}
+}
+
+// Invokes func with the given head after a grace period.
+//
+// Callbacks run with interrupts disabled and MUST NOT sleep.
+//
+// Safe to call from any context.
+void call_rcu(struct rcu_head *head, rcu_callback_t *func) __NOEXCEPT;
+
+// Waits for a grace period to end, so that the elements removed
+// before calling this function are not in use anymore.
+//
+// MUST NOT be invoked within a read-side critical section
+// or by interrupt handlers, since it sleeps.
+void synchronize_rcu(void) __NOEXCEPT;
+
+// Reports that this CPU is in a quiescent state and, if this ends the
+// grace period, invokes the callbacks that were waiting for it.
+//
+// Called by the scheduler when switching context and when returning
+// from interrupts that arrived while preemption was enabled.
+//
+// Must be invoked with interrupts disabled and outside of read-side
+// critical sections.
+void rcu_quiescent_state(void) __NOEXCEPT;
+
+__END_DECLS
+
+#endif // KERNEL_CORE_RCU_H
@@ -0,0 +1,49 @@
+// File: kernel/core/semaphore.c
+// Purpose: sleeping counting semaphores.
+// SPDX-License-Identifier: MIT
+
+#include <kernel/core/semaphore.h> // the subsystem's API
+#include <kernel/core/waiter.h>    // for struct sync_waiter
+
+#include <sys/errno.h> // for EAGAIN
+#include <sys/types.h> // for size_t
+
+void semaphore_down(struct semaphore *sem) {
+	// 1. take a unit right away if available
+	uint64_t flags = __sync_lock(&sem->lock);
+	if (sem->count > 0) {
+		sem->count--;
+		__sync_unlock(&sem->lock, flags);
+		return;
+	}
+
+	// 2. otherwise link ourselves and sleep until semaphore_up hands off
+	// a unit to us, which does not go through the count
+	struct sync_waiter waiter;
+	__sync_waiter_init(&waiter);
+	list_push_back(&sem->waiters, &waiter.node);
+	__sync_unlock(&sem->lock, flags);
+	__sync_waiter_sleep(&waiter, &sem->lock);
+}
+
+__status_t semaphore_try_down(struct semaphore *sem) {
+	uint64_t flags = __sync_lock(&sem->lock);
+	__status_t rc = -EAGAIN;
+	if (sem->count > 0) {
+		sem->count--;
+		rc = 0;
+	}
+	__sync_unlock(&sem->lock, flags);
+	return rc;
+}
+
+void semaphore_up(struct semaphore *sem) {
+	uint64_t flags = __sync_lock(&sem->lock);
+	struct list_node *node = list_front(&sem->waiters);
+	if (node == 0) {
+		sem->count++;
+	} else {
+		__sync_waiter_grant_locked(list_entry(node, struct sync_waiter, node));
+	}
+	__sync_unlock(&sem->lock, flags);
+}
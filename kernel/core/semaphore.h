@@ -0,0 +1,63 @@
+// File: kernel/core/semaphore.h
+// Purpose: sleeping counting semaphores.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_CORE_SEMAPHORE_H
+#define KERNEL_CORE_SEMAPHORE_H
+
+#include <kernel/core/list.h>     // for struct list_node
+#include <kernel/core/spinlock.h> // for struct spinlock
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+#include <sys/types.h> // for size_t
+
+__BEGIN_DECLS
+
+// Counting semaphore that puts the threads waiting for it to sleep.
+//
+// Releasing the semaphore while threads are waiting hands off the unit
+// to the thread that has been waiting for longer, without incrementing
+// the count, so that other threads cannot steal it.
+//
+// Initialize using semaphore_init or SEMAPHORE_INITIALIZER.
+struct semaphore {
+	// The number of available units.
+	size_t count;
+
+	// The threads sleeping on the semaphore in FIFO order (see struct sync_waiter).
+	struct list_node waiters;
+
+	// Spinlock protecting the count and the waiters.
+	struct spinlock lock;
+};
+
+// Use this macro to statically initialize a semaphore with the given count.
+#define SEMAPHORE_INITIALIZER(name, value)                                                                   \
+	{.count = (value), .waiters = LIST_INITIALIZER((name).waiters), .lock = SPINLOCK_INITIALIZER}
+
+// Initialize the semaphore with the given count before using it.
+static inline void semaphore_init(struct semaphore *sem, size_t count) __NOEXCEPT {
+	sem->count = count;
+	list_init(&sem->waiters);
+	spinlock_init(&sem->lock);
+}
+
+// Takes a unit, sleeping until one becomes available.
+//
+// Interrupt handlers MUST NOT use this function.
+void semaphore_down(struct semaphore *sem) __NOEXCEPT;
+
+// Attempts to take a unit without sleeping.
+//
+// Returns 0 on success and -EAGAIN on failure.
+//
+// Safe to call from interrupt context.
+__status_t semaphore_try_down(struct semaphore *sem) __NOEXCEPT;
+
+// Returns a unit, handing it off to the first waiter if any.
+//
+// Safe to call from interrupt context.
+void semaphore_up(struct semaphore *sem) __NOEXCEPT;
+
+__END_DECLS
+
+#endif // KERNEL_CORE_SEMAPHORE_H
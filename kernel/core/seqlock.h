@@ -0,0 +1,82 @@
+// File: kernel/core/seqlock.h
+// Purpose: sequence locks for read-mostly data.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_CORE_SEQLOCK_H
+#define KERNEL_CORE_SEQLOCK_H
+
+#include <kernel/asm/asm.h>       // for dmb_ishld
+#include <kernel/core/spinlock.h> // for struct spinlock
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+#include <sys/types.h> // for uint32_t
+
+__BEGIN_DECLS
+
+// Protects read-mostly data that readers copy without writing any
+// shared cache line, so that many CPUs can read it at the same time.
+//
+// Writers serialize using the spinlock and increment the sequence before
+// and after updating the data, so the sequence is odd while they write.
+// Readers retry when the sequence was odd or changed while they copied.
+//
+// Readers must only copy the data, since they may observe it torn, and
+// must not dereference pointers stored in it.
+struct seqlock {
+	// Incremented twice by each writer.
+	volatile uint32_t sequence;
+
+	// Serializes the writers.
+	struct spinlock lock;
+};
+
+// Use this macro to intialize a static seqlock.
+#define SEQLOCK_INITIALIZER {.sequence = 0, .lock = SPINLOCK_INITIALIZER}
+
+// Initialize the seqlock before using it.
+static inline void seqlock_init(struct seqlock *lock) __NOEXCEPT {
+	lock->sequence = 0;
+	spinlock_init(&lock->lock);
+}
+
+// Begins reading and returns the sequence to pass to seqlock_read_retry.
+//
+// Waits for a concurrent writer to finish, if any.
+static inline uint32_t seqlock_read_begin(const struct seqlock *lock) __NOEXCEPT {
+	uint32_t sequence;
+	while (((sequence = __atomic_load_n(&lock->sequence, __ATOMIC_RELAXED)) & 1) != 0) {
+		cpu_relax();
+	}
+	dmb_ishld(); // read the sequence before the data
+	return sequence;
+}
+
+// Returns whether the data we read since seqlock_read_begin may be
+// inconsistent, in which case we must read it again.
+static inline bool seqlock_read_retry(const struct seqlock *lock, uint32_t sequence) __NOEXCEPT {
+	dmb_ishld(); // read the data before the sequence
+	return __atomic_load_n(&lock->sequence, __ATOMIC_RELAXED) != sequence;
+}
+
+// Begins writing, excluding the other writers.
+//
+// Returns the interrupt state to pass to seqlock_write_end.
+//
+// We disable interrupts, since a reader interrupting the writer
+// on the same CPU would otherwise wait forever.
+static inline uint64_t seqlock_write_begin(struct seqlock *lock) __NOEXCEPT {
+	uint64_t flags = spinlock_acquire_irqsave(&lock->lock);
+	__atomic_store_n(&lock->sequence, lock->sequence + 1, __ATOMIC_RELAXED);
+	dmb_ishst(); // write the sequence before the data
+	return flags;
+}
+
+// Ends writing and restores the interrupt state saved by seqlock_write_begin.
+static inline void seqlock_write_end(struct seqlock *lock, uint64_t flags) __NOEXCEPT {
+	dmb_ishst(); // write the data before the sequence
+	__atomic_store_n(&lock->sequence, lock->sequence + 1, __ATOMIC_RELAXED);
+	spinlock_release_irqrestore(&lock->lock, flags);
+}
+
+__END_DECLS
+
+#endif // KERNEL_CORE_SEQLOCK_H
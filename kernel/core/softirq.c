@@ -0,0 +1,171 @@
+// File: kernel/core/softirq.c
+// Purpose: deferred interrupt work (softirqs and tasklets).
+// SPDX-License-Identifier: MIT
+
+#include <kernel/asm/asm.h>      // for local_irq_save
+#include <kernel/core/assert.h>  // for KERNEL_ASSERT
+#include <kernel/core/preempt.h> // for preempt_disable
+#include <kernel/core/softirq.h> // the subsystem's API
+#include <kernel/smp/smp.h>      // for smp_cpu_id
+#include <kernel/trap/trap.h>    // for trap_send_reschedule_ipi
+
+#include <sys/param.h> // for CACHE_LINE_SIZE, SMP_MAX_CPUS
+#include <sys/types.h> // for uint32_t
+
+// How many times we process the softirqs raised while processing them
+// before letting threads run, so that interrupts arriving at a high rate
+// cannot starve the threads.
+#define SOFTIRQ_MAX_RESTART 8
+
+// The tasklet is waiting to run.
+#define __TASKLET_STATE_SCHEDULED (1 << 0)
+
+// The tasklet is running on some CPU.
+#define __TASKLET_STATE_RUNNING (1 << 1)
+
+// Per-CPU softirq state.
+//
+// Only the owning CPU accesses its state, with interrupts disabled.
+struct softirq_cpu {
+	// Bitmask of the pending softirqs.
+	alignas(CACHE_LINE_SIZE) uint32_t pending;
+
+	// Number of nested interrupt handlers we are running.
+	uint32_t irq_depth;
+
+	// Whether we are running the softirqs.
+	bool running;
+
+	// The scheduled tasklets in FIFO order.
+	struct tasklet *tasklets;
+	struct tasklet **tasklets_tail;
+};
+
+// The softirq state of each CPU.
+static struct softirq_cpu cpus[SMP_MAX_CPUS];
+
+// Runs the scheduled tasklets of this CPU.
+static void __tasklet_softirq(void);
+
+// The function handling each softirq.
+static softirq_func_t *handlers[SOFTIRQ_COUNT] = {
+    [SOFTIRQ_TASKLET] = __tasklet_softirq,
+};
+
+// Returns the softirq state of this CPU.
+//
+// Must be invoked with interrupts or preemption disabled.
+static inline struct softirq_cpu *__softirq_this_cpu(void) {
+	return &cpus[smp_cpu_id()];
+}
+
+void softirq_register(uint32_t nr, softirq_func_t *func) {
+	KERNEL_ASSERT(nr < SOFTIRQ_COUNT && func != 0);
+	handlers[nr] = func;
+}
+
+void softirq_raise(uint32_t nr) {
+	KERNEL_ASSERT(nr < SOFTIRQ_COUNT);
+	uint64_t flags = local_irq_save();
+	struct softirq_cpu *cpu = __softirq_this_cpu();
+	cpu->pending |= 1u << nr;
+	if (cpu->irq_depth == 0 && !cpu->running) {
+		trap_send_reschedule_ipi(cpu - cpus);
+	}
+	local_irq_restore(flags);
+}
+
+void softirq_irq_enter(void) {
+	__softirq_this_cpu()->irq_depth++;
+}
+
+// Runs the pending softirqs with interrupts enabled.
+//
+// Must be invoked with interrupts disabled.
+static void __softirq_run(struct softirq_cpu *cpu) {
+	// 1. disable preemption, so that we do not migrate while interrupts
+	// are enabled and the threads we wake up wait for us to finish
+	cpu->running = true;
+	preempt_disable();
+
+	// 2. run the softirqs, including those raised while running
+	for (size_t restart = 0; cpu->pending != 0 && restart < SOFTIRQ_MAX_RESTART; restart++) {
+		uint32_t pending = cpu->pending;
+		cpu->pending = 0;
+		local_irq_enable();
+		while (pending != 0) {
+			uint32_t nr = (uint32_t)__builtin_ctz(pending);
+			pending &= pending - 1;
+			KERNEL_ASSERT(handlers[nr] != 0);
+			handlers[nr]();
+		}
+		local_irq_disable();
+	}
+
+	// 3. let threads run before we process what is left, which
+	// we do when returning from the interrupt we send ourselves
+	preempt_enable();
+	cpu->running = false;
+	if (cpu->pending != 0) {
+		trap_send_reschedule_ipi(cpu - cpus);
+	}
+}
+
+void softirq_irq_exit(void) {
+	struct softirq_cpu *cpu = __softirq_this_cpu();
+	KERNEL_ASSERT(cpu->irq_depth > 0);
+	cpu->irq_depth--;
+	if (cpu->irq_depth == 0 && !cpu->running && cpu->pending != 0) {
+		__softirq_run(cpu);
+	}
+}
+
+// Appends the tasklet to the scheduled tasklets of the given CPU.
+//
+// Must be invoked with interrupts disabled.
+static void __tasklet_enqueue(struct softirq_cpu *cpu, struct tasklet *t) {
+	if (cpu->tasklets == 0) {
+		cpu->tasklets_tail = &cpu->tasklets;
+	}
+	t->next = 0;
+	*cpu->tasklets_tail = t;
+	cpu->tasklets_tail = &t->next;
+}
+
+void tasklet_schedule(struct tasklet *t) {
+	KERNEL_ASSERT(t != 0 && t->func != 0);
+	uint64_t flags = local_irq_save();
+	if ((__atomic_fetch_or(&t->state, __TASKLET_STATE_SCHEDULED, __ATOMIC_ACQ_REL) & __TASKLET_STATE_SCHEDULED) == 0) {
+		__tasklet_enqueue(__softirq_this_cpu(), t);
+		softirq_raise(SOFTIRQ_TASKLET);
+	}
+	local_irq_restore(flags);
+}
+
+static void __tasklet_softirq(void) {
+	// 1. take the scheduled tasklets, so that those scheduled
+	// while we run them wait for the next round
+	uint64_t flags = local_irq_save();
+	struct softirq_cpu *cpu = __softirq_this_cpu();
+	struct tasklet *t = cpu->tasklets;
+	cpu->tasklets = 0;
+	local_irq_restore(flags);
+
+	// 2. run each tasklet, unless another CPU is running it, in which
+	// case we try again later, since it must not run concurrently
+	while (t != 0) {
+		struct tasklet *next = t->next;
+		if ((__atomic_fetch_or(&t->state, __TASKLET_STATE_RUNNING, __ATOMIC_ACQUIRE) & __TASKLET_STATE_RUNNING) != 0) {
+			flags = local_irq_save();
+			__tasklet_enqueue(cpu, t);
+			softirq_raise(SOFTIRQ_TASKLET);
+			local_irq_restore(flags);
+			t = next;
+			continue;
+		}
+		__atomic_fetch_and(&t->state, ~__TASKLET_STATE_SCHEDULED, __ATOMIC_ACQ_REL);
+		t->func(t->opaque);
+		__atomic_fetch_and(&t->state, ~__TASKLET_STATE_RUNNING, __ATOMIC_RELEASE);
+		t = next;
+	}
+}
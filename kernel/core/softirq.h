@@ -0,0 +1,107 @@
+// File: kernel/core/softirq.h
+// Purpose: deferred interrupt work (softirqs and tasklets).
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_CORE_SOFTIRQ_H
+#define KERNEL_CORE_SOFTIRQ_H
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+#include <sys/types.h> // for uint32_t
+
+__BEGIN_DECLS
+
+// Interrupt handlers (i.e., top halves) acknowledge the device and raise
+// a softirq, which runs the rest of the work (i.e., the bottom half) when
+// the outermost interrupt handler returns, with interrupts enabled and
+// preemption disabled. Softirqs follow the same rules as interrupt
+// handlers: they MUST NOT sleep and they must acquire the spinlocks
+// they share with threads using spinlock_acquire_irqsave.
+//
+// Each CPU runs the softirqs it raised, in the order of their numbers.
+
+// Expires the timer wheel (see `./kernel/sched/timer.h`).
+#define SOFTIRQ_TIMER 0
+
+// Runs the tasklets.
+#define SOFTIRQ_TASKLET 1
+
+// Number of softirqs.
+#define SOFTIRQ_COUNT 2
+
+// The type of the function handling a softirq.
+typedef void(softirq_func_t)(void);
+
+// Sets the function handling the given softirq.
+//
+// Called by the subsystem owning the softirq during early boot.
+void softirq_register(uint32_t nr, softirq_func_t *func) __NOEXCEPT;
+
+// Marks the given softirq as pending on this CPU.
+//
+// When called outside of interrupt handlers, we interrupt this CPU,
+// so that the softirq runs as soon as interrupts are enabled.
+//
+// Safe to call from any context.
+void softirq_raise(uint32_t nr) __NOEXCEPT;
+
+// Notifies that we started handling an interrupt.
+//
+// Called by the trap subsystem with interrupts disabled.
+void softirq_irq_enter(void) __NOEXCEPT;
+
+// Notifies that we finished handling an interrupt and runs the pending
+// softirqs when returning from the outermost interrupt handler.
+//
+// Called by the trap subsystem with interrupts disabled, after it
+// has signalled the end of the interrupt to the interrupt controller,
+// and returns with interrupts disabled.
+void softirq_irq_exit(void) __NOEXCEPT;
+
+// The type of the function implementing a tasklet.
+typedef void(tasklet_func_t)(void *opaque);
+
+// Deferred function that interrupt handlers schedule.
+//
+// A tasklet runs in the SOFTIRQ_TASKLET softirq of the CPU that scheduled
+// it, and it never runs on two CPUs at the same time. Scheduling a tasklet
+// that is already scheduled has no effect, while scheduling it while it
+// runs makes it run again.
+//
+// Initialize using tasklet_init or TASKLET_INITIALIZER.
+//
+// The softirq subsystem protects the fields, so do not access
+// them directly and use the functions below.
+struct tasklet {
+	// The next scheduled tasklet of the same CPU.
+	struct tasklet *next;
+
+	// The function to invoke.
+	tasklet_func_t *func;
+
+	// The opaque argument for func.
+	void *opaque;
+
+	// The state bits (see __TASKLET_STATE_xxx).
+	uint32_t state;
+};
+
+// Use this macro to statically initialize a tasklet.
+#define TASKLET_INITIALIZER(f, o) {.next = 0, .func = (f), .opaque = (o), .state = 0}
+
+// Initialize a tasklet before using it.
+//
+// You retain ownership of opaque.
+static inline void tasklet_init(struct tasklet *t, tasklet_func_t *func, void *opaque) __NOEXCEPT {
+	t->next = 0;
+	t->func = func;
+	t->opaque = opaque;
+	t->state = 0;
+}
+
+// Schedules the tasklet to run on this CPU.
+//
+// Safe to call from any context.
+void tasklet_schedule(struct tasklet *t) __NOEXCEPT;
+
+__END_DECLS
+
+#endif // KERNEL_CORE_SOFTIRQ_H
@@ -0,0 +1,44 @@
+// File: kernel/core/spinlock.c
+// Purpose: spinlock debugging checks.
+// SPDX-License-Identifier: MIT
+
+#include <kernel/asm/asm.h>       // for mrs_cntpct_el0
+#include <kernel/core/panic.h>    // for panic
+#include <kernel/core/spinlock.h> // the subsystem's API
+#include <kernel/smp/smp.h>       // for smp_this_cpu
+
+#ifdef SPINLOCK_DEBUG
+
+// Returns the value identifying this CPU as the owner of a lock.
+//
+// The caller has disabled preemption, so we cannot migrate.
+static inline uint64_t __spinlock_debug_self(void) {
+	return smp_this_cpu()->id + 1;
+}
+
+void __spinlock_debug_acquire(struct spinlock *lock) {
+	if (__atomic_load_n(&lock->owner_cpu, __ATOMIC_RELAXED) == __spinlock_debug_self()) {
+		panic("spinlock: %llx: recursive acquire at %llx (held since %llx)\n", (uintptr_t)lock,
+		      (uintptr_t)__builtin_return_address(0), lock->owner_pc);
+	}
+}
+
+void __spinlock_debug_acquired(struct spinlock *lock) {
+	lock->owner_pc = (uintptr_t)__builtin_return_address(0);
+	lock->acquired_ticks = mrs_cntpct_el0();
+	__atomic_store_n(&lock->owner_cpu, __spinlock_debug_self(), __ATOMIC_RELAXED);
+}
+
+void __spinlock_debug_release(struct spinlock *lock) {
+	if (lock->owner_cpu != __spinlock_debug_self()) {
+		panic("spinlock: %llx: released at %llx by CPU %lld but owned by %lld\n", (uintptr_t)lock,
+		      (uintptr_t)__builtin_return_address(0), __spinlock_debug_self() - 1, lock->owner_cpu - 1);
+	}
+	uint64_t held = mrs_cntpct_el0() - lock->acquired_ticks;
+	if (held > lock->max_hold_ticks) {
+		lock->max_hold_ticks = held;
+	}
+	__atomic_store_n(&lock->owner_cpu, 0, __ATOMIC_RELAXED);
+}
+
+#endif // SPINLOCK_DEBUG
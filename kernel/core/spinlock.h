@@ -4,43 +4,152 @@
 #ifndef KERNEL_CORE_SPINLOCK_H
 #define KERNEL_CORE_SPINLOCK_H
 
+#include <kernel/asm/asm.h>      // for cpu_wait_until_uint16
+#include <kernel/core/preempt.h> // for preempt_disable
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
 #include <sys/errno.h> // for EAGAIN
-#include <sys/types.h> // for uint8_t
+#include <sys/types.h> // for uint16_t
+
+__BEGIN_DECLS
 
 // Contains a lock we will spin on.
+//
+// This is a ticket lock: each CPU takes the next ticket and waits until
+// the lock serves its ticket, so CPUs acquire the lock in arrival order
+// and none of them starves. Waiting CPUs sleep until the holder writes
+// the lock, rather than hammering its cache line.
+//
+// Build with -DSPINLOCK_DEBUG to record the owner and the hold time
+// and to panic on recursive acquisition and on foreign release.
 struct spinlock {
-	// The value controlling spin locking.
-	volatile uint8_t value;
+	union {
+		// Both tickets, for updating them together.
+		volatile uint32_t value;
+
+		struct {
+			// The ticket currently holding the lock.
+			volatile uint16_t owner;
+
+			// The next ticket to hand out.
+			volatile uint16_t next;
+		} tickets;
+	};
+
+#ifdef SPINLOCK_DEBUG
+	// The ID of the CPU holding the lock plus one, or zero.
+	uint64_t owner_cpu;
+
+	// The address of the code that acquired the lock.
+	uintptr_t owner_pc;
+
+	// The counter value when the owner acquired the lock.
+	uint64_t acquired_ticks;
+
+	// The longest the lock has been held, in counter ticks.
+	uint64_t max_hold_ticks;
+#endif
 };
 
 // Use this macro to intialize a static spinlock.
 #define SPINLOCK_INITIALIZER {.value = 0}
 
+#ifdef SPINLOCK_DEBUG
+// Panics if this CPU already holds the lock, which would deadlock.
+void __spinlock_debug_acquire(struct spinlock *lock) __NOEXCEPT;
+
+// Records that this CPU now holds the lock and the address of the calling code.
+void __spinlock_debug_acquired(struct spinlock *lock) __NOEXCEPT;
+
+// Panics unless this CPU holds the lock and updates the hold time.
+void __spinlock_debug_release(struct spinlock *lock) __NOEXCEPT;
+#endif
+
 // Initialize the spinlock before using it.
 static inline void spinlock_init(struct spinlock *lock) {
 	lock->value = 0;
+#ifdef SPINLOCK_DEBUG
+	lock->owner_cpu = 0;
+	lock->owner_pc = 0;
+	lock->acquired_ticks = 0;
+	lock->max_hold_ticks = 0;
+#endif
 }
 
 // Continue spinning until we've acquired the lock.
+//
+// Disables preemption until spinlock_release, since a thread spinning
+// on this CPU would otherwise wait for a holder that cannot run.
 static inline void spinlock_acquire(struct spinlock *lock) {
-	while (__atomic_test_and_set(&lock->value, __ATOMIC_ACQUIRE)) {
-		// 🌀🌀🌀🌀
+	preempt_disable();
+#ifdef SPINLOCK_DEBUG
+	__spinlock_debug_acquire(lock);
+#endif
+	uint16_t ticket = __atomic_fetch_add(&lock->tickets.next, 1, __ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&lock->tickets.owner, __ATOMIC_ACQUIRE) != ticket) {
+		cpu_wait_until_uint16(&lock->tickets.owner, ticket);
 	}
+#ifdef SPINLOCK_DEBUG
+	__spinlock_debug_acquired(lock);
+#endif
 }
 
 // Attempt to acquire the spinlock.
 //
 // Return 0 on success and -EAGAIN on failure.
+//
+// Disables preemption until spinlock_release on success.
 static inline __status_t spinlock_try_acquire(struct spinlock *lock) {
-	if (__atomic_test_and_set(&lock->value, __ATOMIC_ACQUIRE)) {
+	preempt_disable();
+
+	// The lock is free when it serves the next ticket, in which
+	// case we take the next ticket unless someone else did first
+	uint32_t value = __atomic_load_n(&lock->value, __ATOMIC_RELAXED);
+	uint32_t owner = value & 0xffff;
+	uint32_t next = value >> 16;
+	uint32_t taken = (((next + 1) & 0xffff) << 16) | owner;
+	if (owner != next || !__atomic_compare_exchange_n(&lock->value, &value, taken, false, __ATOMIC_ACQUIRE,
+							  __ATOMIC_RELAXED)) {
+		preempt_enable();
 		return -EAGAIN;
 	}
+#ifdef SPINLOCK_DEBUG
+	__spinlock_debug_acquired(lock);
+#endif
 	return 0;
 }
 
 // Release the lock possibly enabling someone else to acquire it.
+//
+// Enables preemption again, which may switch to another thread.
 static inline void spinlock_release(struct spinlock *lock) {
-	__atomic_clear(&lock->value, __ATOMIC_RELEASE);
+#ifdef SPINLOCK_DEBUG
+	__spinlock_debug_release(lock);
+#endif
+	// Only the holder writes the owner, so we can read it plainly
+	__atomic_store_n(&lock->tickets.owner, (uint16_t)(lock->tickets.owner + 1), __ATOMIC_RELEASE);
+	preempt_enable();
+}
+
+// Disables interrupts and acquires the lock.
+//
+// Returns the interrupt state to pass to spinlock_release_irqrestore.
+//
+// Use this function for locks that interrupt handlers also acquire,
+// since an interrupt handler waiting for a lock held by the thread
+// it interrupted would wait forever.
+static inline uint64_t spinlock_acquire_irqsave(struct spinlock *lock) {
+	uint64_t flags = local_irq_save();
+	spinlock_acquire(lock);
+	return flags;
 }
 
+// Releases the lock and restores the interrupt state saved by spinlock_acquire_irqsave.
+static inline void spinlock_release_irqrestore(struct spinlock *lock, uint64_t flags) {
+	spinlock_release(lock);
+	local_irq_restore(flags);
+}
+
+__END_DECLS
+
 #endif // KERNEL_CORE_SPINLOCK_H
@@ -0,0 +1,91 @@
+// File: kernel/core/waiter.h
+// Purpose: threads sleeping on mutexes, semaphores, and condition variables.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_CORE_WAITER_H
+#define KERNEL_CORE_WAITER_H
+
+#include <kernel/core/list.h>       // for struct list_node
+#include <kernel/core/spinlock.h>   // for struct spinlock
+#include <kernel/sched/sched.h>     // for sched_thread_self
+#include <kernel/sched/waitqueue.h> // for struct sched_waitqueue
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+#include <sys/types.h> // for __thread_id_t
+
+__BEGIN_DECLS
+
+// A thread sleeping on a mutex, a semaphore, or a condition variable.
+//
+// The waiter lives on the kernel stack of the sleeping thread, which links
+// it into the list of waiters of the primitive. Releasing the primitive
+// removes the first waiter and grants it the primitive, which hands off the
+// primitive to a specific thread, so a thread that did not wait cannot
+// barge in. Each waiter has its own wait queue, so granting it does not
+// wake up the other waiters.
+//
+// The spinlock of the primitive protects the list of waiters, and we
+// acquire it with interrupts disabled, so that interrupt handlers can
+// release semaphores and use mutex_trylock.
+struct sync_waiter {
+	// Node linking the waiter into the list of waiters of the primitive.
+	struct list_node node;
+
+	// The wait queue on which the thread sleeps.
+	struct sched_waitqueue wq;
+
+	// The ID of the sleeping thread.
+	__thread_id_t tid;
+
+	// Whether we granted the primitive to the thread.
+	bool granted;
+};
+
+// Acquires the spinlock of a primitive disabling interrupts.
+//
+// Returns the interrupt state to pass to __sync_unlock.
+static inline uint64_t __sync_lock(struct spinlock *lock) __NOEXCEPT {
+	return spinlock_acquire_irqsave(lock);
+}
+
+// Releases the spinlock of a primitive and restores the interrupt state.
+static inline void __sync_unlock(struct spinlock *lock, uint64_t flags) __NOEXCEPT {
+	spinlock_release_irqrestore(lock, flags);
+}
+
+// Initialize a waiter for the calling thread.
+static inline void __sync_waiter_init(struct sync_waiter *waiter) __NOEXCEPT {
+	list_init(&waiter->node);
+	sched_waitqueue_init(&waiter->wq);
+	waiter->tid = sched_thread_self();
+	waiter->granted = false;
+}
+
+// Removes the waiter from the list of waiters and wakes it up.
+//
+// Must be invoked while holding the spinlock of the primitive.
+static inline void __sync_waiter_grant_locked(struct sync_waiter *waiter) __NOEXCEPT {
+	list_remove(&waiter->node);
+	__atomic_store_n(&waiter->granted, true, __ATOMIC_RELEASE);
+	sched_waitqueue_wake_one(&waiter->wq);
+}
+
+// Sleeps until we grant the primitive to the waiter.
+//
+// Must be invoked after linking the waiter and releasing the given
+// spinlock of the primitive, which we acquire again before returning
+// to make sure whoever granted us the primitive is not using our stack.
+static inline void __sync_waiter_sleep(struct sync_waiter *waiter, struct spinlock *lock) __NOEXCEPT {
+	for (;;) {
+		uint64_t gen = sched_waitqueue_prepare(&waiter->wq);
+		if (__atomic_load_n(&waiter->granted, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+		sched_waitqueue_wait(&waiter->wq, gen);
+	}
+	uint64_t flags = __sync_lock(lock);
+	__sync_unlock(lock, flags);
+}
+
+__END_DECLS
+
+#endif // KERNEL_CORE_WAITER_H
@@ -102,6 +102,32 @@ static inline volatile uint32_t *gicd_icfgr_addr(uintptr_t base, size_t n) {
 	return (volatile uint32_t *)(base + 0xC00 + 4 * n);
 }
 
+// GICD_SGIR: distributor software generated interrupt register.
+static inline volatile uint32_t *gicd_sgir_addr(uintptr_t base) {
+	return (volatile uint32_t *)(base + 0xF00);
+}
+
+void gicv2_enable_sgi(struct gicv2_device *dev, uint32_t id, uint8_t prio) {
+	// Make sure we're not going beyond the expected memory region.
+	KERNEL_ASSERT(id <= 15);
+
+	printk("%s: gicv2: setting priority of %u to %u\n", dev->name, id, (unsigned)prio);
+	mmio_write_uint8(gicd_ipriorityr_byte_addr(dev->gicd_base, id), prio);
+
+	printk("%s: gicv2: enabling %u\n", dev->name, id);
+	mmio_write_uint32(gicd_isenabler_addr(dev->gicd_base, 0), (1u << id));
+}
+
+void gicv2_send_sgi(struct gicv2_device *dev, uint32_t id, size_t cpu) {
+	KERNEL_ASSERT(id <= 15 && cpu < 8);
+
+	// Make sure the target observes our memory writes before the interrupt
+	dsb_ishst();
+
+	// TargetListFilter=0 (use the list), CPUTargetList in bits [23:16]
+	mmio_write_uint32(gicd_sgir_addr(dev->gicd_base), ((1u << cpu) << 16) | id);
+}
+
 void gicv2_enable_ppi(struct gicv2_device *dev, uint32_t id, uint8_t prio) {
 	// Make sure we're not going beyond the expected memory region.
 	KERNEL_ASSERT(id >= 16 && id <= 31);
@@ -174,6 +200,17 @@ void gicv2_enable(struct gicv2_device *dev) {
 	mmio_write_uint32(gicc_ctrl_addr(dev->gicc_base), 1);
 }
 
+void gicv2_enable_cpu_interface(struct gicv2_device *dev) {
+	printk("%s: gicv2: setting priority mask to 0xFF\n", dev->name);
+	mmio_write_uint32(gicc_pmr_addr(dev->gicc_base), 0xFF);
+
+	printk("%s: gicv2: disabling binary point split\n", dev->name);
+	mmio_write_uint32(gicc_bpr_addr(dev->gicc_base), 0);
+
+	printk("%s: gicv2: enabling the CPU interface\n", dev->name);
+	mmio_write_uint32(gicc_ctrl_addr(dev->gicc_base), 1);
+}
+
 bool gicv2_acknowledge_irq(struct gicv2_device *dev, uint32_t *iar, uint32_t *id) {
 	// Acknowledge the IRQ and get the context
 	*iar = mmio_read_uint32(gicc_iar_addr(dev->gicc_base));
@@ -34,6 +34,18 @@ void gicv2_init_struct(struct gicv2_device *dev, uintptr_t gicc_base, uintptr_t
 // Requires gicv2_init_struct first.
 void gicv2_init_mm(struct gicv2_device *dev, struct vm_root_pt root);
 
+// Enables the given software-generated interrupt (i.e., inter-processor interrupt).
+//
+// The distributor banks the SGI registers per CPU, so each CPU must call this.
+//
+// Requires gicv2_reset first and should happen before gicv2_enable.
+void gicv2_enable_sgi(struct gicv2_device *dev, uint32_t id, uint8_t prio);
+
+// Sends the given software-generated interrupt to the given CPU.
+//
+// Safe to call from any context.
+void gicv2_send_sgi(struct gicv2_device *dev, uint32_t id, size_t cpu);
+
 // Enables the given private-peripheral interrupt (i.e., per-CPU interface).
 //
 // The clock, for example, belongs to this class.
@@ -58,6 +70,12 @@ void gicv2_reset(struct gicv2_device *dev);
 // Requires gicv2_reset first. Should happen after enabling the various IRQs.
 void gicv2_enable(struct gicv2_device *dev);
 
+// Enables the CPU interface of the calling CPU.
+//
+// Secondary CPUs call this instead of gicv2_reset and gicv2_enable, since the
+// boot CPU has already configured the distributor.
+void gicv2_enable_cpu_interface(struct gicv2_device *dev);
+
 // Returns true and a valid `iar` or false if the IRQ is a spurious one.
 //
 // Both `iar` and `id` will always be initialized to some value.
@@ -4,12 +4,16 @@
 // Adapted from: https://github.com/nuta/operating-system-in-1000-lines
 
 #include <kernel/asm/asm.h>               // for mmio_write_uint32
+#include <kernel/core/assert.h>           // for KERNEL_ASSERT
+#include <kernel/core/irqthread.h>        // for struct irq_thread
+#include <kernel/core/mutex.h>            // for struct mutex
 #include <kernel/core/printk.h>           // for printk
 #include <kernel/core/ringbuf.hpp>        // for struct ringbuf
 #include <kernel/core/spinlock.h>         // for struct spinlock
 #include <kernel/drivers/pl011_arm64.hpp> // for struct pl011_device
 #include <kernel/mm/vm.h>                 // for vm_root_pt
-#include <kernel/sched/sched.h>           // for sched_thread_suspend
+#include <kernel/sched/sched.h>           // for sched_thread_yield
+#include <kernel/sched/waitqueue.h>       // for sched_waitqueue_wait
 
 #include <sys/errno.h> // for EAGAIN
 #include <sys/fcntl.h> // for O_NONBLOCK
@@ -53,10 +57,19 @@ static inline volatile uint32_t *icr_addr(uintptr_t base) noexcept {
 // Bitmask used to clear all possible interrupt sources.
 #define UARTICR_CLR_ALL 0x7FF
 
+// Drains the RX FIFO with interrupts enabled (see pl011_isr).
+static void __pl011_rx_thread(void *opaque) noexcept;
+
 void pl011_init_struct(struct pl011_device *dev, uintptr_t base, const char *device_name) noexcept {
 	__bzero_unaligned(dev, sizeof(*dev));
 	dev->base = base;
 	dev->name = device_name;
+	mutex_init(&dev->__rxlock);
+	mutex_init(&dev->__txlock);
+	sched_waitqueue_init(&dev->__rxwait);
+	sched_waitqueue_init(&dev->__txwait);
+	irq_thread_init(&dev->__rxthread, __pl011_rx_thread, dev);
+	spinlock_init(&dev->__imsclock);
 }
 
 void pl011_init_early(struct pl011_device *dev) noexcept {
@@ -112,6 +125,18 @@ static inline bool has_enabled_interrupts(struct pl011_device *dev) noexcept {
 	return __atomic_load_n(&dev->__has_interrupts, __ATOMIC_ACQUIRE) != 0;
 }
 
+// Sets and then clears the given bits of the interrupt mask, which the
+// interrupt handler, the RX thread and the senders update concurrently.
+static inline void update_imsc(struct pl011_device *dev, uint32_t set, uint32_t clear) noexcept {
+	uint64_t flags = spinlock_acquire_irqsave(&dev->__imsclock);
+	uint32_t imsc = mmio_read_uint32(imsc_addr(dev->base));
+	mmio_write_uint32(imsc_addr(dev->base), (imsc | set) & ~clear);
+	spinlock_release_irqrestore(&dev->__imsclock, flags);
+}
+
+// The interrupts signalling that the RX FIFO has data.
+#define UARTINT_RX_ALL (UARTINT_RX | UARTINT_RT | UARTINT_OE)
+
 void pl011_init_irqs(struct pl011_device *dev) noexcept {
 	// Enable the FIFO behavior
 	mmio_write_uint32(clr_h_addr(dev->base), (mmio_read_uint32(clr_h_addr(dev->base)) | UARTLCR_H_FEN));
@@ -119,11 +144,15 @@ void pl011_init_irqs(struct pl011_device *dev) noexcept {
 	// Trigger interrupts when the RX level is 1/8 and the TX level is 1/8
 	mmio_write_uint32(ifls_addr(dev->base), 0);
 
+	// Start the thread draining the RX FIFO before the first interrupt.
+	__status_t rc = irq_thread_start(&dev->__rxthread);
+	KERNEL_ASSERT(rc == 0);
+
 	// Defensively clear all potentially pending interrupts.
 	mmio_write_uint32(icr_addr(dev->base), UARTICR_CLR_ALL);
 
 	// Select the events to receive notifications about.
-	mmio_write_uint32(imsc_addr(dev->base), UARTINT_RX | UARTINT_RT | UARTINT_OE);
+	update_imsc(dev, UARTINT_RX_ALL, 0);
 
 	// Let the user know what we did *before* turning interrupts on.
 	printk("%s: UARTIMSC |= RX | RT | OE\n", dev->name);
@@ -162,19 +191,11 @@ void pl011_isr(struct pl011_device *dev) noexcept {
 	uint32_t mis = mmio_read_uint32(mis_addr(dev->base));
 
 	// Handle the case of the UART being readable
-	if ((mis & (UARTINT_RX | UARTINT_RT | UARTINT_OE)) != 0) {
-		// Drain the RX FIFO first including per-byte flags
-		while (is_readable(dev->base)) {
-			uint16_t value = (uint16_t)(mmio_read_uint32(dr_addr(dev->base)) & 0x0FFF);
-			(void)ringbuf_push(&dev->__rxbuf, value);
-		}
-
-		// Clear RX-related causes and stop the interrupt from firing
-		uint32_t mask = UARTINT_RX | UARTINT_RT | UARTINT_FE | UARTINT_PE | UARTINT_BE | UARTINT_OE;
-		mmio_write_uint32(icr_addr(dev->base), mask);
-
-		// Wake up any sleeping thread
-		sched_thread_resume_all(SCHED_THREAD_WAIT_UART_READABLE);
+	if ((mis & UARTINT_RX_ALL) != 0) {
+		// Mask the level-triggered RX interrupts until the RX thread has
+		// drained the FIFO, which it does with interrupts enabled
+		update_imsc(dev, 0, UARTINT_RX_ALL);
+		irq_thread_wake(&dev->__rxthread);
 	}
 
 	// Handle the case of the UART being writable.
@@ -183,11 +204,41 @@ void pl011_isr(struct pl011_device *dev) noexcept {
 		mmio_write_uint32(icr_addr(dev->base), UARTINT_TX);
 
 		// Mask the interrupt to avoid level-triggered interrupt storms.
-		mmio_write_uint32(imsc_addr(dev->base), (mmio_read_uint32(imsc_addr(dev->base)) & ~UARTINT_TX));
+		update_imsc(dev, 0, UARTINT_TX);
+
+		// Wake up the threads waiting to write
+		sched_waitqueue_wake_all(&dev->__txwait);
+	}
+}
+
+static void __pl011_rx_thread(void *opaque) noexcept {
+	struct pl011_device *dev = (struct pl011_device *)opaque;
+
+	// Clear RX-related causes before draining, so that bytes arriving
+	// while we drain raise the interrupt again once we unmask it
+	uint32_t mask = UARTINT_RX | UARTINT_RT | UARTINT_FE | UARTINT_PE | UARTINT_BE | UARTINT_OE;
+	mmio_write_uint32(icr_addr(dev->base), mask);
 
-		// Let user space know it can send more
-		sched_thread_resume_all(SCHED_THREAD_WAIT_UART_WRITABLE);
+	// Drain the RX FIFO including per-byte flags
+	while (is_readable(dev->base)) {
+		uint16_t value = (uint16_t)(mmio_read_uint32(dr_addr(dev->base)) & 0x0FFF);
+		(void)ringbuf_push(&dev->__rxbuf, value);
 	}
+
+	// Unmask the RX interrupts and wake up the threads waiting to read
+	update_imsc(dev, UARTINT_RX_ALL, 0);
+	sched_waitqueue_wake_all(&dev->__rxwait);
+}
+
+// Acquires the given mutex, or only attempts to if flags contains O_NONBLOCK.
+//
+// Returns whether we acquired the mutex.
+static inline bool __pl011_lock(struct mutex *mtx, __flags32_t flags) noexcept {
+	if ((flags & O_NONBLOCK) != 0) {
+		return mutex_trylock(mtx) == 0;
+	}
+	mutex_lock(mtx);
+	return true;
 }
 
 ssize_t pl011_recv(struct pl011_device *dev, char *buf, size_t count, __flags32_t flags) noexcept {
@@ -202,21 +253,22 @@ ssize_t pl011_recv(struct pl011_device *dev, char *buf, size_t count, __flags32_
 			return (ssize_t)off;
 		}
 
-		// Grab the spinlock to protect against multiple readers
-		// and yield here awaiting for it to become available
-		while (spinlock_try_acquire(&dev->__rxlock) != 0) {
-			if ((flags & O_NONBLOCK) != 0) {
-				return (off <= 0) ? -EAGAIN : (ssize_t)off;
-			}
-			sched_thread_yield();
+		// Snapshot the wait queue before checking the buffer so
+		// that we cannot miss a wakeup occurring in between
+		uint64_t gen = sched_waitqueue_prepare(&dev->__rxwait);
+
+		// Grab the mutex to protect against multiple readers
+		// and sleep here awaiting for it to become available
+		if (!__pl011_lock(&dev->__rxlock, flags)) {
+			return (off <= 0) ? -EAGAIN : (ssize_t)off;
 		}
 
 		// Attempt to read from the ring buffer
 		uint16_t data = 0;
 		bool success = ringbuf_pop(&dev->__rxbuf, &data);
 
-		// Drop the spinlock now that we've accessed the buffer
-		spinlock_release(&dev->__rxlock);
+		// Drop the mutex now that we've accessed the buffer
+		mutex_unlock(&dev->__rxlock);
 
 		// Check whether we succeeded
 		if (success) {
@@ -235,7 +287,7 @@ ssize_t pl011_recv(struct pl011_device *dev, char *buf, size_t count, __flags32_
 		}
 
 		// Suspend until we have data to read
-		sched_thread_suspend(SCHED_THREAD_WAIT_UART_READABLE);
+		sched_waitqueue_wait(&dev->__rxwait, gen);
 	}
 }
 
@@ -249,11 +301,8 @@ ssize_t pl011_send(struct pl011_device *dev, const char *buf, size_t count, __fl
 	for (;;) {
 		// Grab the lock granting us the permission to transmit,
 		// however, be careful with O_NONBLOCK users.
-		while (spinlock_try_acquire(&dev->__txlock) != 0) {
-			if ((flags & O_NONBLOCK) != 0) {
-				return (tot <= 0) ? -EAGAIN : (ssize_t)tot;
-			}
-			sched_thread_yield();
+		if (!__pl011_lock(&dev->__txlock, flags)) {
+			return (tot <= 0) ? -EAGAIN : (ssize_t)tot;
 		}
 
 		// Awesome, now send as much as possible until the
@@ -264,33 +313,34 @@ ssize_t pl011_send(struct pl011_device *dev, const char *buf, size_t count, __fl
 
 		// If everything has been sent, our job is done
 		if (tot >= count) {
-			spinlock_release(&dev->__txlock);
+			mutex_unlock(&dev->__txlock);
 			return (ssize_t)tot;
 		}
 
 		// If we are nonblocking, this is the time where we'd block
 		if ((flags & O_NONBLOCK) != 0) {
-			spinlock_release(&dev->__txlock);
+			mutex_unlock(&dev->__txlock);
 			return (tot <= 0) ? -EAGAIN : (ssize_t)tot;
 		}
 
 		// If we are without interrupts and we are allowed to
 		// block, the best we can do is yield the CPU.
 		if (!has_enabled_interrupts(dev)) {
-			spinlock_release(&dev->__txlock);
+			mutex_unlock(&dev->__txlock);
 			sched_thread_yield();
 			continue;
 		}
 
+		// Snapshot the wait queue before enabling the interrupt, so
+		// that, if the interrupt fires before we suspend, we notice
+		// and we don't get a completely frozen console.
+		uint64_t gen = sched_waitqueue_prepare(&dev->__txwait);
+
 		// Enable the interrupt again
-		mmio_write_uint32(imsc_addr(dev->base), (mmio_read_uint32(imsc_addr(dev->base)) | UARTINT_TX));
-
-		// Release the spinlock and wait for writability.
-		//
-		// As a safety net, for now, also wait for the clock to tick
-		// such that we don't get a completely frozen console.
-		spinlock_release(&dev->__txlock);
-		sched_channels_t channels = SCHED_THREAD_WAIT_UART_WRITABLE | SCHED_THREAD_WAIT_TIMER;
-		sched_thread_suspend(channels);
+		update_imsc(dev, UARTINT_TX, 0);
+
+		// Release the mutex and wait for writability.
+		mutex_unlock(&dev->__txlock);
+		sched_waitqueue_wait(&dev->__txwait, gen);
 	}
 }
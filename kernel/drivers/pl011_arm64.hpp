@@ -4,9 +4,12 @@
 #ifndef KERNEL_DRIVERS_PL011_ARM64_HPP
 #define KERNEL_DRIVERS_PL011_ARM64_HPP
 
-#include <kernel/core/ringbuf.hpp> // for struct ringbuf<T, S>
-#include <kernel/core/spinlock.h>  // for struct spinlock
-#include <kernel/mm/vm.h>          // for struct vm_root_pt
+#include <kernel/core/irqthread.h>  // for struct irq_thread
+#include <kernel/core/mutex.h>      // for struct mutex
+#include <kernel/core/ringbuf.hpp>  // for struct ringbuf<T, S>
+#include <kernel/core/spinlock.h>   // for struct spinlock
+#include <kernel/mm/vm.h>           // for struct vm_root_pt
+#include <kernel/sched/waitqueue.h> // for struct sched_waitqueue
 
 #include <sys/cdefs.h> // for __BEGIN_DECLS
 #include <sys/types.h> // for uintptr_t
@@ -27,8 +30,12 @@ struct pl011_device {
 	// Internal fields.
 	volatile uint64_t __has_interrupts;
 	struct ringbuf<uint16_t, PL011_RINGBUF_SIZE> __rxbuf;
-	struct spinlock __rxlock;
-	struct spinlock __txlock;
+	struct mutex __rxlock;
+	struct mutex __txlock;
+	struct sched_waitqueue __rxwait;
+	struct sched_waitqueue __txwait;
+	struct irq_thread __rxthread;
+	struct spinlock __imsclock;
 };
 
 __BEGIN_DECLS
@@ -68,6 +75,9 @@ void pl011_init_irqs(struct pl011_device *dev) __NOEXCEPT;
 // PL011 interrupt service request.
 //
 // Called by the irq subsystem via the tty driver.
+//
+// Masks the RX interrupts and leaves draining the RX FIFO to a
+// threaded handler, which runs with interrupts enabled.
 void pl011_isr(struct pl011_device *dev) __NOEXCEPT;
 
 // Allows reading bytes from the PL011.
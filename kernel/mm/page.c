@@ -3,11 +3,11 @@
 // SPDX-License-Identifier: MIT
 
 #include <kernel/boot/boot.h>     // for __free_ram_start
-#include <kernel/core/assert.h>   // for KERNEL_ASSERT
-#include <kernel/core/printk.h>   // for printk
-#include <kernel/core/spinlock.h> // for struct spinlock
-#include <kernel/mm/page.h>       // for page_alloc
-#include <kernel/sched/sched.h>   // for sched_thread_yield
+#include <kernel/core/assert.h>  // for KERNEL_ASSERT
+#include <kernel/core/mcslock.h> // for struct mcs_lock
+#include <kernel/core/printk.h>  // for printk
+#include <kernel/mm/page.h>      // for page_alloc
+#include <kernel/sched/sched.h>  // for sched_thread_yield
 
 #include <sys/errno.h> // for EAGAIN
 #include <sys/param.h> // for PAGE_SIZE
@@ -106,32 +106,47 @@ void page_init_early(void) {
 	static_assert((1ULL << PAGE_SHIFT) == PAGE_SIZE);
 }
 
-// Allocate a free page returning 0 and the page index on success, -ENOMEM on failure.
-static inline __status_t bitmask_alloc(size_t *index, __flags32_t flags) {
+// Allocate count contiguous free pages returning 0 and the index of
+// the first page on success, -ENOMEM on failure.
+static inline __status_t bitmask_alloc(size_t *index, size_t count, __flags32_t flags) {
 	KERNEL_ASSERT(index != 0);
+	KERNEL_ASSERT(count > 0 && count <= MAX_PAGES);
 	*index = 0; // avoid possible UB
 
-	for (size_t slot_idx = 0; slot_idx < NUM_SLOTS; slot_idx++) {
+	size_t run = 0;
+	for (size_t page_idx = 0; page_idx < MAX_PAGES; page_idx++) {
+		size_t slot_idx = (page_idx >> SLOT_SHIFT);
+		size_t bit_idx = (page_idx & (PAGES_PER_SLOT - 1));
+
+		// Skip full slots altogether
 		uint64_t entry = bitmask[slot_idx];
 		if (entry == UINT64_MAX) {
+			run = 0;
+			page_idx |= (PAGES_PER_SLOT - 1);
 			continue;
 		}
 
-		for (size_t bit_idx = 0; bit_idx < PAGES_PER_SLOT; bit_idx++) {
-			uint64_t bit = (1ULL << bit_idx);
-			if ((entry & bit) != 0) {
-				continue;
-			}
+		// Extend the current run of free pages until it is long enough
+		uint64_t bit = (1ULL << bit_idx);
+		if ((entry & bit) != 0) {
+			run = 0;
+			continue;
+		}
+		if (++run < count) {
+			continue;
+		}
 
-			bitmask[slot_idx] = entry | bit;
-			KERNEL_ASSERT(slot_idx <= (SIZE_MAX >> SLOT_SHIFT));
-			*index = (slot_idx << SLOT_SHIFT) | bit_idx;
+		// Mark the whole run as allocated
+		size_t first = page_idx + 1 - count;
+		for (size_t idx = first; idx <= page_idx; idx++) {
+			bitmask[idx >> SLOT_SHIFT] |= (1ULL << (idx & (PAGES_PER_SLOT - 1)));
+		}
+		*index = first;
 
-			if ((flags & PAGE_ALLOC_DEBUG) != 0) {
-				printk("bitmask_alloc: %llx %llx => %llx\n", slot_idx, bit_idx, *index);
-			}
-			return 0;
+		if ((flags & PAGE_ALLOC_DEBUG) != 0) {
+			printk("bitmask_alloc: %llx %llx => %llx\n", first, count, *index);
 		}
+		return 0;
 	}
 	return -ENOMEM;
 }
@@ -156,7 +171,10 @@ static inline void bitmask_free(size_t index, __flags32_t flags) {
 }
 
 // Spinlock for protecting allocation.
-static struct spinlock lock;
+//
+// All CPUs allocate pages, so we use a queued lock where each waiting
+// CPU spins on its own node rather than on the lock.
+static struct mcs_lock lock;
 
 // Convert page index into physical page address
 static inline page_addr_t make_page_addr(size_t index) {
@@ -173,22 +191,26 @@ static inline page_addr_t make_page_addr(size_t index) {
 }
 
 __status_t page_alloc(page_addr_t *addr, __flags32_t flags) {
+	return page_alloc_contig(addr, 1, flags);
+}
+
+__status_t page_alloc_contig(page_addr_t *addr, size_t count, __flags32_t flags) {
 	KERNEL_ASSERT(addr != 0);
 	*addr = 0; // Avoid possible UB
 
 	for (;;) {
-		while (spinlock_try_acquire(&lock) != 0) {
-			if ((flags & PAGE_ALLOC_WAIT) == 0) {
-				return -EAGAIN;
-			}
-			if ((flags & PAGE_ALLOC_YIELD) != 0) {
-				sched_thread_yield();
-			}
+		// The spinlock disables preemption and we only hold it to scan
+		// the bitmask, so waiting for it is cheaper than yielding
+		struct mcs_node node;
+		if ((flags & PAGE_ALLOC_WAIT) != 0) {
+			mcs_lock_acquire(&lock, &node);
+		} else if (mcs_lock_try_acquire(&lock, &node) != 0) {
+			return -EAGAIN;
 		}
 
 		size_t index = 0;
-		__status_t rc = bitmask_alloc(&index, flags);
-		spinlock_release(&lock);
+		__status_t rc = bitmask_alloc(&index, count, flags);
+		mcs_lock_release(&lock, &node);
 
 		if (rc < 0) {
 			if ((flags & PAGE_ALLOC_WAIT) == 0) {
@@ -201,21 +223,29 @@ __status_t page_alloc(page_addr_t *addr, __flags32_t flags) {
 		}
 
 		*addr = make_page_addr(index);
+		KERNEL_ASSERT(make_page_addr(index + count - 1) - *addr == (count - 1) * PAGE_SIZE);
 		if ((flags & PAGE_ALLOC_DEBUG) != 0) {
-			printk("page_alloc: %llx => %llx\n", index, *addr);
+			printk("page_alloc: %llx %llx => %llx\n", index, count, *addr);
+		}
+		if ((flags & PAGE_ALLOC_NOZERO) == 0) {
+			__bzero((void *)*addr, count * PAGE_SIZE);
 		}
-		__bzero((void *)*addr, PAGE_SIZE);
 		return 0;
 	}
 }
 
 void page_free(page_addr_t addr, __flags32_t flags) {
+	page_free_contig(addr, 1, flags);
+}
+
+void page_free_contig(page_addr_t addr, size_t count, __flags32_t flags) {
 	// Ensure the address is within RAM and aligned
 	if ((flags & PAGE_ALLOC_DEBUG) != 0) {
 		printk("page_free: %llx %llx %llx\n", (uintptr_t)__free_ram_start, addr, (uintptr_t)__free_ram_end);
 	}
 	KERNEL_ASSERT(addr >= (uintptr_t)__free_ram_start);
 	KERNEL_ASSERT(addr < (uintptr_t)__free_ram_end);
+	KERNEL_ASSERT(count > 0 && count <= ((uintptr_t)__free_ram_end - addr) >> PAGE_SHIFT);
 	KERNEL_ASSERT(page_aligned(addr));
 
 	// Transform to offset that must be aligned
@@ -227,15 +257,19 @@ void page_free(page_addr_t addr, __flags32_t flags) {
 	if ((flags & PAGE_ALLOC_DEBUG) != 0) {
 		printk("page_free: %llx => %llx\n", addr, index);
 	}
-	spinlock_acquire(&lock);
-	bitmask_free(index, flags);
-	spinlock_release(&lock);
+	struct mcs_node node;
+	mcs_lock_acquire(&lock, &node);
+	for (size_t idx = index; idx < index + count; idx++) {
+		bitmask_free(idx, flags);
+	}
+	mcs_lock_release(&lock, &node);
 }
 
 void page_debug_printk(void) {
-	spinlock_acquire(&lock);
+	struct mcs_node node;
+	mcs_lock_acquire(&lock, &node);
 	for (size_t slot_idx = 0; slot_idx < NUM_SLOTS; slot_idx++) {
 		printk("page_debug_printk: %lld %llx\n", slot_idx, bitmask[slot_idx]);
 	}
-	spinlock_release(&lock);
+	mcs_lock_release(&lock, &node);
 }
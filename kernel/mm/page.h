@@ -30,12 +30,16 @@ static inline bool page_aligned(uintptr_t addr) {
 // It is okay to wait for free pages to become available.
 #define PAGE_ALLOC_WAIT (1 << 0)
 
-// It is okay to yield when waiting.
+// It is okay to yield while waiting for free pages.
 #define PAGE_ALLOC_YIELD (1 << 1)
 
 // Print details about what we are actually allocating.
 #define PAGE_ALLOC_DEBUG (1 << 2)
 
+// Do not zero the pages, which is fine for memory the kernel
+// initializes before reading it, such as kernel stacks.
+#define PAGE_ALLOC_NOZERO (1 << 3)
+
 // Early initialization of the page allocator.
 //
 // Called early by the boot subsystem.
@@ -46,14 +50,20 @@ void page_init_early(void);
 // The returned memory page is *physical*. However, the kernel maps the
 // whole RAM, therefore, for the kernel it is also virtual.
 //
-// The returned memory page *content* is zeroed. This is possible
-// because the kernel identity maps the RAM.
+// The returned memory page *content* is zeroed, unless flags contains
+// PAGE_ALLOC_NOZERO. This is possible because the kernel identity maps
+// the RAM.
 //
 // Returns 0 on success and `-ENOMEM` or `-EAGAIN` on failure.
 //
 // The addr is set to zero in case of error.
 __status_t page_alloc(page_addr_t *addr, __flags32_t flags);
 
+// Allocate count physically contiguous memory pages.
+//
+// Behaves like page_alloc, except that addr points to the first page.
+__status_t page_alloc_contig(page_addr_t *addr, size_t count, __flags32_t flags);
+
 // Convenience function for allocations that MUST always succeed.
 static inline page_addr_t page_must_alloc(__flags32_t flags) {
 	page_addr_t addr = 0;
@@ -71,6 +81,11 @@ static inline page_addr_t page_must_alloc(__flags32_t flags) {
 // Panics when the address is not aligned or the page is not allocated.
 void page_free(page_addr_t addr, __flags32_t flags);
 
+// Free count contiguous memory pages allocated using page_alloc_contig.
+//
+// Panics when the range is not aligned or any page is not allocated.
+void page_free_contig(page_addr_t addr, size_t count, __flags32_t flags);
+
 // Prints the bitmask using printk.
 void page_debug_printk(void);
 
@@ -0,0 +1,168 @@
+// File: kernel/mm/slab.c
+// Purpose: caches of fixed-size kernel objects.
+// SPDX-License-Identifier: MIT
+
+#include <kernel/core/assert.h>   // for KERNEL_ASSERT
+#include <kernel/core/list.h>     // for struct list_node
+#include <kernel/core/spinlock.h> // for struct spinlock
+#include <kernel/mm/page.h>       // for page_alloc
+#include <kernel/mm/slab.h>       // the subsystem's API
+
+#include <sys/param.h> // for PAGE_SIZE
+#include <sys/types.h> // for size_t
+
+#include <string.h> // for __bzero
+
+// A free object, which points to the next free object of its slab.
+struct slab_object {
+	struct slab_object *next;
+};
+
+// Header at the beginning of each slab.
+struct slab {
+	// Links the slab into the partial or the full list of its cache.
+	struct list_node node;
+
+	// The first free object or zero.
+	struct slab_object *freelist;
+
+	// Number of allocated objects.
+	size_t inuse;
+};
+
+// Rounds value up to a multiple of align, which must be a power of two.
+static inline size_t __slab_round_up(size_t value, size_t align) {
+	return (value + align - 1) & ~(align - 1);
+}
+
+// Acquires the spinlock of the cache from any context disabling interrupts.
+//
+// Returns the interrupt state to pass to __slab_unlock.
+static inline uint64_t __slab_lock(struct slab_cache *cache) {
+	return spinlock_acquire_irqsave(&cache->lock);
+}
+
+// Releases the spinlock of the cache and restores the interrupt state.
+static inline void __slab_unlock(struct slab_cache *cache, uint64_t flags) {
+	spinlock_release_irqrestore(&cache->lock, flags);
+}
+
+void slab_cache_init(struct slab_cache *cache, const char *name, size_t objsize, size_t align) {
+	KERNEL_ASSERT(cache != 0 && objsize > 0);
+	KERNEL_ASSERT(align > 0 && (align & (align - 1)) == 0 && align < PAGE_SIZE);
+	align = (align < SLAB_MIN_ALIGN) ? SLAB_MIN_ALIGN : align;
+	cache->name = name;
+	cache->objsize = __slab_round_up(objsize, align);
+	cache->offset = __slab_round_up(sizeof(struct slab), align);
+	KERNEL_ASSERT(cache->objsize <= PAGE_SIZE - cache->offset);
+	cache->perslab = (PAGE_SIZE - cache->offset) / cache->objsize;
+	list_init(&cache->partial);
+	list_init(&cache->full);
+	cache->spare = 0;
+	cache->nr_active = 0;
+	cache->nr_slabs = 0;
+	spinlock_init(&cache->lock);
+}
+
+// Formats a zeroed page as a slab whose objects are all free.
+static struct slab *__slab_format(struct slab_cache *cache, page_addr_t page) {
+	struct slab *slab = (struct slab *)page;
+	list_init(&slab->node);
+	slab->freelist = 0;
+	slab->inuse = 0;
+
+	// Link the objects backwards so that we hand them out in address order
+	uint8_t *base = (uint8_t *)page + cache->offset;
+	for (size_t idx = cache->perslab; idx > 0; idx--) {
+		struct slab_object *object = (struct slab_object *)(base + (idx - 1) * cache->objsize);
+		object->next = slab->freelist;
+		slab->freelist = object;
+	}
+	return slab;
+}
+
+__status_t slab_alloc(struct slab_cache *cache, void **obj, __flags32_t flags) {
+	KERNEL_ASSERT(cache != 0 && obj != 0);
+	*obj = 0; // Avoid possible UB
+	uint64_t irqflags = __slab_lock(cache);
+
+	// 1. make sure there is a slab with free objects, reusing the spare slab
+	// or formatting a new page, which we allocate without holding the spinlock
+	// since the page allocator may yield the CPU depending on the flags
+	if (list_empty(&cache->partial)) {
+		struct slab *slab = cache->spare;
+		cache->spare = 0;
+		if (slab == 0) {
+			__slab_unlock(cache, irqflags);
+			page_addr_t page = 0;
+			__status_t rc = page_alloc(&page, flags);
+			if (rc != 0) {
+				return rc;
+			}
+			slab = __slab_format(cache, page);
+			irqflags = __slab_lock(cache);
+			cache->nr_slabs++;
+		}
+		list_push_back(&cache->partial, &slab->node);
+	}
+
+	// 2. take the first free object of the first partial slab
+	struct slab *slab = list_entry(list_front(&cache->partial), struct slab, node);
+	struct slab_object *object = slab->freelist;
+	slab->freelist = object->next;
+	slab->inuse++;
+	cache->nr_active++;
+
+	// 3. move the slab to the full list when we took its last object
+	if (slab->freelist == 0) {
+		list_remove(&slab->node);
+		list_push_back(&cache->full, &slab->node);
+	}
+	__slab_unlock(cache, irqflags);
+
+	// 4. hand out zeroed memory like the page allocator does
+	__bzero(object, cache->objsize);
+	*obj = object;
+	return 0;
+}
+
+void slab_free(struct slab_cache *cache, void *obj) {
+	// 1. slabs are page aligned, so masking the address gives us the slab
+	KERNEL_ASSERT(cache != 0 && obj != 0);
+	struct slab *slab = (struct slab *)((uintptr_t)obj & ~(uintptr_t)PAGE_OFFSET_MASK);
+	uintptr_t offset = (uintptr_t)obj - (uintptr_t)slab;
+	KERNEL_ASSERT(offset >= cache->offset && (offset - cache->offset) % cache->objsize == 0);
+	uint64_t irqflags = __slab_lock(cache);
+	KERNEL_ASSERT(slab->inuse > 0);
+
+	// 2. a full slab becomes partial again
+	if (slab->freelist == 0) {
+		list_remove(&slab->node);
+		list_push_back(&cache->partial, &slab->node);
+	}
+
+	// 3. link the object into the free list of its slab
+	struct slab_object *object = obj;
+	object->next = slab->freelist;
+	slab->freelist = object;
+	slab->inuse--;
+	cache->nr_active--;
+
+	// 4. an empty slab becomes the spare slab or goes back to the page allocator
+	page_addr_t release = 0;
+	if (slab->inuse == 0) {
+		list_remove(&slab->node);
+		if (cache->spare == 0) {
+			cache->spare = slab;
+		} else {
+			release = (page_addr_t)slab;
+			cache->nr_slabs--;
+		}
+	}
+	__slab_unlock(cache, irqflags);
+
+	// 5. free the page without holding the spinlock
+	if (release != 0) {
+		page_free(release, 0);
+	}
+}
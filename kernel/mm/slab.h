@@ -0,0 +1,93 @@
+// File: kernel/mm/slab.h
+// Purpose: caches of fixed-size kernel objects.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_MM_SLAB_H
+#define KERNEL_MM_SLAB_H
+
+#include <kernel/core/list.h>     // for struct list_node
+#include <kernel/core/spinlock.h> // for struct spinlock
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+#include <sys/types.h> // for size_t
+
+__BEGIN_DECLS
+
+// Opaque header at the beginning of each slab.
+struct slab;
+
+// Cache of fixed-size objects carved out of memory pages (i.e., slabs).
+//
+// Each slab is a single page starting with a small header followed by as
+// many objects as fit in the page, and the free objects of a slab form a
+// singly-linked list. Allocating and freeing are constant time, we find
+// the slab of an object by masking its address, and we return the pages
+// of empty slabs to the page allocator, so that the memory we use stays
+// proportional to the number of live objects.
+//
+// Initialize using slab_cache_init.
+struct slab_cache {
+	// Name of the cache for debugging.
+	const char *name;
+
+	// Size of each object rounded up to the object alignment.
+	size_t objsize;
+
+	// Offset of the first object within a slab.
+	size_t offset;
+
+	// Number of objects that fit in a slab.
+	size_t perslab;
+
+	// Slabs with at least one free object.
+	struct list_node partial;
+
+	// Slabs without free objects.
+	struct list_node full;
+
+	// An empty slab we keep around so that allocating and freeing an
+	// object at the boundary of a slab does not allocate and free a page.
+	struct slab *spare;
+
+	// Number of allocated objects.
+	size_t nr_active;
+
+	// Number of slabs, including the spare one.
+	size_t nr_slabs;
+
+	// Spinlock protecting the cache.
+	struct spinlock lock;
+};
+
+// The minimum alignment of the objects.
+#define SLAB_MIN_ALIGN 16
+
+// Initialize an empty cache of objects with the given size and alignment.
+//
+// The alignment must be a power of two and we raise it to SLAB_MIN_ALIGN.
+// Use the cache line size for objects that different CPUs write.
+//
+// Panics if the object does not fit into a slab.
+void slab_cache_init(struct slab_cache *cache, const char *name, size_t objsize, size_t align) __NOEXCEPT;
+
+// Allocate an object from the cache.
+//
+// The object content is zeroed and aligned as requested by slab_cache_init.
+//
+// The flags are the PAGE_ALLOC_xxx flags we use when we need a new slab.
+//
+// Returns 0 on success and `-ENOMEM` or `-EAGAIN` on failure.
+//
+// The obj is set to zero in case of error.
+//
+// Safe to call with interrupts disabled as long as flags does not
+// contain PAGE_ALLOC_YIELD.
+__status_t slab_alloc(struct slab_cache *cache, void **obj, __flags32_t flags) __NOEXCEPT;
+
+// Return an object to the cache it was allocated from.
+//
+// Safe to call with interrupts disabled.
+void slab_free(struct slab_cache *cache, void *obj) __NOEXCEPT;
+
+__END_DECLS
+
+#endif // KERNEL_MM_SLAB_H
@@ -81,6 +81,20 @@ void vm_map_explicit(struct vm_root_pt root, page_addr_t paddr, uintptr_t vaddr,
 	__vm_map_explicit_assume_aligned(root, paddr, vaddr, flags);
 }
 
+void vm_unmap_explicit(struct vm_root_pt root, uintptr_t vaddr, __flags32_t flags) {
+	// 1. make sure all the addresses are aligned with the page size
+	KERNEL_ASSERT(__builtin_is_aligned(root.table, PAGE_SIZE));
+	KERNEL_ASSERT(__builtin_is_aligned(vaddr, PAGE_SIZE));
+
+	// 2. if needed print what we're doing
+	if ((flags & VM_MAP_FLAG_DEBUG) != 0) {
+		printk("    vm_unmap: [%llx, %llx)\n", vaddr, vaddr + PAGE_SIZE);
+	}
+
+	// 3. let the MD implementation finish the job
+	__vm_unmap_explicit_assume_aligned(root, vaddr, flags);
+}
+
 void vm_map_range_identity(struct vm_root_pt root, page_addr_t start, page_addr_t end, __flags32_t flags) {
 	KERNEL_ASSERT(vm_align_down(start) == start);
 	end = vm_align_up(end);
@@ -79,6 +79,14 @@ void vm_map_range_identity(struct vm_root_pt root, page_addr_t start, page_addr_
 // specific areas of the memory for kernel usage with different flags.
 void vm_map_explicit(struct vm_root_pt root, page_addr_t paddr, uintptr_t vaddr, __flags32_t flags) __NOEXCEPT;
 
+// Removes the mapping of vaddr from the given root table.
+//
+// Panics if vaddr is not aligned or not mapped.
+//
+// Unlike vm_map_explicit, this function invalidates the stale
+// translations of vaddr cached by the TLBs of all the CPUs.
+void vm_unmap_explicit(struct vm_root_pt root, uintptr_t vaddr, __flags32_t flags) __NOEXCEPT;
+
 // Maps the kernel memory into the given root table.
 //
 // When you're creating the memory layout for a new process, you need to
@@ -113,6 +121,12 @@ __status_t vm_user_virt_to_phys(uintptr_t *paddr, struct vm_root_pt root, uintpt
 // Prefer __vm_map_explicit to calling this function.
 void __vm_map_explicit_assume_aligned(struct vm_root_pt root, page_addr_t paddr, uintptr_t vaddr, __flags32_t flags) __NOEXCEPT;
 
+// Internal machine dependent unmapping implementation that assumes that
+// we have already checked that the address is correctly aligned.
+//
+// Prefer vm_unmap_explicit to calling this function.
+void __vm_unmap_explicit_assume_aligned(struct vm_root_pt root, uintptr_t vaddr, __flags32_t flags) __NOEXCEPT;
+
 // Internal machine-dependent function for using the MMU.
 //
 // Should only be called within this subsystem.
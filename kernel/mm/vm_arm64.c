@@ -197,6 +197,34 @@ void __vm_map_explicit_assume_aligned(struct vm_root_pt root, page_addr_t paddr,
 	// support for TLB invalidation to this code.
 }
 
+// The caller MUST already have checked that the address is aligned.
+void __vm_unmap_explicit_assume_aligned(struct vm_root_pt root, uintptr_t vaddr, __flags32_t flags) {
+	// 1. walk the tables, which must exist since vaddr is mapped
+	uint64_t *l1_virt = (uint64_t *)root.table; // direct mapping
+	uint64_t l1_desc = l1_virt[L1_INDEX(vaddr)];
+	KERNEL_ASSERT((l1_desc & ARM64_PTE_VALID) != 0);
+
+	uint64_t *l2_virt = (uint64_t *)(l1_desc & ARM64_PTE_ADDR_MASK); // direct mapping
+	uint64_t l2_desc = l2_virt[L2_INDEX(vaddr)];
+	KERNEL_ASSERT((l2_desc & ARM64_PTE_VALID) != 0);
+
+	uint64_t *l3_virt = (uint64_t *)(l2_desc & ARM64_PTE_ADDR_MASK); // direct mapping
+	uint64_t *pte = &l3_virt[L3_INDEX(vaddr)];
+	KERNEL_ASSERT((*pte & ARM64_PTE_VALID) != 0);
+
+	// 2. clear the leaf and make the write visible to the table walkers
+	*pte = 0;
+	if ((flags & VM_MAP_FLAG_DEBUG) != 0) {
+		printk("      L3_VIRT[L3_INDEX] = %llx\n", *pte);
+	}
+	dsb_ishst();
+
+	// 3. drop the cached translations on every CPU and wait for that
+	tlbi_vaae1is(vaddr);
+	dsb_ish();
+	isb();
+}
+
 __status_t vm_user_virt_to_phys(uintptr_t *paddr, struct vm_root_pt root, uintptr_t vaddr, __flags32_t flags) {
 	// 0. let the user know what we're doing and clear paddr
 	if ((flags & VM_MAP_FLAG_DEBUG) != 0) {
@@ -0,0 +1,166 @@
+// File: kernel/sched/bench.c
+// Purpose: scheduler microbenchmarks.
+// SPDX-License-Identifier: MIT
+
+#include <kernel/clock/clock.h>     // for clock_monotonic_ns
+#include <kernel/core/printk.h>     // for printk
+#include <kernel/core/semaphore.h>  // for struct semaphore
+#include <kernel/sched/bench.h>     // for sched_bench_run
+#include <kernel/sched/sched.h>     // for sched_thread_start
+#include <kernel/sched/workqueue.h> // for sched_work_queue
+
+#include <sys/types.h> // for size_t
+
+// Number of times each thread of the yield benchmark yields.
+#define BENCH_YIELD_ITERATIONS 1000
+
+// Number of threads the spawn benchmark starts and joins one at a time.
+#define BENCH_SPAWN_ITERATIONS 1000
+
+// Number of work items the workqueue benchmark queues and waits for one at a time.
+#define BENCH_WORK_ITERATIONS 1000
+
+// Maximum number of threads we run concurrently.
+#define BENCH_MAX_THREADS 512
+
+// Number of runnable threads for each run of the yield benchmark.
+static const size_t bench_yield_threads[] = {2, 8, 32, 128, 512};
+
+// The IDs of the threads of the current run.
+static __thread_id_t bench_tids[BENCH_MAX_THREADS];
+
+// Main of the yield benchmark threads.
+static void __bench_yield_main(void *opaque) {
+	(void)opaque;
+	for (size_t idx = 0; idx < BENCH_YIELD_ITERATIONS; idx++) {
+		sched_thread_yield();
+	}
+}
+
+// Starts count joinable threads running main and joins them.
+//
+// Returns the elapsed time in nanoseconds or zero on failure.
+static __duration64_t __bench_run_threads(sched_thread_main_t *main, size_t count) {
+	// 1. start all the threads
+	__duration64_t start = clock_monotonic_ns();
+	size_t started = 0;
+	for (; started < count; started++) {
+		__status_t rc = sched_thread_start(&bench_tids[started], main, 0, SCHED_THREAD_FLAG_JOINABLE);
+		if (rc != 0) {
+			printk("bench: cannot start thread: %lld\n", rc);
+			break;
+		}
+	}
+
+	// 2. wait for the threads we started to terminate
+	for (size_t idx = 0; idx < started; idx++) {
+		(void)sched_thread_join(bench_tids[idx], 0);
+	}
+	__duration64_t elapsed = clock_monotonic_ns() - start;
+	return (started == count) ? elapsed : 0;
+}
+
+// Measures the cost of selecting and switching to the next thread
+// as a function of the number of runnable threads.
+//
+// With several CPUs online the threads spread across the CPUs, so
+// we measure the aggregate throughput rather than the latency.
+static void __bench_yield(void) {
+	for (size_t idx = 0; idx < sizeof(bench_yield_threads) / sizeof(bench_yield_threads[0]); idx++) {
+		size_t count = bench_yield_threads[idx];
+		__duration64_t elapsed = __bench_run_threads(__bench_yield_main, count);
+		if (elapsed == 0) {
+			return;
+		}
+		size_t switches = count * BENCH_YIELD_ITERATIONS;
+		printk("bench: yield: %lld threads: %lld ns/switch\n", count, elapsed / switches);
+	}
+}
+
+// The monotonic time when the current spawn benchmark thread started running.
+static __duration64_t bench_spawn_running;
+
+// Main of the spawn benchmark threads.
+static void __bench_spawn_main(void *opaque) {
+	(void)opaque;
+	__atomic_store_n(&bench_spawn_running, clock_monotonic_ns(), __ATOMIC_RELEASE);
+}
+
+// Measures the cost of starting a short-lived thread and the latency
+// until it runs, starting and joining one thread at a time, so that,
+// except for the first iterations, we reuse the threads we freed.
+static void __bench_spawn(void) {
+	__duration64_t start_ns = 0;
+	__duration64_t latency_ns = 0;
+	for (size_t idx = 0; idx < BENCH_SPAWN_ITERATIONS; idx++) {
+		// 1. start the thread measuring how long starting takes
+		__thread_id_t tid = 0;
+		__duration64_t before = clock_monotonic_ns();
+		__status_t rc = sched_thread_start(&tid, __bench_spawn_main, 0, SCHED_THREAD_FLAG_JOINABLE);
+		__duration64_t after = clock_monotonic_ns();
+		if (rc != 0) {
+			printk("bench: cannot start thread: %lld\n", rc);
+			return;
+		}
+
+		// 2. join the thread and measure when it started running
+		(void)sched_thread_join(tid, 0);
+		start_ns += after - before;
+		latency_ns += __atomic_load_n(&bench_spawn_running, __ATOMIC_ACQUIRE) - before;
+	}
+	printk("bench: spawn: %lld ns/start, %lld ns until running\n", start_ns / BENCH_SPAWN_ITERATIONS,
+	       latency_ns / BENCH_SPAWN_ITERATIONS);
+}
+
+// The monotonic time when the current workqueue benchmark work item started running.
+static __duration64_t bench_work_running;
+
+// Semaphore the workqueue benchmark work items signal when done.
+static struct semaphore bench_work_done = SEMAPHORE_INITIALIZER(bench_work_done, 0);
+
+// Function of the workqueue benchmark work items.
+static void __bench_work_func(void *opaque) {
+	(void)opaque;
+	__atomic_store_n(&bench_work_running, clock_monotonic_ns(), __ATOMIC_RELEASE);
+	semaphore_up(&bench_work_done);
+}
+
+// Measures the cost of queueing a work item and the latency until
+// a worker runs it, to compare with the spawn benchmark.
+static void __bench_workqueue(void) {
+	struct sched_work work;
+	sched_work_init(&work, __bench_work_func, 0);
+	__duration64_t queue_ns = 0;
+	__duration64_t latency_ns = 0;
+	for (size_t idx = 0; idx < BENCH_WORK_ITERATIONS; idx++) {
+		// 1. queue the work item measuring how long queueing takes
+		__duration64_t before = clock_monotonic_ns();
+		(void)sched_work_queue(&work);
+		__duration64_t after = clock_monotonic_ns();
+
+		// 2. wait for the work item and measure when it started running
+		semaphore_down(&bench_work_done);
+		queue_ns += after - before;
+		latency_ns += __atomic_load_n(&bench_work_running, __ATOMIC_ACQUIRE) - before;
+	}
+	printk("bench: workqueue: %lld ns/queue, %lld ns until running\n", queue_ns / BENCH_WORK_ITERATIONS,
+	       latency_ns / BENCH_WORK_ITERATIONS);
+}
+
+void sched_bench_run(void) {
+	__bench_yield();
+	__bench_spawn();
+	__bench_workqueue();
+	printk("bench: stack: deepest usage %lld of %lld bytes\n", sched_stack_max_usage(), sched_stack_size());
+	struct sched_fpu_stats fpu;
+	sched_fpu_stats(&fpu);
+	printk("bench: fpu: %lld saves (%lld avoided), %lld restores (%lld avoided)\n", fpu.saves, fpu.saves_avoided,
+	       fpu.restores, fpu.restores_avoided);
+	struct schedstat_latency latency;
+	sched_latency_histogram(&latency);
+	for (size_t idx = 0; idx < SCHEDSTAT_LATENCY_BUCKETS; idx++) {
+		if (latency.buckets[idx] != 0) {
+			printk("bench: wakeup latency: < %lld us: %lld\n", 1ULL << idx, latency.buckets[idx]);
+		}
+	}
+}
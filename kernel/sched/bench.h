@@ -0,0 +1,21 @@
+// File: kernel/sched/bench.h
+// Purpose: scheduler microbenchmarks.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_SCHED_BENCH_H
+#define KERNEL_SCHED_BENCH_H
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+
+__BEGIN_DECLS
+
+// Run the scheduler microbenchmarks and print their results.
+//
+// The init thread calls this function after starting the secondary
+// CPUs when we build the kernel with `-DSCHED_BENCH`.
+//
+// Must be invoked from a kernel thread.
+void sched_bench_run(void) __NOEXCEPT;
+
+__END_DECLS
+
+#endif // KERNEL_SCHED_BENCH_H
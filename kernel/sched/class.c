@@ -0,0 +1,122 @@
+// File: kernel/sched/class.c
+// Purpose: scheduling classes implementing the scheduling policies.
+// SPDX-License-Identifier: MIT
+
+#include <kernel/core/assert.h> // for KERNEL_ASSERT
+#include <kernel/core/heap.h>   // for heap_node_init
+#include <kernel/core/list.h>   // for list_init
+#include <kernel/sched/class.h> // the subsystem's API
+#include <kernel/sched/sched.h> // for SCHED_POLICY_FAIR
+
+#include <sys/types.h> // for size_t
+
+const struct sched_class *const sched_classes[SCHED_POLICY_DEADLINE + 1] = {
+    [SCHED_POLICY_RR] = &sched_class_rr,
+    [SCHED_POLICY_FAIR] = &sched_class_fair,
+    [SCHED_POLICY_FIFO] = &sched_class_fifo,
+    [SCHED_POLICY_DEADLINE] = &sched_class_deadline,
+};
+
+// The classes in rank order.
+static const struct sched_class *const sched_classes_ranked[] = {
+    &sched_class_deadline,
+    &sched_class_fifo,
+    &sched_class_rr,
+    &sched_class_fair,
+};
+
+// Number of classes.
+#define SCHED_NR_CLASSES (sizeof(sched_classes_ranked) / sizeof(sched_classes_ranked[0]))
+
+void sched_entity_init(struct sched_entity *se, uint32_t policy, size_t prio, int32_t nice) {
+	KERNEL_ASSERT(policy <= SCHED_POLICY_DEADLINE);
+	se->policy = policy;
+	se->weight = sched_fair_weight(nice);
+	se->prio = prio;
+	se->vruntime = 0;
+	se->exec_start_ns = 0;
+	list_init(&se->rqnode);
+	heap_node_init(&se->fairnode);
+	heap_node_init(&se->dlnode);
+	se->dl_abs_deadline = 0;
+	se->dl_budget = 0;
+	se->dl_next_period = 0;
+	se->dl_params = 0;
+	se->dl_throttled = false;
+}
+
+void sched_rq_init(struct sched_rq *rq) {
+	rq->curr = 0;
+	for (size_t idx = 0; idx < SCHED_NR_CLASSES; idx++) {
+		sched_classes_ranked[idx]->init(rq);
+	}
+}
+
+struct sched_entity *sched_rq_pick_next(struct sched_rq *rq, bool stealing) {
+	for (size_t idx = 0; idx < SCHED_NR_CLASSES; idx++) {
+		const struct sched_class *class = sched_classes_ranked[idx];
+		if (stealing && class->pinned) {
+			continue;
+		}
+		struct sched_entity *se = class->pick_next(rq);
+		if (se != 0) {
+			return se;
+		}
+	}
+	return 0;
+}
+
+size_t sched_rq_nr_queued(const struct sched_rq *rq) {
+	size_t count = 0;
+	for (size_t idx = 0; idx < SCHED_NR_CLASSES; idx++) {
+		count += sched_classes_ranked[idx]->nr_queued(rq);
+	}
+	return count;
+}
+
+size_t sched_rq_nr_stealable(const struct sched_rq *rq) {
+	size_t count = 0;
+	for (size_t idx = 0; idx < SCHED_NR_CLASSES; idx++) {
+		const struct sched_class *class = sched_classes_ranked[idx];
+		if (!class->pinned) {
+			count += class->nr_queued(rq);
+		}
+	}
+	return count;
+}
+
+bool sched_rq_wakeup_preempt(const struct sched_rq *rq,
+                             const struct sched_entity *curr,
+                             const struct sched_entity *se) {
+	const struct sched_class *class = sched_class_of(se);
+	const struct sched_class *currclass = sched_class_of(curr);
+	if (class != currclass) {
+		return class->rank < currclass->rank;
+	}
+	return class->wakeup(rq, curr, se);
+}
+
+bool sched_rq_replenish(struct sched_rq *rq, __duration64_t now_ns) {
+	bool replenished = false;
+	for (size_t idx = 0; idx < SCHED_NR_CLASSES; idx++) {
+		const struct sched_class *class = sched_classes_ranked[idx];
+		if (class->replenish != 0 && class->replenish(rq, now_ns)) {
+			replenished = true;
+		}
+	}
+	return replenished;
+}
+
+__duration64_t sched_rq_next_event(const struct sched_rq *rq) {
+	__duration64_t next = UINT64_MAX;
+	for (size_t idx = 0; idx < SCHED_NR_CLASSES; idx++) {
+		const struct sched_class *class = sched_classes_ranked[idx];
+		if (class->next_event != 0) {
+			__duration64_t event = class->next_event(rq);
+			if (event < next) {
+				next = event;
+			}
+		}
+	}
+	return next;
+}
@@ -0,0 +1,257 @@
+// File: kernel/sched/class.h
+// Purpose: scheduling classes implementing the scheduling policies.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_SCHED_CLASS_H
+#define KERNEL_SCHED_CLASS_H
+
+#include <kernel/core/heap.h>      // for struct heap
+#include <kernel/core/list.h>      // for struct list_node
+#include <kernel/sched/runqueue.h> // for struct sched_runqueue
+#include <kernel/sched/sched.h>    // for SCHED_POLICY_DEADLINE
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+#include <sys/types.h> // for __duration64_t
+
+__BEGIN_DECLS
+
+// The scheduling classes separate the policies, which decide which thread
+// runs next, from the mechanism in `./kernel/sched/sched.c`, which handles
+// locking, CPU selection, work stealing, the clock interrupt, admission
+// control, CPU quotas, and context switching.
+//
+// Each policy (i.e., SCHED_POLICY_xxx) has its own class, which orders the
+// entities in its part of a run queue. The classes do not know about threads,
+// CPUs, or locks, and the mechanism invokes them holding the scheduler
+// spinlock, so we can also compile them for the host and replay traces
+// through them (see `./tools/schedsim`).
+
+// The part of a thread the scheduling classes use.
+//
+// The mechanism embeds it into the thread and initializes it using
+// sched_entity_init, and the fields are then owned by the class of
+// the entity's policy, except for policy, prio, weight, and dl_params,
+// which the mechanism sets while the entity is not queued, and for
+// exec_start_ns, which the mechanism sets when charging the entity.
+struct sched_entity {
+	// The scheduling policy (one of SCHED_POLICY_xxx constants).
+	uint32_t policy;
+
+	// The weight corresponding to the nice value (see sched_fair_weight).
+	uint32_t weight;
+
+	// The priority (0 is the highest, see SCHED_PRIO_xxx).
+	size_t prio;
+
+	// The CPU time consumed so far, scaled by SCHED_FAIR_WEIGHT_NICE0 / weight.
+	//
+	// Only meaningful relative to the min_vruntime of the entity's run queue.
+	__duration64_t vruntime;
+
+	// The monotonic time when we last charged the entity for its CPU time.
+	__duration64_t exec_start_ns;
+
+	// Links a SCHED_POLICY_FIFO or SCHED_POLICY_RR entity into the run queue
+	// when it is runnable and not running.
+	//
+	// The mechanism also uses it to link a blocked thread into its wait queue.
+	struct list_node rqnode;
+
+	// Links a SCHED_POLICY_FAIR entity into the fair queue when
+	// it is runnable and not running.
+	struct heap_node fairnode;
+
+	// Links a SCHED_POLICY_DEADLINE entity into the deadline queue when it is runnable
+	// and not running, or into the throttled queue when it waits for the next period.
+	//
+	// The mechanism also uses it to park any other entity whose process
+	// exhausted its CPU quota until the next period.
+	struct heap_node dlnode;
+
+	// The monotonic time by which the entity must consume its budget.
+	__duration64_t dl_abs_deadline;
+
+	// The CPU time left in the current period, which is negative after an overrun.
+	int64_t dl_budget;
+
+	// The monotonic time at which the next period begins.
+	__duration64_t dl_next_period;
+
+	// The reservation of a SCHED_POLICY_DEADLINE entity.
+	const struct sched_deadline_params *dl_params;
+
+	// Whether the entity exhausted its budget and waits for the next period.
+	bool dl_throttled;
+};
+
+// Initialize an entity using the given policy, priority, and nice value.
+void sched_entity_init(struct sched_entity *se, uint32_t policy, size_t prio, int32_t nice) __NOEXCEPT;
+
+// The per-CPU run queue, which contains a part for each class.
+//
+// Initialize using sched_rq_init.
+struct sched_rq {
+	// The entity running on the CPU or zero if the CPU is running its
+	// idle thread or the running thread stopped being runnable.
+	//
+	// The mechanism sets this field when it switches threads.
+	struct sched_entity *curr;
+
+	// Runnable SCHED_POLICY_DEADLINE entities ordered by absolute deadline.
+	struct heap dlqueue;
+
+	// Runnable SCHED_POLICY_DEADLINE entities that exhausted their budget
+	// ordered by the beginning of their next period.
+	struct heap dlthrottled;
+
+	// Runnable SCHED_POLICY_FIFO entities.
+	struct sched_runqueue fifoqueue;
+
+	// Runnable SCHED_POLICY_RR entities.
+	struct sched_runqueue runqueue;
+
+	// Runnable SCHED_POLICY_FAIR entities ordered by virtual runtime.
+	struct heap fairqueue;
+
+	// The virtual clock of the fair queue, which never goes back
+	// and follows the smallest virtual runtime of the run queue.
+	__duration64_t min_vruntime;
+};
+
+// Initialize an empty run queue.
+void sched_rq_init(struct sched_rq *rq) __NOEXCEPT;
+
+// The entity was not runnable before being queued (i.e., it woke up or started).
+#define SCHED_ENQUEUE_WAKEUP (1 << 0)
+
+// The entity was running and a more important entity preempted it.
+#define SCHED_ENQUEUE_PREEMPTED (1 << 1)
+
+// The operations implementing a scheduling policy.
+//
+// The operations marked as optional may be zero.
+struct sched_class {
+	// The name of the policy.
+	const char *name;
+
+	// The class rank, where entities of lower-ranked classes run first.
+	uint32_t rank;
+
+	// Whether the entities only run on their own run queue, in
+	// which case other run queues must not steal them.
+	bool pinned;
+
+	// Initializes the part of an empty run queue belonging to the class.
+	void (*init)(struct sched_rq *rq);
+
+	// Links a runnable entity that is not running into the run queue.
+	//
+	// The flags are a combination of SCHED_ENQUEUE_xxx.
+	//
+	// Returns false if the class parked the entity until it may run
+	// again, in which case the mechanism must make sure the clock
+	// interrupt fires by the time returned by next_event.
+	bool (*enqueue)(struct sched_rq *rq, struct sched_entity *se, __flags32_t flags, __duration64_t now_ns);
+
+	// Unlinks an entity that is waiting in the run queue.
+	void (*dequeue)(struct sched_rq *rq, struct sched_entity *se);
+
+	// Returns whether a runnable entity is waiting in the run queue,
+	// which excludes the entities that the class has parked.
+	bool (*queued)(const struct sched_rq *rq, const struct sched_entity *se);
+
+	// Removes and returns the entity of this class that should run next or zero.
+	struct sched_entity *(*pick_next)(struct sched_rq *rq);
+
+	// Charges the running entity for delta_ns of CPU time ending at now_ns.
+	//
+	// Returns whether the entity must stop running.
+	bool (*tick)(struct sched_rq *rq, struct sched_entity *curr, __duration64_t delta_ns, __duration64_t now_ns);
+
+	// Returns whether an entity that became runnable should preempt
+	// the running entity, which belongs to the same class.
+	bool (*wakeup)(const struct sched_rq *rq, const struct sched_entity *curr, const struct sched_entity *se);
+
+	// Returns the number of entities waiting in the run queue.
+	size_t (*nr_queued)(const struct sched_rq *rq);
+
+	// Optional: prepares an entity that joins the class at now_ns
+	// while it is not queued (e.g., when it starts).
+	void (*attach)(struct sched_rq *rq, struct sched_entity *se, __duration64_t now_ns);
+
+	// Optional: prepares an entity that leaves the class while it is not queued.
+	//
+	// Returns whether the class had parked the entity, in which case the
+	// mechanism must queue it according to its new class.
+	bool (*detach)(struct sched_rq *rq, struct sched_entity *se);
+
+	// Optional: adjusts an entity that is not queued moving from one run queue to another.
+	void (*migrate)(struct sched_rq *from, struct sched_rq *to, struct sched_entity *se);
+
+	// Optional: makes runnable the parked entities that may run again at now_ns.
+	//
+	// Returns whether any entity became runnable.
+	bool (*replenish)(struct sched_rq *rq, __duration64_t now_ns);
+
+	// Optional: returns the earliest monotonic time at which the class needs
+	// the clock interrupt to fire, to stop the running entity or to make a
+	// parked entity runnable again, or UINT64_MAX.
+	__duration64_t (*next_event)(const struct sched_rq *rq);
+};
+
+// The SCHED_POLICY_DEADLINE class (see `./kernel/sched/class_deadline.c`).
+extern const struct sched_class sched_class_deadline;
+
+// The SCHED_POLICY_FIFO class (see `./kernel/sched/class_rt.c`).
+extern const struct sched_class sched_class_fifo;
+
+// The SCHED_POLICY_RR class (see `./kernel/sched/class_rt.c`).
+extern const struct sched_class sched_class_rr;
+
+// The SCHED_POLICY_FAIR class (see `./kernel/sched/class_fair.c`).
+extern const struct sched_class sched_class_fair;
+
+// The class of each policy indexed by SCHED_POLICY_xxx.
+extern const struct sched_class *const sched_classes[SCHED_POLICY_DEADLINE + 1];
+
+// Returns the class of the entity's policy.
+static inline const struct sched_class *sched_class_of(const struct sched_entity *se) __NOEXCEPT {
+	return sched_classes[se->policy];
+}
+
+// Returns the weight corresponding to the given nice value.
+uint32_t sched_fair_weight(int32_t nice) __NOEXCEPT;
+
+// Removes and returns the entity that should run next or zero.
+//
+// We ask each class in rank order, so the deadline entity with the earliest
+// deadline runs first, then the SCHED_POLICY_FIFO and SCHED_POLICY_RR entities
+// in priority order, and finally the fair entity with the smallest virtual
+// runtime. When stealing, we skip the classes whose entities are pinned.
+struct sched_entity *sched_rq_pick_next(struct sched_rq *rq, bool stealing) __NOEXCEPT;
+
+// Returns the number of entities waiting in the run queue.
+size_t sched_rq_nr_queued(const struct sched_rq *rq) __NOEXCEPT;
+
+// Returns the number of entities waiting in the run queue that
+// another run queue may steal, which excludes the pinned ones.
+size_t sched_rq_nr_stealable(const struct sched_rq *rq) __NOEXCEPT;
+
+// Returns whether se, which became runnable, should preempt curr.
+//
+// An entity of a lower-ranked class always preempts, otherwise
+// the class of both entities decides.
+bool sched_rq_wakeup_preempt(const struct sched_rq *rq,
+                             const struct sched_entity *curr,
+                             const struct sched_entity *se) __NOEXCEPT;
+
+// Makes runnable the parked entities of all classes that may run again at now_ns.
+//
+// Returns whether any entity became runnable.
+bool sched_rq_replenish(struct sched_rq *rq, __duration64_t now_ns) __NOEXCEPT;
+
+// Returns the earliest next_event of all classes or UINT64_MAX.
+__duration64_t sched_rq_next_event(const struct sched_rq *rq) __NOEXCEPT;
+
+__END_DECLS
+
+#endif // KERNEL_SCHED_CLASS_H
@@ -0,0 +1,187 @@
+// File: kernel/sched/class_deadline.c
+// Purpose: earliest-deadline-first scheduling class (SCHED_POLICY_DEADLINE).
+// SPDX-License-Identifier: MIT
+
+#include <kernel/core/assert.h> // for KERNEL_ASSERT
+#include <kernel/core/heap.h>   // for struct heap
+#include <kernel/core/list.h>   // for list_entry
+#include <kernel/sched/class.h> // the subsystem's API
+#include <kernel/sched/sched.h> // for struct sched_deadline_params
+
+#include <sys/types.h> // for __duration64_t
+
+// Orders the deadline queue by absolute deadline.
+static bool __sched_dl_less(const struct heap_node *a, const struct heap_node *b) {
+	const struct sched_entity *sa = list_entry(a, struct sched_entity, dlnode);
+	const struct sched_entity *sb = list_entry(b, struct sched_entity, dlnode);
+	return sa->dl_abs_deadline < sb->dl_abs_deadline;
+}
+
+// Orders the throttled queue by the beginning of the next period.
+static bool __sched_dl_throttled_less(const struct heap_node *a, const struct heap_node *b) {
+	const struct sched_entity *sa = list_entry(a, struct sched_entity, dlnode);
+	const struct sched_entity *sb = list_entry(b, struct sched_entity, dlnode);
+	return sa->dl_next_period < sb->dl_next_period;
+}
+
+// Starts a new period of a deadline entity at the given monotonic time.
+static inline void __sched_dl_new_period(struct sched_entity *se, __duration64_t start_ns) {
+	se->dl_budget = (int64_t)se->dl_params->runtime_ns;
+	se->dl_abs_deadline = start_ns + se->dl_params->deadline_ns;
+	se->dl_next_period = start_ns + se->dl_params->period_ns;
+	se->dl_throttled = false;
+}
+
+// Starts the period following the current one of a deadline entity, unless
+// the entity is so late that we would begin with an expired deadline.
+static inline void __sched_dl_replenish(struct sched_entity *se, __duration64_t now_ns) {
+	__duration64_t start_ns = se->dl_next_period;
+	if (start_ns + se->dl_params->deadline_ns <= now_ns) {
+		start_ns = now_ns;
+	}
+	__sched_dl_new_period(se, start_ns);
+}
+
+// Returns whether a deadline entity waking up at the given monotonic time
+// would use more than its reserved utilization by consuming the budget left
+// before its current deadline, in which case it needs a new period.
+//
+// This is the wakeup rule of the constant bandwidth server, which prevents
+// entities that sleep and wake up from stealing time reserved by others.
+static inline bool __sched_dl_overflow(const struct sched_entity *se, __duration64_t now_ns) {
+	if (se->dl_budget <= 0 || now_ns >= se->dl_abs_deadline) {
+		return true;
+	}
+	unsigned __int128 used = (unsigned __int128)(uint64_t)se->dl_budget * se->dl_params->deadline_ns;
+	unsigned __int128 allowed = (unsigned __int128)(se->dl_abs_deadline - now_ns) * se->dl_params->runtime_ns;
+	return used > allowed;
+}
+
+static void __sched_dl_init(struct sched_rq *rq) {
+	heap_init(&rq->dlqueue, __sched_dl_less);
+	heap_init(&rq->dlthrottled, __sched_dl_throttled_less);
+}
+
+// Refills the budget if the entity is entitled to it, or parks an entity
+// that exhausted its budget until its next period.
+static bool __sched_dl_enqueue(struct sched_rq *rq, struct sched_entity *se, __flags32_t flags, __duration64_t now_ns) {
+	KERNEL_ASSERT(se->dl_params != 0);
+	if (se->dl_throttled) {
+		if (now_ns < se->dl_next_period) {
+			heap_insert(&rq->dlthrottled, &se->dlnode);
+			return false;
+		}
+		__sched_dl_replenish(se, now_ns);
+	} else if ((flags & SCHED_ENQUEUE_WAKEUP) != 0 && __sched_dl_overflow(se, now_ns)) {
+		__sched_dl_new_period(se, now_ns);
+	}
+	heap_insert(&rq->dlqueue, &se->dlnode);
+	return true;
+}
+
+static void __sched_dl_dequeue(struct sched_rq *rq, struct sched_entity *se) {
+	heap_remove(&rq->dlqueue, &se->dlnode);
+}
+
+static bool __sched_dl_queued(const struct sched_rq *rq, const struct sched_entity *se) {
+	return !se->dl_throttled && heap_linked(&rq->dlqueue, &se->dlnode);
+}
+
+static struct sched_entity *__sched_dl_pick_next(struct sched_rq *rq) {
+	struct heap_node *node = heap_pop(&rq->dlqueue);
+	return (node != 0) ? list_entry(node, struct sched_entity, dlnode) : 0;
+}
+
+// Consumes the budget, which stops the entity when exhausted until its next period.
+static bool
+__sched_dl_tick(struct sched_rq *rq, struct sched_entity *curr, __duration64_t delta_ns, __duration64_t now_ns) {
+	(void)rq;
+	(void)now_ns;
+	curr->dl_budget -= (int64_t)delta_ns;
+	if (curr->dl_budget <= 0 && !curr->dl_throttled) {
+		curr->dl_throttled = true;
+		return true;
+	}
+	return false;
+}
+
+static bool
+__sched_dl_wakeup(const struct sched_rq *rq, const struct sched_entity *curr, const struct sched_entity *se) {
+	(void)rq;
+	return se->dl_abs_deadline < curr->dl_abs_deadline;
+}
+
+static size_t __sched_dl_nr_queued(const struct sched_rq *rq) {
+	return rq->dlqueue.count;
+}
+
+// Starts a new period for an entity that got a new reservation.
+static void __sched_dl_attach(struct sched_rq *rq, struct sched_entity *se, __duration64_t now_ns) {
+	(void)rq;
+	KERNEL_ASSERT(se->dl_params != 0);
+	__sched_dl_new_period(se, now_ns);
+}
+
+static bool __sched_dl_detach(struct sched_rq *rq, struct sched_entity *se) {
+	bool parked = se->dl_throttled && heap_linked(&rq->dlthrottled, &se->dlnode);
+	if (parked) {
+		heap_remove(&rq->dlthrottled, &se->dlnode);
+	}
+	se->dl_throttled = false;
+	return parked;
+}
+
+static bool __sched_dl_replenish_all(struct sched_rq *rq, __duration64_t now_ns) {
+	bool replenished = false;
+	for (;;) {
+		struct heap_node *node = heap_min(&rq->dlthrottled);
+		if (node == 0) {
+			return replenished;
+		}
+		struct sched_entity *se = list_entry(node, struct sched_entity, dlnode);
+		if (se->dl_next_period > now_ns) {
+			return replenished;
+		}
+		heap_remove(&rq->dlthrottled, node);
+		__sched_dl_replenish(se, now_ns);
+		heap_insert(&rq->dlqueue, &se->dlnode);
+		replenished = true;
+	}
+}
+
+// Returns the earliest among the end of the budget of the running
+// entity and the next period of the first throttled entity.
+static __duration64_t __sched_dl_next_event(const struct sched_rq *rq) {
+	__duration64_t next = UINT64_MAX;
+	struct sched_entity *curr = rq->curr;
+	if (curr != 0 && curr->policy == SCHED_POLICY_DEADLINE && !curr->dl_throttled) {
+		next = curr->exec_start_ns + (__duration64_t)curr->dl_budget;
+	}
+	struct heap_node *node = heap_min(&rq->dlthrottled);
+	if (node != 0) {
+		__duration64_t period = list_entry(node, struct sched_entity, dlnode)->dl_next_period;
+		if (period < next) {
+			next = period;
+		}
+	}
+	return next;
+}
+
+const struct sched_class sched_class_deadline = {
+    .name = "deadline",
+    .rank = 0,
+    .pinned = true,
+    .init = __sched_dl_init,
+    .enqueue = __sched_dl_enqueue,
+    .dequeue = __sched_dl_dequeue,
+    .queued = __sched_dl_queued,
+    .pick_next = __sched_dl_pick_next,
+    .tick = __sched_dl_tick,
+    .wakeup = __sched_dl_wakeup,
+    .nr_queued = __sched_dl_nr_queued,
+    .attach = __sched_dl_attach,
+    .detach = __sched_dl_detach,
+    .migrate = 0,
+    .replenish = __sched_dl_replenish_all,
+    .next_event = __sched_dl_next_event,
+};
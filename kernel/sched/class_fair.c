@@ -0,0 +1,166 @@
+// File: kernel/sched/class_fair.c
+// Purpose: fair-share scheduling class (SCHED_POLICY_FAIR).
+// SPDX-License-Identifier: MIT
+
+#include <kernel/clock/clock.h> // for CLOCK_NSEC_PER_JIFFY
+#include <kernel/core/heap.h>   // for struct heap
+#include <kernel/core/list.h>   // for list_entry
+#include <kernel/sched/class.h> // the subsystem's API
+#include <kernel/sched/sched.h> // for SCHED_NICE_MIN
+
+#include <sys/types.h> // for __duration64_t
+
+// The weight of a SCHED_POLICY_FAIR entity with nice value zero.
+#define SCHED_FAIR_WEIGHT_NICE0 1024
+
+// How far behind the virtual clock we place an entity that wakes up.
+//
+// An entity that slept for long gets at most one time slice of credit, which
+// lets it preempt CPU-bound entities without starving them.
+#define SCHED_FAIR_SLEEPER_CREDIT_NS CLOCK_NSEC_PER_JIFFY
+
+// How far ahead of an entity that wakes up the running entity must be for the
+// wakeup to preempt it, which avoids switching back and forth too often.
+#define SCHED_FAIR_WAKEUP_GRANULARITY_NS (CLOCK_NSEC_PER_JIFFY / 10)
+
+// Weight of each nice value, from SCHED_NICE_MIN to SCHED_NICE_MAX.
+//
+// Each step is ~1.25x, so that an entity changing its nice value by one
+// changes its CPU share by ~10% relative to another entity.
+static const uint32_t sched_fair_weights[SCHED_NICE_MAX - SCHED_NICE_MIN + 1] = {
+    /* -20 */ 88761, 71755, 56483, 46273, 36291,
+    /* -15 */ 29154, 23254, 18705, 14949, 11916,
+    /* -10 */ 9548,  7620,  6100,  4904,  3906,
+    /*  -5 */ 3121,  2501,  1991,  1586,  1277,
+    /*   0 */ 1024,  820,   655,   526,   423,
+    /*   5 */ 335,   272,   215,   172,   137,
+    /*  10 */ 110,   87,    70,    56,    45,
+    /*  15 */ 36,    29,    23,    18,    15,
+};
+
+uint32_t sched_fair_weight(int32_t nice) {
+	return sched_fair_weights[nice - SCHED_NICE_MIN];
+}
+
+// Returns whether virtual runtime a comes before virtual runtime b.
+static inline bool __sched_vruntime_before(__duration64_t a, __duration64_t b) {
+	return (int64_t)(a - b) < 0;
+}
+
+// Orders the fair queue by virtual runtime, tolerating wraparound.
+static bool __sched_fair_less(const struct heap_node *a, const struct heap_node *b) {
+	const struct sched_entity *sa = list_entry(a, struct sched_entity, fairnode);
+	const struct sched_entity *sb = list_entry(b, struct sched_entity, fairnode);
+	return __sched_vruntime_before(sa->vruntime, sb->vruntime);
+}
+
+// Advances the virtual clock of the run queue to the smallest virtual
+// runtime among the running entity and the entities in the fair queue.
+static void __sched_fair_update_min(struct sched_rq *rq) {
+	// 1. consider the running entity
+	struct sched_entity *curr = rq->curr;
+	bool found = curr != 0 && curr->policy == SCHED_POLICY_FAIR;
+	__duration64_t vmin = found ? curr->vruntime : 0;
+
+	// 2. consider the leftmost queued entity
+	struct heap_node *node = heap_min(&rq->fairqueue);
+	if (node != 0) {
+		__duration64_t vruntime = list_entry(node, struct sched_entity, fairnode)->vruntime;
+		if (!found || __sched_vruntime_before(vruntime, vmin)) {
+			vmin = vruntime;
+		}
+		found = true;
+	}
+
+	// 3. never move the virtual clock backwards
+	if (found && __sched_vruntime_before(rq->min_vruntime, vmin)) {
+		rq->min_vruntime = vmin;
+	}
+}
+
+static void __sched_fair_init(struct sched_rq *rq) {
+	heap_init(&rq->fairqueue, __sched_fair_less);
+	rq->min_vruntime = 0;
+}
+
+// Queues the entity by virtual runtime, giving a bounded credit to entities
+// that have been sleeping, so that they cannot monopolize the CPU.
+static bool
+__sched_fair_enqueue(struct sched_rq *rq, struct sched_entity *se, __flags32_t flags, __duration64_t now_ns) {
+	(void)now_ns;
+	if ((flags & SCHED_ENQUEUE_WAKEUP) != 0) {
+		__duration64_t floor = rq->min_vruntime - SCHED_FAIR_SLEEPER_CREDIT_NS;
+		if (__sched_vruntime_before(se->vruntime, floor)) {
+			se->vruntime = floor;
+		}
+	}
+	heap_insert(&rq->fairqueue, &se->fairnode);
+	return true;
+}
+
+static void __sched_fair_dequeue(struct sched_rq *rq, struct sched_entity *se) {
+	heap_remove(&rq->fairqueue, &se->fairnode);
+}
+
+static bool __sched_fair_queued(const struct sched_rq *rq, const struct sched_entity *se) {
+	return heap_linked(&rq->fairqueue, &se->fairnode);
+}
+
+static struct sched_entity *__sched_fair_pick_next(struct sched_rq *rq) {
+	struct heap_node *node = heap_pop(&rq->fairqueue);
+	return (node != 0) ? list_entry(node, struct sched_entity, fairnode) : 0;
+}
+
+// Advances the virtual runtime inversely to the weight. The clock interrupt
+// time slices fair entities, so we never need to stop the running one.
+static bool
+__sched_fair_tick(struct sched_rq *rq, struct sched_entity *curr, __duration64_t delta_ns, __duration64_t now_ns) {
+	(void)now_ns;
+	if (curr->weight != SCHED_FAIR_WEIGHT_NICE0) {
+		delta_ns = delta_ns * SCHED_FAIR_WEIGHT_NICE0 / curr->weight;
+	}
+	curr->vruntime += delta_ns;
+	__sched_fair_update_min(rq);
+	return false;
+}
+
+static bool
+__sched_fair_wakeup(const struct sched_rq *rq, const struct sched_entity *curr, const struct sched_entity *se) {
+	(void)rq;
+	return (int64_t)(curr->vruntime - se->vruntime) > (int64_t)SCHED_FAIR_WAKEUP_GRANULARITY_NS;
+}
+
+static size_t __sched_fair_nr_queued(const struct sched_rq *rq) {
+	return rq->fairqueue.count;
+}
+
+// An entity joining the class starts at the virtual clock.
+static void __sched_fair_attach(struct sched_rq *rq, struct sched_entity *se, __duration64_t now_ns) {
+	(void)now_ns;
+	se->vruntime = rq->min_vruntime;
+}
+
+// Moves the virtual runtime of an entity from the virtual clock of
+// one run queue to the virtual clock of another, preserving its lag.
+static void __sched_fair_migrate(struct sched_rq *from, struct sched_rq *to, struct sched_entity *se) {
+	se->vruntime = se->vruntime - from->min_vruntime + to->min_vruntime;
+}
+
+const struct sched_class sched_class_fair = {
+    .name = "fair",
+    .rank = 3,
+    .pinned = false,
+    .init = __sched_fair_init,
+    .enqueue = __sched_fair_enqueue,
+    .dequeue = __sched_fair_dequeue,
+    .queued = __sched_fair_queued,
+    .pick_next = __sched_fair_pick_next,
+    .tick = __sched_fair_tick,
+    .wakeup = __sched_fair_wakeup,
+    .nr_queued = __sched_fair_nr_queued,
+    .attach = __sched_fair_attach,
+    .detach = 0,
+    .migrate = __sched_fair_migrate,
+    .replenish = 0,
+    .next_event = 0,
+};
@@ -0,0 +1,127 @@
+// File: kernel/sched/class_rt.c
+// Purpose: priority scheduling classes (SCHED_POLICY_FIFO and SCHED_POLICY_RR).
+// SPDX-License-Identifier: MIT
+
+#include <kernel/core/list.h>      // for list_entry
+#include <kernel/sched/class.h>    // the subsystem's API
+#include <kernel/sched/runqueue.h> // for struct sched_runqueue
+
+#include <sys/types.h> // for size_t
+
+// Both classes keep their entities in a priority run queue and differ in
+// where a preempted entity goes: FIFO entities are not time sliced, so they
+// resume before their peers, while RR entities rotate through the tail.
+
+// Returns the entity linked through the given run queue node or zero.
+static inline struct sched_entity *__sched_rt_entry(struct list_node *node) {
+	return (node != 0) ? list_entry(node, struct sched_entity, rqnode) : 0;
+}
+
+static bool __sched_rt_queued(const struct sched_rq *rq, const struct sched_entity *se) {
+	(void)rq;
+	return list_linked(&se->rqnode);
+}
+
+static bool
+__sched_rt_tick(struct sched_rq *rq, struct sched_entity *curr, __duration64_t delta_ns, __duration64_t now_ns) {
+	// Nothing to charge, and the clock interrupt time slices RR entities
+	(void)rq;
+	(void)curr;
+	(void)delta_ns;
+	(void)now_ns;
+	return false;
+}
+
+static bool
+__sched_rt_wakeup(const struct sched_rq *rq, const struct sched_entity *curr, const struct sched_entity *se) {
+	(void)rq;
+	return se->prio < curr->prio;
+}
+
+static void __sched_fifo_init(struct sched_rq *rq) {
+	sched_runqueue_init(&rq->fifoqueue);
+}
+
+static bool
+__sched_fifo_enqueue(struct sched_rq *rq, struct sched_entity *se, __flags32_t flags, __duration64_t now_ns) {
+	(void)now_ns;
+	if ((flags & SCHED_ENQUEUE_PREEMPTED) != 0) {
+		sched_runqueue_push_front(&rq->fifoqueue, &se->rqnode, se->prio);
+	} else {
+		sched_runqueue_push(&rq->fifoqueue, &se->rqnode, se->prio);
+	}
+	return true;
+}
+
+static void __sched_fifo_dequeue(struct sched_rq *rq, struct sched_entity *se) {
+	sched_runqueue_remove(&rq->fifoqueue, &se->rqnode, se->prio);
+}
+
+static struct sched_entity *__sched_fifo_pick_next(struct sched_rq *rq) {
+	return __sched_rt_entry(sched_runqueue_pop(&rq->fifoqueue));
+}
+
+static size_t __sched_fifo_nr_queued(const struct sched_rq *rq) {
+	return rq->fifoqueue.nr_queued;
+}
+
+const struct sched_class sched_class_fifo = {
+    .name = "fifo",
+    .rank = 1,
+    .pinned = false,
+    .init = __sched_fifo_init,
+    .enqueue = __sched_fifo_enqueue,
+    .dequeue = __sched_fifo_dequeue,
+    .queued = __sched_rt_queued,
+    .pick_next = __sched_fifo_pick_next,
+    .tick = __sched_rt_tick,
+    .wakeup = __sched_rt_wakeup,
+    .nr_queued = __sched_fifo_nr_queued,
+    .attach = 0,
+    .detach = 0,
+    .migrate = 0,
+    .replenish = 0,
+    .next_event = 0,
+};
+
+static void __sched_rr_init(struct sched_rq *rq) {
+	sched_runqueue_init(&rq->runqueue);
+}
+
+static bool __sched_rr_enqueue(struct sched_rq *rq, struct sched_entity *se, __flags32_t flags, __duration64_t now_ns) {
+	(void)flags;
+	(void)now_ns;
+	sched_runqueue_push(&rq->runqueue, &se->rqnode, se->prio);
+	return true;
+}
+
+static void __sched_rr_dequeue(struct sched_rq *rq, struct sched_entity *se) {
+	sched_runqueue_remove(&rq->runqueue, &se->rqnode, se->prio);
+}
+
+static struct sched_entity *__sched_rr_pick_next(struct sched_rq *rq) {
+	return __sched_rt_entry(sched_runqueue_pop(&rq->runqueue));
+}
+
+static size_t __sched_rr_nr_queued(const struct sched_rq *rq) {
+	return rq->runqueue.nr_queued;
+}
+
+const struct sched_class sched_class_rr = {
+    .name = "rr",
+    .rank = 2,
+    .pinned = false,
+    .init = __sched_rr_init,
+    .enqueue = __sched_rr_enqueue,
+    .dequeue = __sched_rr_dequeue,
+    .queued = __sched_rt_queued,
+    .pick_next = __sched_rr_pick_next,
+    .tick = __sched_rt_tick,
+    .wakeup = __sched_rt_wakeup,
+    .nr_queued = __sched_rr_nr_queued,
+    .attach = 0,
+    .detach = 0,
+    .migrate = 0,
+    .replenish = 0,
+    .next_event = 0,
+};
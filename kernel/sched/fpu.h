@@ -0,0 +1,46 @@
+// File: kernel/sched/fpu.h
+// Purpose: lazy switching of the user FP/SIMD state.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_SCHED_FPU_H
+#define KERNEL_SCHED_FPU_H
+
+#include <sys/types.h> // for uint64_t
+
+// The FP/SIMD state of a thread.
+//
+// The kernel does not use FP/SIMD registers, since we compile it with
+// -mgeneral-regs-only, so neither the trap frame nor the switch frame
+// contain them. Instead, we trap the first FP/SIMD instruction a user
+// thread executes during its time slice and load its state, and we only
+// save the state of threads that used FP/SIMD during their time slice.
+// Each CPU remembers whose state its registers contain, so a thread that
+// runs again on the same CPU without anybody else using FP/SIMD in the
+// meanwhile does not need to load its state again.
+//
+// CAUTION: keep in sync with `./kernel/sched/fpu_arm64.S`.
+struct sched_fpu_state {
+	__uint128_t q[32];
+	uint64_t fpcr;
+	uint64_t fpsr;
+} __attribute__((aligned(16)));
+
+// Make sure the C struct is synchronized with the assembly code
+static_assert(sizeof(struct sched_fpu_state) == 528, "sched_fpu_state must be 528 bytes");
+static_assert(__builtin_offsetof(struct sched_fpu_state, fpcr) == 512, "fpcr offset");
+static_assert(__builtin_offsetof(struct sched_fpu_state, fpsr) == 520, "fpsr offset");
+
+// Saves the FP/SIMD registers into the given state.
+//
+// Called by the scheduler internals.
+//
+// Do not use outside of this subsystem.
+void __sched_fpu_save(struct sched_fpu_state *state);
+
+// Loads the FP/SIMD registers from the given state.
+//
+// Called by the scheduler internals.
+//
+// Do not use outside of this subsystem.
+void __sched_fpu_restore(const struct sched_fpu_state *state);
+
+#endif // KERNEL_SCHED_FPU_H
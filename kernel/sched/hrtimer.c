@@ -0,0 +1,126 @@
+// File: kernel/sched/hrtimer.c
+// Purpose: one-shot high-resolution kernel timers.
+// SPDX-License-Identifier: MIT
+
+#include <kernel/core/assert.h>   // for KERNEL_ASSERT
+#include <kernel/core/heap.h>     // for struct heap
+#include <kernel/core/list.h>     // for list_entry
+#include <kernel/core/spinlock.h> // for struct spinlock
+#include <kernel/sched/hrtimer.h> // the subsystem's API
+#include <kernel/sched/timer.h>   // for __sched_clock_timer_armed
+
+#include <sys/types.h> // for __duration64_t
+
+// Returns whether the timer a expires before the timer b.
+static bool __hrtimer_less(const struct heap_node *a, const struct heap_node *b) {
+	const struct sched_hrtimer *ta = list_entry(a, const struct sched_hrtimer, node);
+	const struct sched_hrtimer *tb = list_entry(b, const struct sched_hrtimer, node);
+	return ta->expires_ns < tb->expires_ns;
+}
+
+// The pending timers ordered by deadline.
+static struct heap queue = HEAP_INITIALIZER(__hrtimer_less);
+
+// Spinlock protecting the queue and the timers it contains.
+static struct spinlock lock = SPINLOCK_INITIALIZER;
+
+// The timer whose callback is running or zero.
+static struct sched_hrtimer *running;
+
+// Acquires the spinlock from any context disabling interrupts.
+//
+// Returns the interrupt state to pass to __hrtimer_unlock.
+static inline uint64_t __hrtimer_lock(void) {
+	return spinlock_acquire_irqsave(&lock);
+}
+
+// Releases the spinlock and restores the interrupt state.
+static inline void __hrtimer_unlock(uint64_t flags) {
+	spinlock_release_irqrestore(&lock, flags);
+}
+
+void sched_hrtimer_init(struct sched_hrtimer *timer, sched_timer_func_t *func, void *opaque) {
+	KERNEL_ASSERT(timer != 0 && func != 0);
+	heap_node_init(&timer->node);
+	timer->expires_ns = 0;
+	timer->func = func;
+	timer->opaque = opaque;
+}
+
+void sched_hrtimer_start(struct sched_hrtimer *timer, __duration64_t expires_ns) {
+	KERNEL_ASSERT(timer != 0 && timer->func != 0);
+	uint64_t flags = __hrtimer_lock();
+	if (heap_linked(&queue, &timer->node)) {
+		heap_remove(&queue, &timer->node);
+	}
+	timer->expires_ns = expires_ns;
+	heap_insert(&queue, &timer->node);
+	__hrtimer_unlock(flags);
+
+	// The clock interrupt may be stopped or programmed for later
+	__sched_clock_timer_armed(expires_ns);
+}
+
+bool sched_hrtimer_cancel(struct sched_hrtimer *timer) {
+	KERNEL_ASSERT(timer != 0);
+	uint64_t flags = __hrtimer_lock();
+	bool pending = heap_linked(&queue, &timer->node);
+	if (pending) {
+		heap_remove(&queue, &timer->node);
+	}
+	__hrtimer_unlock(flags);
+	return pending;
+}
+
+__duration64_t sched_hrtimer_next_expiry(void) {
+	uint64_t flags = __hrtimer_lock();
+	struct heap_node *node = heap_min(&queue);
+	__duration64_t next = (node != 0) ? list_entry(node, struct sched_hrtimer, node)->expires_ns : UINT64_MAX;
+	__hrtimer_unlock(flags);
+	return next;
+}
+
+bool sched_hrtimer_cancel_sync(struct sched_hrtimer *timer) {
+	KERNEL_ASSERT(timer != 0);
+	for (;;) {
+		uint64_t flags = __hrtimer_lock();
+		bool pending = heap_linked(&queue, &timer->node);
+		if (pending) {
+			heap_remove(&queue, &timer->node);
+		}
+		bool busy = (running == timer);
+		__hrtimer_unlock(flags);
+		if (!busy) {
+			return pending;
+		}
+		// The callback is running on the timer CPU, which we
+		// cannot be, since callbacks run with interrupts disabled
+	}
+}
+
+void __sched_hrtimer_run(__duration64_t now_ns) {
+	uint64_t flags = __hrtimer_lock();
+	for (;;) {
+		// 1. stop at the first timer that has not expired yet
+		struct heap_node *node = heap_min(&queue);
+		if (node == 0) {
+			break;
+		}
+		struct sched_hrtimer *timer = list_entry(node, struct sched_hrtimer, node);
+		if (timer->expires_ns > now_ns) {
+			break;
+		}
+
+		// 2. dequeue and invoke the callback without holding the spinlock,
+		// so that it can rearm timers or wake up threads
+		heap_remove(&queue, node);
+		sched_timer_func_t *func = timer->func;
+		void *opaque = timer->opaque;
+		running = timer;
+		__hrtimer_unlock(flags);
+		func(opaque);
+		flags = __hrtimer_lock();
+		running = 0;
+	}
+	__hrtimer_unlock(flags);
+}
@@ -0,0 +1,87 @@
+// File: kernel/sched/hrtimer.h
+// Purpose: one-shot high-resolution kernel timers.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_SCHED_HRTIMER_H
+#define KERNEL_SCHED_HRTIMER_H
+
+#include <kernel/core/heap.h>   // for struct heap_node
+#include <kernel/sched/timer.h> // for sched_timer_func_t
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+#include <sys/types.h> // for __duration64_t
+
+__BEGIN_DECLS
+
+// One-shot timer expiring at a given monotonic time in nanoseconds.
+//
+// Unlike struct sched_timer, which has jiffy granularity, the scheduler
+// programs the clock interrupt for the earliest pending high-resolution
+// timer, so these timers expire with the resolution of the hardware
+// counter plus the interrupt latency. Pending timers live in a heap
+// ordered by deadline, so prefer struct sched_timer for coarse timeouts.
+//
+// Initialize using sched_hrtimer_init.
+//
+// The timer subsystem protects the fields, so do not access them
+// directly and use the functions below.
+struct sched_hrtimer {
+	// Links the timer into the queue of pending timers.
+	struct heap_node node;
+
+	// The absolute monotonic time at which the timer expires.
+	__duration64_t expires_ns;
+
+	// The function to invoke when the timer expires.
+	sched_timer_func_t *func;
+
+	// The opaque argument for func.
+	void *opaque;
+};
+
+// Initialize a timer before using it.
+//
+// You retain ownership of opaque.
+void sched_hrtimer_init(struct sched_hrtimer *timer, sched_timer_func_t *func, void *opaque) __NOEXCEPT;
+
+// Arms the timer to expire at the given monotonic time (see clock_monotonic_ns).
+//
+// If the timer is already pending, it is re-armed with the new deadline. If
+// the deadline is in the past, the timer expires as soon as possible.
+//
+// The timer function runs in interrupt context, therefore it MUST NOT
+// block and it SHOULD be short.
+//
+// Safe to call from any context.
+void sched_hrtimer_start(struct sched_hrtimer *timer, __duration64_t expires_ns) __NOEXCEPT;
+
+// Disarms the timer.
+//
+// Returns whether the timer was pending. When the return value is false,
+// the timer has already expired, or it was not armed.
+//
+// Safe to call from any context.
+bool sched_hrtimer_cancel(struct sched_hrtimer *timer) __NOEXCEPT;
+
+// Disarms the timer and waits for its callback to complete if it is running.
+//
+// Use this function before freeing the memory the callback uses.
+//
+// Returns whether the timer was pending, like sched_hrtimer_cancel.
+//
+// MUST NOT be called by the callback of the timer itself.
+bool sched_hrtimer_cancel_sync(struct sched_hrtimer *timer) __NOEXCEPT;
+
+// Returns the monotonic time at which the first pending timer
+// expires or UINT64_MAX when no timer is pending.
+__duration64_t sched_hrtimer_next_expiry(void) __NOEXCEPT;
+
+// Expires all the timers whose deadline is not after now_ns.
+//
+// Called by the scheduler clock interrupt handler.
+//
+// Do not use outside of this subsystem.
+void __sched_hrtimer_run(__duration64_t now_ns) __NOEXCEPT;
+
+__END_DECLS
+
+#endif // KERNEL_SCHED_HRTIMER_H
@@ -0,0 +1,104 @@
+// File: kernel/sched/runqueue.h
+// Purpose: constant-time priority run queue.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_SCHED_RUNQUEUE_H
+#define KERNEL_SCHED_RUNQUEUE_H
+
+#include <kernel/core/list.h> // for struct list_node
+
+#include <sys/cdefs.h> // for __NOEXCEPT
+#include <sys/types.h> // for uint64_t
+
+__BEGIN_DECLS
+
+// Number of priority buckets in a run queue.
+//
+// This value MUST be equal to the number of bits in the bitmap.
+#define SCHED_RUNQUEUE_NPRIO 64
+
+// Queue of runnable threads ordered by priority.
+//
+// Each priority level (0 is the highest priority) has its own FIFO bucket
+// and the bitmap has bit N set iff bucket N is not empty. Selecting the
+// next thread is a find-first-set on the bitmap followed by popping the
+// head of the corresponding bucket, so the cost does not depend on the
+// number of threads. Threads that are pushed back at the tail of their
+// own bucket after running give us round-robin among equal priorities.
+//
+// Initialize using sched_runqueue_init.
+struct sched_runqueue {
+	// Bit N is set iff buckets[N] is not empty.
+	uint64_t bitmap;
+
+	// Number of nodes queued across all the buckets.
+	size_t nr_queued;
+
+	// One FIFO list per priority level.
+	struct list_node buckets[SCHED_RUNQUEUE_NPRIO];
+};
+
+static_assert(sizeof(((struct sched_runqueue *)0)->bitmap) * 8 == SCHED_RUNQUEUE_NPRIO, "bitmap size");
+
+// Initialize an empty run queue.
+static inline void sched_runqueue_init(struct sched_runqueue *rq) __NOEXCEPT {
+	rq->bitmap = 0;
+	rq->nr_queued = 0;
+	for (size_t idx = 0; idx < SCHED_RUNQUEUE_NPRIO; idx++) {
+		list_init(&rq->buckets[idx]);
+	}
+}
+
+// Returns whether the run queue is empty.
+static inline bool sched_runqueue_empty(const struct sched_runqueue *rq) __NOEXCEPT {
+	return rq->bitmap == 0;
+}
+
+// Appends node at the tail of the bucket for the given priority.
+static inline void sched_runqueue_push(struct sched_runqueue *rq, struct list_node *node, size_t prio) __NOEXCEPT {
+	list_push_back(&rq->buckets[prio], node);
+	rq->bitmap |= (1ULL << prio);
+	rq->nr_queued++;
+}
+
+// Prepends node at the head of the bucket for the given priority.
+//
+// Use this for a thread that was preempted before the end of its turn.
+static inline void
+sched_runqueue_push_front(struct sched_runqueue *rq, struct list_node *node, size_t prio) __NOEXCEPT {
+	list_push_front(&rq->buckets[prio], node);
+	rq->bitmap |= (1ULL << prio);
+	rq->nr_queued++;
+}
+
+// Removes node, which MUST be queued with the given priority.
+static inline void sched_runqueue_remove(struct sched_runqueue *rq, struct list_node *node, size_t prio) __NOEXCEPT {
+	list_remove(node);
+	if (list_empty(&rq->buckets[prio])) {
+		rq->bitmap &= ~(1ULL << prio);
+	}
+	rq->nr_queued--;
+}
+
+// Returns the highest priority level with queued nodes.
+//
+// The run queue MUST NOT be empty.
+static inline size_t sched_runqueue_top_prio(const struct sched_runqueue *rq) __NOEXCEPT {
+	return (size_t)__builtin_ctzll(rq->bitmap);
+}
+
+// Removes and returns the first node of the highest priority bucket.
+//
+// Returns zero if the run queue is empty.
+static inline struct list_node *sched_runqueue_pop(struct sched_runqueue *rq) __NOEXCEPT {
+	if (sched_runqueue_empty(rq)) {
+		return 0;
+	}
+	size_t prio = sched_runqueue_top_prio(rq);
+	struct list_node *node = list_front(&rq->buckets[prio]);
+	sched_runqueue_remove(rq, node, prio);
+	return node;
+}
+
+__END_DECLS
+
+#endif // KERNEL_SCHED_RUNQUEUE_H
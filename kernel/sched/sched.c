@@ -2,23 +2,37 @@
 // Purpose: kernel thread scheduler
 // SPDX-License-Identifier: MIT
 
-#include <kernel/asm/asm.h>       // for cpu_sleep_until_interrupt
-#include <kernel/clock/clock.h>   // for clock_tick_start
-#include <kernel/core/assert.h>   // for KERNEL_ASSERT
-#include <kernel/core/panic.h>    // for panic
-#include <kernel/core/printk.h>   // for printk
-#include <kernel/core/spinlock.h> // for struct spinlock
-#include <kernel/exec/load.h>     // for struct load_program
-#include <kernel/mm/vm.h>         // for struct vm_root_pt
-#include <kernel/sched/sched.h>   // the subsystem's API
-#include <kernel/sched/switch.h>  // switching threads
-#include <kernel/trap/trap.h>     // for trap_restore_user_and_eret
-
-#include <sys/errno.h> // for EAGAIN
-#include <sys/param.h> // for SCHED_MAX_THREADS
-#include <sys/types.h> // for __duration64_t
-
-#include <string.h> // for memset
+#include <kernel/asm/asm.h>         // for cpu_sleep_until_interrupt
+#include <kernel/clock/clock.h>     // for clock_monotonic_ns
+#include <kernel/core/assert.h>     // for KERNEL_ASSERT
+#include <kernel/core/heap.h>       // for struct heap
+#include <kernel/core/list.h>       // for struct list_node
+#include <kernel/core/panic.h>      // for panic
+#include <kernel/core/preempt.h>    // for __preempt_schedule
+#include <kernel/core/printk.h>     // for printk
+#include <kernel/core/rcu.h>        // for call_rcu
+#include <kernel/core/softirq.h>    // for softirq_raise
+#include <kernel/core/spinlock.h>   // for struct spinlock
+#include <kernel/exec/load.h>       // for struct load_program
+#include <kernel/mm/page.h>         // for page_alloc_contig
+#include <kernel/mm/slab.h>         // for struct slab_cache
+#include <kernel/mm/vm.h>           // for vm_unmap_explicit
+#include <kernel/sched/class.h>     // for struct sched_class
+#include <kernel/sched/fpu.h>       // for struct sched_fpu_state
+#include <kernel/sched/hrtimer.h>   // for struct sched_hrtimer
+#include <kernel/sched/sched.h>     // the subsystem's API
+#include <kernel/sched/switch.h>    // switching threads
+#include <kernel/sched/timer.h>     // for sched_timer_next_expiry
+#include <kernel/sched/waitqueue.h> // for struct sched_waitqueue
+#include <kernel/smp/smp.h>         // for smp_this_cpu
+#include <kernel/trap/trap.h>       // for trap_restore_user_and_eret
+
+#include <sys/cpuquota.h> // for struct cpuquota
+#include <sys/errno.h>    // for ETIMEDOUT
+#include <sys/param.h>    // for CACHE_LINE_SIZE, HZ, SCHED_MAX_THREADS
+#include <sys/types.h>    // for __duration64_t
+
+#include <string.h> // for __bzero
 
 // The scheduler is not using this thread slot.
 #define SCHED_THREAD_STATE_UNUSED 0
@@ -32,30 +46,141 @@
 // The thread is blocked waiting for a specific event to happen.
 #define SCHED_THREAD_STATE_BLOCKED 3
 
-// The size in bytes of the statically-allocated stack.
+// The size in bytes of the kernel stack of each thread.
 #define SCHED_THREAD_STACK_SIZE 8192
 
+// The number of contiguous pages backing the kernel stack of each thread.
+#define SCHED_THREAD_STACK_PAGES (SCHED_THREAD_STACK_SIZE / PAGE_SIZE)
+
+// The number of unmapped pages below each stack, which turn a stack
+// overflow into a kernel exception rather than memory corruption.
+#define SCHED_THREAD_GUARD_PAGES 1
+
+// The pattern with which we fill the unused part of the stacks, which
+// allows us to find out how deep a stack got (see __sched_stack_usage).
+#define SCHED_THREAD_STACK_CANARY 0x57acca2a57acca2aULL
+
+// Maximum number of exited threads we keep for reuse along with their stacks.
+#define SCHED_THREAD_POOL_MAX 64
+
+// Number of buckets of the hash table mapping thread IDs to threads.
+//
+// This value MUST be a power of two.
+#define SCHED_TID_HASH_SIZE 256
+
+// The CPU whose clock interrupt expires the kernel timers.
+#define SCHED_TIMER_CPU 0
+
+// Fixed-point shift of the CPU utilization reserved by deadline threads.
+#define SCHED_DL_BW_SHIFT 20
+
+// The CPU utilization that deadline threads may reserve on each CPU (i.e., 95%),
+// which leaves some CPU time to the other threads.
+#define SCHED_DL_BW_LIMIT (((1ULL << SCHED_DL_BW_SHIFT) * 95) / 100)
+
 // A process contains resources including threads.
 struct sched_process {
 	struct vm_root_pt page_table;
+
+	// The CPU time the process may consume in each period or zero if unlimited.
+	__duration64_t quota_ns;
+
+	// The length of the period of the CPU quota.
+	__duration64_t quota_period_ns;
+
+	// The CPU time the process consumed in the current period.
+	__duration64_t quota_used_ns;
+
+	// The monotonic time at which the next period begins.
+	__duration64_t quota_next_period;
 };
 
 // A schedulable thread of execution.
+//
+// We keep the fields we read and write when making scheduling decisions
+// (i.e., when selecting, queueing, waking up, and preempting threads)
+// together at the beginning, so that they span few cache lines, and the
+// fields we only use when creating, exiting, or joining threads after
+// them, starting on a separate cache line. The stack is a separate
+// allocation, so threads are dense in the slab cache.
 struct sched_thread {
 	// The thread stack pointer.
 	//
 	// CAUTION: This field MUST be the first element of a
 	// thread since the switch code assumes this.
-	uintptr_t sp;
+	alignas(CACHE_LINE_SIZE) uintptr_t sp;
 
-	// The statically-allocated aligned stack.
-	alignas(16) uint8_t stack[SCHED_THREAD_STACK_SIZE];
+	// The thread state (one of SCHED_THREAD_STATE_xxx constants).
+	uint32_t state;
+
+	// Flags modifying the thread behavior (see SCHED_THREAD_FLAG_xxx).
+	__flags32_t flags;
+
+	// The CPU on which the thread is running, is queued, or last ran.
+	size_t cpu;
+
+	// The wait queue the thread is blocked on or zero.
+	struct sched_waitqueue *waitingon;
+
+	// The CPU owning the reservation of a SCHED_POLICY_DEADLINE
+	// thread, which is the only one running the thread.
+	size_t dl_cpu;
+
+	// Whether the process exhausted its CPU quota and waits for the next period.
+	bool quota_throttled;
+
+	// The state the scheduling class of the thread's policy uses, including
+	// the nodes linking the thread into the run queues of its CPU.
+	struct sched_entity se;
+
+	// The kernel stack, which we allocate from the page allocator
+	// along with the unmapped guard pages right below it.
+	//
+	// This is the first of the fields we do not use for scheduling.
+	alignas(CACHE_LINE_SIZE) uint8_t *stack;
 
 	// The thread ID.
 	__thread_id_t id;
 
-	// The thread state (one of SCHED_THREAD_STATE_xxx constants).
-	uint64_t state;
+	// Links the thread into its bucket of the thread ID hash table.
+	struct list_node tidnode;
+
+	// Defers freeing the thread until lock-free lookups cannot reach it.
+	struct rcu_head rcu;
+
+	// The ID of the thread that started this thread or zero.
+	__thread_id_t parent;
+
+	// The thread blocked joining this thread or zero.
+	//
+	// When we exit, we only wake up this thread, or the parent when
+	// nobody is joining us, rather than all the joining threads.
+	struct sched_thread *joiner;
+
+	// Links an exited joinable thread into the zombies of its parent.
+	struct list_node zombienode;
+
+	// The exited joinable threads we started that nobody has joined yet.
+	struct list_node zombies;
+
+	// The number of joinable threads we started that nobody has joined yet.
+	size_t nr_children;
+
+	// Wait queue on which the thread waits while joining other threads,
+	// which only the threads it is joining wake up.
+	struct sched_waitqueue joinwq;
+
+	// The nice value (see SCHED_NICE_xxx).
+	int32_t nice;
+
+	// The reservation of a SCHED_POLICY_DEADLINE thread.
+	struct sched_deadline_params dl_params;
+
+	// The CPU utilization of the reservation shifted by SCHED_DL_BW_SHIFT.
+	uint64_t dl_bw;
+
+	// Timer waking up the thread when a wait with deadline expires.
+	struct sched_hrtimer timeout;
 
 	// The thread return value after it has exited.
 	void *retval;
@@ -66,15 +191,9 @@ struct sched_thread {
 	// The func argument.
 	void *opaque;
 
-	// Flags modifying the thread behavior (see SCHED_THREAD_FLAG_xxx).
-	__flags32_t flags;
-
 	// The raw trap frame pointer, which points inside the stack.
 	uintptr_t trapframe;
 
-	// The thing the thread is blocked by.
-	sched_channels_t blockedby;
-
 	// The epoch when the thread was created.
 	__duration64_t epoch;
 
@@ -91,66 +210,720 @@ struct sched_thread {
 	// This strategy is fine as long as we have a single
 	// thread for each user process.
 	struct sched_process __proc_storage;
+
+	// The CPU whose registers contain the latest FP/SIMD state
+	// of the thread or zero if the state is in fpstate.
+	struct sched_cpu *fp_cpu;
+
+	// The scheduler accounting of the thread.
+	struct schedstat_thread stats;
+
+	// The monotonic time when the thread was queued or zero if it is not queued.
+	__duration64_t queued_ns;
+
+	// Whether the thread was queued because it woke up or started.
+	bool queued_wakeup;
+
+	// The saved FP/SIMD state, which is zero until the thread uses FP/SIMD.
+	struct sched_fpu_state fpstate;
 };
 
 // Ensure that the important invariant assumed by switching code is still valid.
 static_assert(__builtin_offsetof(struct sched_thread, sp) == 0, "sp offset");
 
-// Statically allocated list of threads.
-static struct sched_thread threads[SCHED_MAX_THREADS];
+// Ensure the fields used for scheduling decisions fit in three cache lines.
+static_assert(__builtin_offsetof(struct sched_thread, stack) <= 3 * CACHE_LINE_SIZE, "hot fields size");
+
+// Cache from which we allocate the threads.
+static struct slab_cache thread_cache;
+
+// Threads that have been freed, which we keep along with their stacks, so
+// that spawning short-lived threads does not go through the allocators.
+//
+// The threads are linked through se.rqnode.
+static struct list_node thread_pool;
+
+// Number of threads in thread_pool.
+static size_t thread_pool_len;
+
+// Spinlock protecting thread_pool, which we use without holding the
+// scheduler spinlock, since we free threads after releasing it.
+static struct spinlock thread_pool_lock = SPINLOCK_INITIALIZER;
+
+// The deepest stack usage in bytes of the threads we have freed so far.
+static size_t stack_max_usage;
+
+// Hash table mapping the IDs of the live threads to the threads.
+static struct list_node tidhash[SCHED_TID_HASH_SIZE];
 
-// The thread that is currently running or zero if no thread is running.
+// The ID of the next thread we create, which allows us to never reuse IDs.
+static __thread_id_t next_tid = 1;
+
+// Number of threads in the hash table.
+static size_t nr_threads;
+
+// Per-CPU scheduler state.
 //
-// Note: this gets initialized to the idle thread when we try to switch the first time.
-static struct sched_thread *current = 0;
+// Each CPU runs threads from its own run queue and programs its own clock
+// interrupt. The spinlock protects the state of all the CPUs, except for
+// need_sched, which we access atomically.
+struct sched_cpu {
+	// The logical CPU ID.
+	//
+	// Each CPU starts on its own cache line, since other CPUs
+	// write its state when they queue threads on it.
+	alignas(CACHE_LINE_SIZE) size_t id;
 
-// Spinlock protecting access to the threads.
+	// The thread that is currently running on this CPU.
+	//
+	// Note: this gets initialized to the idle thread when the CPU switches the first time.
+	struct sched_thread *current;
+
+	// The ID of the current thread, which other CPUs read without
+	// holding the spinlock (see sched_thread_running).
+	__thread_id_t current_tid;
+
+	// The idle thread of this CPU.
+	//
+	// This is initialized by sched_thread_run.
+	struct sched_thread *idle;
+
+	// Runnable threads waiting for this CPU, which the scheduling
+	// classes order, and the thread they consider running.
+	//
+	// The idle thread is never queued here.
+	struct sched_rq rq;
+
+	// The sum of the dl_bw of the deadline threads owned by this CPU.
+	uint64_t dl_bw;
+
+	// Runnable threads that last ran on this CPU and whose process exhausted
+	// its CPU quota ordered by the beginning of the next period.
+	struct heap quotathrottled;
+
+	// Flag indicating we should reschedule
+	uint64_t need_sched;
+
+	// The monotonic time for which we have programmed the clock interrupt.
+	//
+	// Zero means the clock has not been started yet and
+	// UINT64_MAX means the clock interrupt is stopped.
+	__duration64_t clock_next_ns;
+
+	// The jiffy in which the clock interrupt last requested to reschedule.
+	__duration64_t clock_last_jiffy;
+
+	// Whether the CPU is running threads.
+	bool online;
+
+	// A thread that exited on this CPU, whose memory the thread we switched
+	// to frees, since a thread cannot free the stack it is running on.
+	struct sched_thread *dead;
+
+	// The thread whose FP/SIMD state the registers of this CPU contain or zero.
+	//
+	// The registers are only up to date if the thread's fp_cpu is also this CPU.
+	struct sched_thread *fp_owner;
+
+	// Counters of the FP/SIMD state saves and restores we performed and
+	// avoided, which we update with interrupts disabled on this CPU.
+	struct sched_fpu_stats fp_stats;
+
+	// The wakeup-to-run latency histogram of the threads run by this CPU.
+	struct schedstat_latency latency;
+};
+
+// The scheduler state of each CPU.
+static struct sched_cpu cpus[SMP_MAX_CPUS];
+
+// Spinlock protecting access to the threads and to the CPUs.
+//
+// We keep a single lock to protect all the scheduler state, which keeps
+// migrating and waking up threads simple, at the cost of contention.
 static struct spinlock lock = SPINLOCK_INITIALIZER;
 
-// The idle thread implementation.
+// Orders the quota throttled queue by the beginning of the next period.
+static bool __sched_quota_throttled_less(const struct heap_node *a, const struct heap_node *b);
+
+void sched_init_early(void) {
+	slab_cache_init(&thread_cache, "sched_thread", sizeof(struct sched_thread), alignof(struct sched_thread));
+	list_init(&thread_pool);
+	for (size_t idx = 0; idx < SCHED_TID_HASH_SIZE; idx++) {
+		list_init(&tidhash[idx]);
+	}
+	for (size_t id = 0; id < SMP_MAX_CPUS; id++) {
+		struct sched_cpu *cpu = &cpus[id];
+		cpu->id = id;
+		sched_rq_init(&cpu->rq);
+		heap_init(&cpu->quotathrottled, __sched_quota_throttled_less);
+		smp_cpu(id)->sched = cpu;
+	}
+	__sched_timer_init_early();
+}
+
+// Returns the scheduler state of the CPU we're running on.
+static inline struct sched_cpu *__sched_this_cpu(void) {
+	return smp_this_cpu()->sched;
+}
+
+// Returns the thread running on this CPU.
+//
+// We disable interrupts while reading, since otherwise we could be
+// preempted and migrate after reading the state of the previous CPU.
+static inline struct sched_thread *__sched_current(void) {
+	uint64_t flags = local_irq_save();
+	struct sched_thread *current = __sched_this_cpu()->current;
+	local_irq_restore(flags);
+	return current;
+}
+
+// Returns whether the given thread is the idle thread of its CPU.
+static inline bool __sched_thread_is_idle(struct sched_thread *thread) {
+	return cpus[thread->cpu].idle == thread;
+}
+
+static bool __sched_quota_throttled_less(const struct heap_node *a, const struct heap_node *b) {
+	const struct sched_thread *ta = list_entry(a, struct sched_thread, se.dlnode);
+	const struct sched_thread *tb = list_entry(b, struct sched_thread, se.dlnode);
+	return ta->__proc->quota_next_period < tb->__proc->quota_next_period;
+}
+
+// Returns the thread containing the given scheduling entity or zero.
+static inline struct sched_thread *__sched_thread_of(struct sched_entity *se) {
+	return (se != 0) ? list_entry(se, struct sched_thread, se) : 0;
+}
+
+// Returns the scheduling class of the thread's policy.
+static inline const struct sched_class *__sched_thread_class(const struct sched_thread *thread) {
+	return sched_class_of(&thread->se);
+}
+
+// Returns whether the thread uses one of the real-time policies.
+static inline bool __sched_thread_is_rt(const struct sched_thread *thread) {
+	return thread->se.policy == SCHED_POLICY_DEADLINE || thread->se.policy == SCHED_POLICY_FIFO;
+}
+
+// Returns the process of the thread if its CPU quota applies to the thread or zero.
+static inline struct sched_process *__sched_quota_process(const struct sched_thread *thread) {
+	struct sched_process *proc = thread->__proc;
+	return (proc != 0 && proc->quota_ns != 0 && thread->se.policy != SCHED_POLICY_DEADLINE) ? proc : 0;
+}
+
+// Starts a new period of the CPU quota of a process at the given monotonic time.
+static inline void __sched_quota_new_period(struct sched_process *proc, __duration64_t start_ns) {
+	proc->quota_used_ns = 0;
+	proc->quota_next_period = start_ns + proc->quota_period_ns;
+}
+
+// Starts the period following the current one of the CPU quota of a process,
+// unless the process did not run for whole periods, which we skip.
+static inline void __sched_quota_replenish(struct sched_process *proc, __duration64_t now_ns) {
+	__duration64_t start_ns = proc->quota_next_period;
+	if (start_ns + proc->quota_period_ns <= now_ns) {
+		start_ns = now_ns;
+	}
+	__sched_quota_new_period(proc, start_ns);
+}
+
+// Returns the monotonic time at which the running thread exhausts the
+// CPU quota of its process or UINT64_MAX if this cannot happen.
+static inline __duration64_t __sched_quota_end(const struct sched_thread *thread) {
+	struct sched_process *proc = __sched_quota_process(thread);
+	if (proc == 0 || thread->quota_throttled) {
+		return UINT64_MAX;
+	}
+	__duration64_t left = (proc->quota_used_ns < proc->quota_ns) ? proc->quota_ns - proc->quota_used_ns : 0;
+	return thread->se.exec_start_ns + left;
+}
+
+// Charges the running thread for the CPU time it consumed since we last did it.
+//
+// Must be invoked while holding the spinlock.
+static void __sched_update_current_locked(struct sched_cpu *cpu, __duration64_t now_ns) {
+	// 1. compute the elapsed time
+	struct sched_thread *curr = cpu->current;
+	if (curr == 0) {
+		return;
+	}
+	__duration64_t delta_ns = (now_ns > curr->se.exec_start_ns) ? now_ns - curr->se.exec_start_ns : 0;
+	curr->se.exec_start_ns = now_ns;
+	curr->stats.runtime_ns += delta_ns;
+
+	// 2. threads of processes with a CPU quota consume it and must stop
+	// running when they exhaust it, until their next period begins
+	if (curr == cpu->idle) {
+		return;
+	}
+	struct sched_process *proc = __sched_quota_process(curr);
+	if (proc != 0) {
+		if (now_ns >= proc->quota_next_period) {
+			__sched_quota_replenish(proc, now_ns);
+			curr->quota_throttled = false;
+		}
+		proc->quota_used_ns += delta_ns;
+		if (proc->quota_used_ns >= proc->quota_ns && !curr->quota_throttled) {
+			curr->quota_throttled = true;
+			curr->stats.nr_throttled++;
+			__atomic_store_n(&cpu->need_sched, 1, __ATOMIC_RELEASE);
+		}
+	}
+
+	// 3. the class of the thread's policy charges it and tells us whether it
+	// must stop running (e.g., a deadline thread that exhausted its budget)
+	if (__sched_thread_class(curr)->tick(&cpu->rq, &curr->se, delta_ns, now_ns)) {
+		__atomic_store_n(&cpu->need_sched, 1, __ATOMIC_RELEASE);
+	}
+}
+
+// Returns the number of threads waiting in the run queues of the CPU.
+static inline size_t __sched_cpu_nr_queued(struct sched_cpu *cpu) {
+	return sched_rq_nr_queued(&cpu->rq);
+}
+
+// Returns the number of threads waiting in the run queues of the CPU
+// that another CPU may steal, which excludes the deadline threads.
+static inline size_t __sched_cpu_nr_stealable(struct sched_cpu *cpu) {
+	return sched_rq_nr_stealable(&cpu->rq);
+}
+
+// Returns whether the thread is waiting in the run queues of its CPU.
 //
-// This is auto-initialized when we try to switch the first time.
-static struct sched_thread *idle_thread = 0;
+// Must be invoked while holding the spinlock.
+static inline bool __sched_thread_queued(struct sched_thread *thread) {
+	if (thread->state != SCHED_THREAD_STATE_RUNNABLE) {
+		return false;
+	}
+	return __sched_thread_class(thread)->queued(&cpus[thread->cpu].rq, &thread->se);
+}
 
-// ID used by the scheduler to try and be fair.
-static size_t fair_id = 0;
+// Links a runnable thread into the run queues of the CPU, which
+// MUST NOT be parking it (see __sched_dl_enqueue_locked).
+//
+// The flags are a combination of SCHED_ENQUEUE_xxx.
+//
+// Must be invoked while holding the spinlock.
+static void
+__sched_cpu_push_locked(struct sched_cpu *cpu, struct sched_thread *thread, __flags32_t flags, __duration64_t now_ns) {
+	bool queued = __sched_thread_class(thread)->enqueue(&cpu->rq, &thread->se, flags, now_ns);
+	KERNEL_ASSERT(queued);
+}
 
-// List of pending events since the last schedule occurred.
-static sched_channels_t events = 0;
+// Unlinks a queued thread from the run queues of the CPU.
+//
+// Must be invoked while holding the spinlock.
+static inline void __sched_cpu_remove_locked(struct sched_cpu *cpu, struct sched_thread *thread) {
+	__sched_thread_class(thread)->dequeue(&cpu->rq, &thread->se);
+}
 
-// Flag indicating we should reschedule
-static uint64_t need_sched = 0;
+// Removes and returns the next thread to run from the run queues of the CPU
+// according to the scheduling classes (see sched_rq_pick_next), skipping the
+// deadline threads when stealing, since they only run on their own CPU.
+//
+// Returns zero if nothing is queued.
+//
+// Must be invoked while holding the spinlock.
+static inline struct sched_thread *__sched_cpu_pop_locked(struct sched_cpu *cpu, bool stealing) {
+	return __sched_thread_of(sched_rq_pick_next(&cpu->rq, stealing));
+}
 
-// Number of ticks since the system has booted.
-static volatile __duration64_t jiffies = 0;
+// Lets the class of the thread's policy prepare a thread that is not
+// queued and joins the class at now_ns (e.g., when it starts).
+//
+// Must be invoked while holding the spinlock.
+static inline void
+__sched_class_attach_locked(struct sched_cpu *cpu, struct sched_thread *thread, __duration64_t now_ns) {
+	const struct sched_class *class = __sched_thread_class(thread);
+	if (class->attach != 0) {
+		class->attach(&cpu->rq, &thread->se, now_ns);
+	}
+}
+
+// Lets the class of the thread's policy adjust a thread that is
+// not queued and moves from the CPU from to the CPU to.
+//
+// Must be invoked while holding the spinlock.
+static inline void
+__sched_class_migrate_locked(struct sched_thread *thread, struct sched_cpu *from, struct sched_cpu *to) {
+	const struct sched_class *class = __sched_thread_class(thread);
+	if (class->migrate != 0 && from != to) {
+		class->migrate(&from->rq, &to->rq, &thread->se);
+	}
+}
+
+// Acquires the spinlock from any context disabling interrupts.
+//
+// Returns the interrupt state to pass to __sched_unlock.
+static inline uint64_t __sched_lock(void) {
+	return spinlock_acquire_irqsave(&lock);
+}
+
+// Releases the spinlock and restores the interrupt state.
+static inline void __sched_unlock(uint64_t flags) {
+	spinlock_release_irqrestore(&lock, flags);
+}
+
+static inline bool __sched_should_reschedule(void) {
+	return __atomic_exchange_n(&__sched_this_cpu()->need_sched, 0, __ATOMIC_ACQUIRE) != 0;
+}
+
+static inline __duration64_t __sched_jiffies(void) {
+	return clock_jiffies();
+}
+
+__duration64_t sched_jiffies(void) {
+	return __sched_jiffies();
+}
+
+// Returns the monotonic time at which the jiffy following now_ns begins.
+static inline __duration64_t __sched_next_tick_ns(__duration64_t now_ns) {
+	return (now_ns / CLOCK_NSEC_PER_JIFFY + 1) * CLOCK_NSEC_PER_JIFFY;
+}
+
+// Programs the clock interrupt of this CPU for the next event we care about.
+//
+// We need a periodic tick only when there are runnable threads waiting
+// for the CPU, since we need to preempt the running thread to give them
+// a chance to run. Otherwise, either the idle thread or a single thread
+// is running, so we only need to wake up for the next timer or we can
+// stop the clock interrupt entirely (tickless or NO_HZ operation).
+//
+// Only SCHED_TIMER_CPU expires the kernel timers, so that a timer does
+// not wake up all the idle CPUs, and the other CPUs ignore them.
+//
+// Each CPU also enforces the budget of the deadline threads it owns, so
+// it wakes up when the running deadline thread exhausts its budget and
+// when the next period of a throttled deadline thread begins. Likewise,
+// it enforces the CPU quota of the processes whose threads it runs.
+//
+// Must be invoked while holding the spinlock.
+static void __sched_clock_reprogram_locked(struct sched_cpu *cpu) {
+	// 0. we can only program the clock of the CPU we're running on
+	// and there's nothing to do until the IRQ subsystem starts it
+	KERNEL_ASSERT(cpu == __sched_this_cpu());
+	if (cpu->clock_next_ns == 0) {
+		return;
+	}
+
+	// 1. the periodic tick, if threads are competing for the CPU
+	__duration64_t now_ns = clock_monotonic_ns();
+	__duration64_t next = (__sched_cpu_nr_queued(cpu) == 0) ? UINT64_MAX : __sched_next_tick_ns(now_ns);
+
+	// 2. the events of the scheduling classes, such as the end of the budget of the
+	// running deadline thread and the next period of the first throttled one
+	__duration64_t event = sched_rq_next_event(&cpu->rq);
+	if (event < next) {
+		next = event;
+	}
+
+	// 3. the end of the CPU quota of the process of the running thread
+	struct sched_thread *curr = cpu->current;
+	if (curr != 0 && curr != cpu->idle) {
+		__duration64_t quota_end = __sched_quota_end(curr);
+		if (quota_end < next) {
+			next = quota_end;
+		}
+	}
+
+	// 4. the first throttled process that can run again
+	struct heap_node *quotanode = heap_min(&cpu->quotathrottled);
+	if (quotanode != 0) {
+		struct sched_thread *thread = list_entry(quotanode, struct sched_thread, se.dlnode);
+		__duration64_t period = thread->__proc->quota_next_period;
+		if (period < next) {
+			next = period;
+		}
+	}
+
+	if (cpu->id == SCHED_TIMER_CPU) {
+		// 5. the first jiffy-granularity timer
+		__duration64_t wheel = sched_timer_next_expiry();
+		if (wheel < UINT64_MAX / CLOCK_NSEC_PER_JIFFY && wheel * CLOCK_NSEC_PER_JIFFY < next) {
+			next = wheel * CLOCK_NSEC_PER_JIFFY;
+		}
+
+		// 6. the first high-resolution timer
+		__duration64_t hrtimer = sched_hrtimer_next_expiry();
+		if (hrtimer < next) {
+			next = hrtimer;
+		}
+	}
+
+	// 7. avoid touching the hardware if nothing changed
+	if (next == cpu->clock_next_ns) {
+		return;
+	}
+
+	// 8. program or stop the clock interrupt
+	cpu->clock_next_ns = next;
+	if (next == UINT64_MAX) {
+		clock_tick_stop();
+		return;
+	}
+	clock_tick_program(next);
+}
+
+// Ensures the clock interrupt of this CPU fires no later than the given monotonic time.
+//
+// Must be invoked while holding the spinlock.
+static inline void __sched_clock_kick_locked(struct sched_cpu *cpu, __duration64_t deadline_ns) {
+	if (deadline_ns < cpu->clock_next_ns) {
+		__sched_clock_reprogram_locked(cpu);
+	}
+}
+
+// Ensures the clock interrupt of the given CPU fires no later than the given
+// monotonic time, sending an IPI to a remote CPU to reprogram its clock.
+//
+// Must be invoked while holding the spinlock.
+static void __sched_cpu_arm_locked(struct sched_cpu *cpu, __duration64_t deadline_ns) {
+	if (cpu == __sched_this_cpu()) {
+		__sched_clock_kick_locked(cpu, deadline_ns);
+	} else if (deadline_ns < cpu->clock_next_ns) {
+		trap_send_reschedule_ipi(cpu->id);
+	}
+}
+
+// Tells the given CPU that we have queued a thread on its run queue.
+//
+// The CPU restarts the periodic tick if it was stopped because the CPU was
+// idle or a single thread was running, since now threads need to share the
+// CPU. A remote CPU needs an IPI to do that, which also wakes it up if it
+// is idle, unless it is busy and its tick is already running.
+//
+// The force flag indicates that a real-time thread must preempt the thread
+// running on a remote CPU, which always needs an IPI, so that the CPU
+// reschedules when returning from the interrupt rather than at its next tick.
+//
+// Must be invoked while holding the spinlock.
+static void __sched_cpu_notify_locked(struct sched_cpu *cpu, bool force) {
+	__duration64_t tick_ns = __sched_next_tick_ns(clock_monotonic_ns());
+	if (cpu == __sched_this_cpu()) {
+		__sched_clock_kick_locked(cpu, tick_ns);
+		return;
+	}
+	if (!force && cpu->current != cpu->idle && cpu->clock_next_ns <= tick_ns) {
+		return;
+	}
+	trap_send_reschedule_ipi(cpu->id);
+}
+
+void __sched_clock_timer_armed(__duration64_t expires_ns) {
+	uint64_t flags = __sched_lock();
+	__sched_cpu_arm_locked(&cpus[SCHED_TIMER_CPU], expires_ns);
+	__sched_unlock(flags);
+}
+
+// Asks the CPU to reschedule if the thread we just queued on it
+// should run before the thread that is currently running.
+//
+// Returns whether the CPU must reschedule.
+//
+// Must be invoked while holding the spinlock.
+static bool __sched_check_preempt_locked(struct sched_cpu *cpu, struct sched_thread *thread);
+
+// Queues a runnable deadline thread on the CPU owning its reservation or,
+// when it has exhausted its budget, parks it until its next period.
+//
+// The flags are a combination of SCHED_ENQUEUE_xxx, where SCHED_ENQUEUE_WAKEUP
+// indicates the thread was blocked and may need a new period.
+//
+// Must be invoked while holding the spinlock.
+static void __sched_dl_enqueue_locked(struct sched_thread *thread, __flags32_t flags, __duration64_t now_ns) {
+	// 1. deadline threads always run on the CPU owning their reservation
+	struct sched_cpu *cpu = &cpus[thread->dl_cpu];
+	thread->cpu = cpu->id;
+
+	// 2. the class refills the budget if the thread is entitled to it or parks
+	// the thread, in which case the clock must fire when its next period begins
+	if (!__sched_thread_class(thread)->enqueue(&cpu->rq, &thread->se, flags, now_ns)) {
+		__sched_cpu_arm_locked(cpu, thread->se.dl_next_period);
+		return;
+	}
+
+	// 3. let the CPU know
+	__sched_cpu_notify_locked(cpu, __sched_check_preempt_locked(cpu, thread));
+}
+
+// Makes runnable the threads the scheduling classes of the CPU parked
+// until now_ns (e.g., the throttled deadline threads whose next period began).
+//
+// We do not know which threads became runnable, so we let the CPU reschedule,
+// which picks the running thread again if it remains the most important one.
+//
+// Must be invoked while holding the spinlock.
+static void __sched_class_replenish_locked(struct sched_cpu *cpu, __duration64_t now_ns) {
+	if (sched_rq_replenish(&cpu->rq, now_ns) && cpu->current != cpu->idle) {
+		__atomic_store_n(&cpu->need_sched, 1, __ATOMIC_RELEASE);
+	}
+}
+
+// Releases the reservation of a deadline thread leaving the policy.
+//
+// Returns whether the thread was waiting for its next period, in which case
+// the caller must queue it according to its new policy.
+//
+// Must be invoked while holding the spinlock.
+static bool __sched_dl_release_locked(struct sched_thread *thread) {
+	struct sched_cpu *cpu = &cpus[thread->dl_cpu];
+	cpu->dl_bw -= thread->dl_bw;
+	thread->dl_bw = 0;
+	return sched_class_deadline.detach(&cpu->rq, &thread->se);
+}
+
+// Parks a runnable thread whose process exhausted its CPU quota on the
+// CPU until the next period begins, unless it has begun already.
+//
+// Returns whether we parked the thread, otherwise the caller must queue it.
+//
+// Must be invoked while holding the spinlock.
+static bool __sched_quota_park_locked(struct sched_cpu *cpu, struct sched_thread *thread, __duration64_t now_ns) {
+	struct sched_process *proc = thread->__proc;
+	if (now_ns >= proc->quota_next_period) {
+		__sched_quota_replenish(proc, now_ns);
+		thread->quota_throttled = false;
+		return false;
+	}
+	thread->cpu = cpu->id;
+	heap_insert(&cpu->quotathrottled, &thread->se.dlnode);
+	__sched_cpu_arm_locked(cpu, proc->quota_next_period);
+	return true;
+}
+
+// Makes runnable the throttled threads of the CPU whose process began a new period.
+//
+// Must be invoked while holding the spinlock.
+static void __sched_quota_replenish_locked(struct sched_cpu *cpu, __duration64_t now_ns) {
+	for (;;) {
+		struct heap_node *node = heap_min(&cpu->quotathrottled);
+		if (node == 0) {
+			return;
+		}
+		struct sched_thread *thread = list_entry(node, struct sched_thread, se.dlnode);
+		if (thread->__proc->quota_next_period > now_ns) {
+			return;
+		}
+		heap_remove(&cpu->quotathrottled, node);
+		__sched_quota_replenish(thread->__proc, now_ns);
+		thread->quota_throttled = false;
+
+		// A throttled fair thread did not advance its virtual runtime,
+		// so we queue it as a thread waking up, which bounds its credit
+		__sched_cpu_push_locked(cpu, thread, SCHED_ENQUEUE_WAKEUP, now_ns);
+		__sched_check_preempt_locked(cpu, thread);
+	}
+}
+
+// Lifts the throttling of a thread leaving the CPU quota of its process.
+//
+// Returns whether the thread was waiting for the next period, in which case
+// the caller must queue it.
+//
+// Must be invoked while holding the spinlock.
+static bool __sched_quota_unpark_locked(struct sched_thread *thread) {
+	struct sched_cpu *cpu = &cpus[thread->cpu];
+	bool parked = thread->quota_throttled && heap_linked(&cpu->quotathrottled, &thread->se.dlnode);
+	if (parked) {
+		heap_remove(&cpu->quotathrottled, &thread->se.dlnode);
+	}
+	thread->quota_throttled = false;
+	return parked;
+}
 
 void sched_clock_init_irqs(void) {
-	clock_tick_start();
+	// 1. arm the first tick and record its deadline for reprogramming
+	uint64_t flags = __sched_lock();
+	struct sched_cpu *cpu = __sched_this_cpu();
+	cpu->clock_next_ns = clock_tick_start();
+	__sched_unlock(flags);
+
+	// 2. let the user know without holding the spinlock
+	printk("clock: cpu%lld: ticking at most %lld times per second\n", cpu->id, HZ);
 }
 
 void sched_clock_isr(void) {
-	__atomic_fetch_add(&jiffies, 1, __ATOMIC_RELEASE);
-	sched_thread_resume_all(SCHED_THREAD_WAIT_TIMER);
-	clock_tick_rearm();
-	__atomic_store_n(&need_sched, 1, __ATOMIC_RELEASE);
+	// 1. expire the high-resolution timers, catching up with all the
+	// time that has elapsed since the previous clock interrupt, and
+	// leave the timer wheel, whose callbacks may be long, to the softirq
+	struct sched_cpu *cpu = __sched_this_cpu();
+	clock_update();
+	__duration64_t now_ns = clock_monotonic_ns();
+	if (cpu->id == SCHED_TIMER_CPU) {
+		__sched_hrtimer_run(now_ns);
+		softirq_raise(SOFTIRQ_TIMER);
+	}
+
+	// 2. enforce the budget of the running deadline thread and the CPU
+	// quota of its process, make the threads whose period began runnable
+	// again, and program the next clock interrupt
+	uint64_t flags = __sched_lock();
+	__sched_update_current_locked(cpu, now_ns);
+	__sched_class_replenish_locked(cpu, now_ns);
+	__sched_quota_replenish_locked(cpu, now_ns);
+	cpu->clock_next_ns = UINT64_MAX; // the programmed interrupt has fired
+	__sched_clock_reprogram_locked(cpu);
+	__sched_unlock(flags);
+
+	// 3. ask the current thread to reschedule at most once per
+	// jiffy, which is the time slice of threads sharing the CPU
+	__duration64_t jiffy = now_ns / CLOCK_NSEC_PER_JIFFY;
+	if (jiffy != cpu->clock_last_jiffy) {
+		cpu->clock_last_jiffy = jiffy;
+		__atomic_store_n(&cpu->need_sched, 1, __ATOMIC_RELEASE);
+	}
 }
 
-static inline bool __sched_should_reschedule(void) {
-	return __atomic_exchange_n(&need_sched, 0, __ATOMIC_ACQUIRE) != 0;
+void sched_ipi_isr(void) {
+	// Another CPU queued a thread for us or armed a timer we expire, so
+	// recompute when our clock must fire. If we're idle, returning from
+	// the interrupt is enough for the idle thread to look for work.
+	struct sched_cpu *cpu = __sched_this_cpu();
+	uint64_t flags = __sched_lock();
+	__sched_clock_reprogram_locked(cpu);
+	__sched_unlock(flags);
 }
 
-static inline __duration64_t __sched_jiffies(int memoryorder) {
-	return __atomic_load_n(&jiffies, memoryorder);
+// Frees the memory of a thread that nobody can reach anymore.
+static void __sched_thread_free(struct sched_thread *thread);
+
+// Frees an unregistered thread after the lock-free lookups
+// that may have reached it have completed.
+static void __sched_thread_free_deferred(struct sched_thread *thread);
+
+// Completes the switch to the current thread of this CPU.
+//
+// Releases the spinlock held by the thread that switched to us and frees
+// that thread if it exited, since we are not using its stack anymore.
+static void __sched_switch_finish(void) {
+	struct sched_cpu *cpu = __sched_this_cpu();
+	struct sched_thread *dead = cpu->dead;
+	cpu->dead = 0;
+	spinlock_release(&lock);
+	if (dead != 0) {
+		__sched_thread_free_deferred(dead);
+	}
+
+	// Switching context with preemption enabled means that this
+	// CPU is not within a read-side critical section
+	if (smp_this_cpu()->preempt_count == 0) {
+		rcu_quiescent_state();
+	}
 }
 
 void __sched_trampoline(void) {
+	// The thread that switched to us still holds the spinlock and masked
+	// interrupts, which we must unmask like the other switch paths do, or
+	// the new thread would run without ticks and never be preempted
+	__sched_switch_finish();
+	local_irq_enable();
+
+	struct sched_thread *current = __sched_current();
 	current->main(current->opaque);
 	sched_thread_exit(0);
 }
 
 static inline void __sched_thread_stack_init(struct sched_thread *thread) {
 	// See the stack as a uint8 aligned array
-	uintptr_t sp = (uintptr_t)&thread->stack[SCHED_THREAD_STACK_SIZE];
+	uintptr_t sp = (uintptr_t)thread->stack + SCHED_THREAD_STACK_SIZE;
 
 	// Ensure the stack is 16 byte aligned
 	KERNEL_ASSERT((sp & 0xF) == 0);
@@ -159,66 +932,297 @@ static inline void __sched_thread_stack_init(struct sched_thread *thread) {
 	thread->sp = __sched_build_switch_frame(sp);
 }
 
-// Assumption: the caller has acquired the spinlock
-static __status_t
-__sched_thread_start_locked(__thread_id_t *tid, sched_thread_main_t *main, void *opaque, __flags32_t flags) {
-	// 0. always clear the tid
-	KERNEL_ASSERT(tid != 0);
-	*tid = 0;
+// Timer callback waking up a thread whose wait deadline has expired.
+static void __sched_thread_timeout(void *opaque);
+
+// Queues a runnable thread on a CPU and makes sure that CPU notices.
+//
+// We prefer the CPU on which the thread last ran, whose caches may still
+// contain its data, unless that CPU is busy while another one is idle, in
+// which case we spread the load right away rather than waiting for the
+// idle CPU to steal the thread.
+//
+// Must be invoked while holding the spinlock.
+static void __sched_enqueue_locked(struct sched_thread *thread);
+
+// Returns a thread from the pool or zero if the pool is empty.
+//
+// The returned thread still contains the state it had when freed.
+static struct sched_thread *__sched_thread_pool_get(void) {
+	uint64_t irqflags = spinlock_acquire_irqsave(&thread_pool_lock);
+	struct sched_thread *thread = 0;
+	struct list_node *node = list_pop_front(&thread_pool);
+	if (node != 0) {
+		thread = list_entry(node, struct sched_thread, se.rqnode);
+		thread_pool_len--;
+	}
+	spinlock_release_irqrestore(&thread_pool_lock, irqflags);
+	return thread;
+}
 
-	// 1. find thread that is currently unused
+// Adds a thread to the pool.
+//
+// Returns false if the pool is full.
+static bool __sched_thread_pool_put(struct sched_thread *thread) {
+	uint64_t irqflags = spinlock_acquire_irqsave(&thread_pool_lock);
+	bool added = thread_pool_len < SCHED_THREAD_POOL_MAX;
+	if (added) {
+		list_push_front(&thread_pool, &thread->se.rqnode);
+		thread_pool_len++;
+	}
+	spinlock_release_irqrestore(&thread_pool_lock, irqflags);
+	return added;
+}
+
+// Fills the stack range [start, stack top) with SCHED_THREAD_STACK_CANARY.
+static void __sched_stack_paint(uint8_t *stack, size_t start) {
+	uint64_t *words = (uint64_t *)stack;
+	for (size_t idx = start / sizeof(*words); idx < SCHED_THREAD_STACK_SIZE / sizeof(*words); idx++) {
+		words[idx] = SCHED_THREAD_STACK_CANARY;
+	}
+}
+
+// Returns how many bytes of the given stack have been used since we painted it.
+//
+// Stacks grow downwards, so we scan upwards from the bottom of the
+// stack until we find the first word that is not the canary.
+static size_t __sched_stack_usage(const uint8_t *stack) {
+	const uint64_t *words = (const uint64_t *)stack;
 	size_t idx = 0;
-	struct sched_thread *candidate = 0;
-	for (; idx < SCHED_MAX_THREADS; idx++) {
-		candidate = &threads[idx];
-		if (candidate->state == SCHED_THREAD_STATE_UNUSED) {
-			break;
-		}
-		candidate = 0;
+	while (idx < SCHED_THREAD_STACK_SIZE / sizeof(*words) && words[idx] == SCHED_THREAD_STACK_CANARY) {
+		idx++;
 	}
+	return SCHED_THREAD_STACK_SIZE - idx * sizeof(*words);
+}
 
-	// 2. handle the case where we cannot create a new thread.
-	if (candidate == 0) {
-		return -EAGAIN;
+// Allocates the memory of a new thread and of its stack.
+//
+// Returns 0 on success and `-ENOMEM` or `-EAGAIN` on failure.
+static __status_t __sched_thread_alloc_memory(struct sched_thread **thread) {
+	// 1. allocate the thread
+	void *memory = 0;
+	__status_t rc = slab_alloc(&thread_cache, &memory, 0);
+	if (rc != 0) {
+		return rc;
 	}
 
-	// 3. for safety zero initialize the whole slot
-	memset(candidate, 0, sizeof(*candidate));
+	// 2. allocate the thread stack and its guard pages without zeroing them
+	page_addr_t base = 0;
+	size_t count = SCHED_THREAD_GUARD_PAGES + SCHED_THREAD_STACK_PAGES;
+	rc = page_alloc_contig(&base, count, PAGE_ALLOC_NOZERO);
+	if (rc != 0) {
+		slab_free(&thread_cache, memory);
+		return rc;
+	}
 
-	// 4. initialize the thread stack invoking MD code
-	candidate->sp = (uintptr_t)&candidate->stack[sizeof(candidate->stack)];
-	__sched_thread_stack_init(candidate);
+	// 3. unmap the guard pages from the kernel page table, which is the one
+	// we use while running in the kernel (see kernel/trap/handle_arm64.S)
+	for (size_t idx = 0; idx < SCHED_THREAD_GUARD_PAGES; idx++) {
+		vm_unmap_explicit(vm_kernel_root_pt(), base + idx * PAGE_SIZE, 0);
+	}
+
+	// 4. paint the stack so that we can measure its usage
+	uint8_t *stack = (uint8_t *)(base + SCHED_THREAD_GUARD_PAGES * PAGE_SIZE);
+	__sched_stack_paint(stack, 0);
+	*thread = memory;
+	(*thread)->stack = stack;
+	return 0;
+}
+
+// Allocates and initializes a thread without making it runnable.
+//
+// The thread is not visible to the rest of the scheduler until we
+// register it (see __sched_thread_register_locked).
+//
+// Returns zero if we cannot allocate memory for the thread.
+//
+// Must be invoked without holding the spinlock, since it allocates memory.
+static struct sched_thread *__sched_thread_alloc(sched_thread_main_t *main, void *opaque, __flags32_t flags) {
+	// 1. reuse a pooled thread and its stack or allocate new ones
+	struct sched_thread *candidate = __sched_thread_pool_get();
+	if (candidate == 0 && __sched_thread_alloc_memory(&candidate) != 0) {
+		return 0;
+	}
 
-	// 5. initialize the thread ID
-	candidate->id = idx;
+	// 2. clear the thread leaving the stack, which the code running on
+	// it initializes before reading, so we never need to zero it
+	uint8_t *stack = candidate->stack;
+	__bzero(candidate, sizeof(*candidate));
+	candidate->stack = stack;
+
+	// 3. initialize the thread stack invoking MD code
+	__sched_thread_stack_init(candidate);
 
-	// 6. initialize the thread state and make it runnable.
+	// 4. initialize the thread state and make it runnable.
 	candidate->state = SCHED_THREAD_STATE_RUNNABLE;
 
-	// 7. initialize the thread retval.
+	// 5. initialize the thread retval.
 	candidate->retval = 0;
 
-	// 8. initialize the thread main func and argument.
+	// 6. initialize the thread main func and argument.
 	candidate->main = main;
 	candidate->opaque = opaque;
 
-	// 9. copy the flags.
+	// 7. copy the flags.
 	candidate->flags = flags;
 
-	// 10. set the thread's epoch
-	candidate->epoch = __sched_jiffies(__ATOMIC_RELAXED);
+	// 8. set the thread's epoch
+	candidate->epoch = __sched_jiffies();
+
+	// 9. prepare the timer used by waits with a deadline.
+	sched_hrtimer_init(&candidate->timeout, __sched_thread_timeout, candidate);
+
+	// 10. use the default priority and policy and start near the creator.
+	uint32_t policy = ((flags & SCHED_THREAD_FLAG_FIFO) != 0) ? SCHED_POLICY_FIFO : SCHED_POLICY_DEFAULT;
+	candidate->nice = SCHED_NICE_DEFAULT;
+	sched_entity_init(&candidate->se, policy, SCHED_PRIO_DEFAULT, candidate->nice);
+	list_init(&candidate->tidnode);
+	list_init(&candidate->zombienode);
+	list_init(&candidate->zombies);
+	sched_waitqueue_init(&candidate->joinwq);
+	candidate->cpu = __sched_this_cpu()->id;
+	return candidate;
+}
+
+static void __sched_thread_free(struct sched_thread *thread) {
+	// 1. record how deep the stack got
+	KERNEL_ASSERT(!list_linked(&thread->tidnode));
+	KERNEL_ASSERT(!list_linked(&thread->se.rqnode));
+	size_t usage = __sched_stack_usage(thread->stack);
+	size_t max_usage = __atomic_load_n(&stack_max_usage, __ATOMIC_RELAXED);
+	while (usage > max_usage && !__atomic_compare_exchange_n(&stack_max_usage, &max_usage, usage, true,
+	                                                           __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+		// nothing
+	}
+
+	// 2. repaint the part of the stack we used and keep the thread for reuse
+	__sched_stack_paint(thread->stack, SCHED_THREAD_STACK_SIZE - usage);
+	if (__sched_thread_pool_put(thread)) {
+		return;
+	}
+
+	// 3. otherwise, map back the guard pages and free the memory
+	page_addr_t base = (page_addr_t)thread->stack - SCHED_THREAD_GUARD_PAGES * PAGE_SIZE;
+	for (size_t idx = 0; idx < SCHED_THREAD_GUARD_PAGES; idx++) {
+		vm_map_identity(vm_kernel_root_pt(), base + idx * PAGE_SIZE, VM_MAP_FLAG_WRITE);
+	}
+	page_free_contig(base, SCHED_THREAD_GUARD_PAGES + SCHED_THREAD_STACK_PAGES, 0);
+	slab_free(&thread_cache, thread);
+}
+
+// Invoked by call_rcu to free a thread.
+static void __sched_thread_free_rcu(struct rcu_head *head) {
+	struct sched_thread *thread = rcu_entry(head, struct sched_thread, rcu);
+	list_init(&thread->tidnode); // lookups cannot be standing on it anymore
+	__sched_thread_free(thread);
+}
+
+static void __sched_thread_free_deferred(struct sched_thread *thread) {
+	call_rcu(&thread->rcu, __sched_thread_free_rcu);
+}
+
+// Returns the hash table bucket of the given thread ID.
+static inline struct list_node *__sched_tid_bucket(__thread_id_t tid) {
+	return &tidhash[tid & (SCHED_TID_HASH_SIZE - 1)];
+}
+
+// Assigns an ID to the thread and makes it visible through the hash table.
+//
+// Returns false if we have reached SCHED_MAX_THREADS.
+//
+// Must be invoked while holding the spinlock.
+static bool __sched_thread_register_locked(struct sched_thread *thread) {
+	if (nr_threads >= SCHED_MAX_THREADS) {
+		return false;
+	}
+	nr_threads++;
+	thread->id = next_tid++;
+	list_push_back_rcu(__sched_tid_bucket(thread->id), &thread->tidnode);
+	return true;
+}
+
+// Removes a thread that is going away from the hash table.
+//
+// Lock-free lookups may still reach the thread, so free it
+// using __sched_thread_free_deferred.
+//
+// Must be invoked while holding the spinlock.
+static void __sched_thread_unregister_locked(struct sched_thread *thread) {
+	KERNEL_ASSERT(nr_threads > 0);
+	list_remove_rcu(&thread->tidnode);
+	nr_threads--;
+}
 
-	// 11. return the thread ID.
-	*tid = candidate->id;
+// Returns the live thread with the given ID or zero.
+//
+// Must be invoked while holding the spinlock or within an RCU
+// read-side critical section, which keeps the thread valid.
+static struct sched_thread *__sched_thread_find(__thread_id_t tid) {
+	struct list_node *bucket = __sched_tid_bucket(tid);
+	for (struct list_node *node = list_next_rcu(bucket); node != bucket; node = list_next_rcu(node)) {
+		struct sched_thread *thread = list_entry(node, struct sched_thread, tidnode);
+		if (thread->id == tid) {
+			return thread;
+		}
+	}
+	return 0;
+}
+
+// Returns the parent of the given thread if it is still running or zero.
+//
+// Must be invoked while holding the spinlock.
+static struct sched_thread *__sched_thread_parent_locked(struct sched_thread *thread) {
+	struct sched_thread *parent = (thread->parent != 0) ? __sched_thread_find(thread->parent) : 0;
+	return (parent != 0 && parent->state != SCHED_THREAD_STATE_EXITED) ? parent : 0;
+}
+
+// Assumption: the caller has acquired the spinlock and allocated the thread
+static __status_t __sched_thread_start_locked(__thread_id_t *tid, struct sched_thread *thread) {
+	// 1. always clear the tid
+	KERNEL_ASSERT(tid != 0);
+	*tid = 0;
+
+	// 2. assign the thread ID
+	if (!__sched_thread_register_locked(thread)) {
+		return -EAGAIN;
+	}
+
+	// 3. remember who started the thread, which sched_thread_join_any
+	// uses to collect the thread if it is joinable
+	struct sched_thread *parent = __sched_current();
+	if (parent != 0) {
+		thread->parent = parent->id;
+		if ((thread->flags & SCHED_THREAD_FLAG_JOINABLE) != 0) {
+			parent->nr_children++;
+		}
+	}
+
+	// 4. make the thread runnable, letting its class prepare it
+	// (e.g., a fair thread starts at the virtual clock)
+	__sched_class_attach_locked(&cpus[thread->cpu], thread, clock_monotonic_ns());
+	__sched_enqueue_locked(thread);
+
+	// 5. return the thread ID.
+	*tid = thread->id;
 	return 0;
 }
 
 __status_t sched_thread_start(__thread_id_t *tid, sched_thread_main_t *main, void *opaque, __flags32_t flags) {
-	// Ensure no-one can modify the thread global state while we're creating a thread
+	// Allocate memory before taking the spinlock, since the allocators have their own
 	KERNEL_ASSERT(tid != 0 && main != 0);
-	spinlock_acquire(&lock);
-	__status_t rc = __sched_thread_start_locked(tid, main, opaque, flags);
-	spinlock_release(&lock);
+	*tid = 0;
+	struct sched_thread *thread = __sched_thread_alloc(main, opaque, flags);
+	if (thread == 0) {
+		return -EAGAIN;
+	}
+
+	// Ensure no-one can modify the thread global state while we're registering the thread
+	uint64_t irqflags = __sched_lock();
+	__status_t rc = __sched_thread_start_locked(tid, thread);
+	__sched_unlock(irqflags);
+	if (rc != 0) {
+		__sched_thread_free(thread);
+	}
 	return rc;
 }
 
@@ -230,6 +1234,7 @@ static inline struct sched_process *must_get_process(struct sched_thread *thread
 
 __status_t sched_current_process_page_table(struct vm_root_pt *table) {
 	KERNEL_ASSERT(table != 0);
+	struct sched_thread *current = __sched_current();
 	KERNEL_ASSERT(current != 0);
 	if (current->__proc == 0) {
 		*table = (struct vm_root_pt){0};
@@ -241,6 +1246,7 @@ __status_t sched_current_process_page_table(struct vm_root_pt *table) {
 
 [[noreturn]] void sched_process_exec(struct load_program *program) {
 	// 1. some sanity checks to make sure it's all good
+	struct sched_thread *current = __sched_current();
 	KERNEL_ASSERT(current != 0);
 	KERNEL_ASSERT(program != 0);
 
@@ -259,9 +1265,18 @@ __status_t sched_current_process_page_table(struct vm_root_pt *table) {
 	proc->page_table = program->root;
 
 	// 5. permanently attach this thread to a user process
-	// and mark the thread as joinable.
+	// and mark the thread as joinable, which makes it a
+	// child that the parent thread needs to join.
+	spinlock_acquire(&lock);
+	if ((current->flags & SCHED_THREAD_FLAG_JOINABLE) == 0) {
+		struct sched_thread *parent = __sched_thread_parent_locked(current);
+		if (parent != 0) {
+			parent->nr_children++;
+		}
+	}
 	current->flags |= SCHED_THREAD_FLAG_JOINABLE;
 	current->flags |= SCHED_THREAD_FLAG_PROCESS;
+	spinlock_release(&lock);
 
 	// 6. call assembly code to initialize the trapframe
 	// relative to the current thread stack. The idea here
@@ -273,6 +1288,38 @@ __status_t sched_current_process_page_table(struct vm_root_pt *table) {
 	panic("trap_restore_user_and_eret should never return\n");
 }
 
+// Returns whether any CPU has runnable threads waiting in its run queue,
+// which the calling CPU could run or steal.
+//
+// Must be invoked while holding the spinlock.
+static bool __sched_runnable_anywhere_locked(struct sched_cpu *cpu) {
+	if (__sched_cpu_nr_queued(cpu) != 0) {
+		return true;
+	}
+	for (size_t id = 0; id < SMP_MAX_CPUS; id++) {
+		if (__sched_cpu_nr_stealable(&cpus[id]) != 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Prepares the clock before the idle thread suspends the CPU.
+//
+// Returns whether the CPU can sleep because no thread is runnable.
+//
+// Must be invoked with interrupts disabled.
+static bool __sched_idle_enter(void) {
+	spinlock_acquire(&lock);
+	struct sched_cpu *cpu = __sched_this_cpu();
+	bool cansleep = !__sched_runnable_anywhere_locked(cpu);
+	if (cansleep) {
+		__sched_clock_reprogram_locked(cpu);
+	}
+	spinlock_release(&lock);
+	return cansleep;
+}
+
 // Loop forever yielding the CPU and then awaiting for interrupts.
 [[noreturn]] static void __idle_main(void *unused) {
 	(void)unused;
@@ -280,116 +1327,408 @@ __status_t sched_current_process_page_table(struct vm_root_pt *table) {
 	// the processor as soon as possible.
 	for (;;) {
 		sched_thread_yield();
-		cpu_sleep_until_interrupt();
+
+		// We stop the tick or program it for the next timer and we sleep
+		// with interrupts disabled. WFI returns when an interrupt becomes
+		// pending even if it's masked, so we cannot miss wakeups that occur
+		// between checking the run queue and suspending the CPU, and we
+		// service the interrupt as soon as we re-enable interrupts.
+		local_irq_disable();
+		if (__sched_idle_enter()) {
+			cpu_sleep_until_interrupt();
+		}
+		local_irq_enable();
+	}
+}
+
+// Switches the user FP/SIMD state from prev to next.
+//
+// We save the state of prev only if it has used FP/SIMD during its time
+// slice, which we know because we only allow user access after the first
+// trap (see sched_fpu_trap), and we let next access FP/SIMD right away
+// if the registers still contain its state, otherwise we trap again.
+//
+// Must be invoked while holding the spinlock with interrupts disabled.
+static void __sched_fpu_switch_locked(struct sched_cpu *cpu, struct sched_thread *prev, struct sched_thread *next) {
+	// 1. save the state of prev if needed, which remains in the registers
+	if (cpu_fp_user_access()) {
+		KERNEL_ASSERT(cpu->fp_owner == prev && prev->fp_cpu == cpu);
+		__sched_fpu_save(&prev->fpstate);
+		__atomic_store_n(&cpu->fp_stats.saves, cpu->fp_stats.saves + 1, __ATOMIC_RELAXED);
+	} else {
+		__atomic_store_n(&cpu->fp_stats.saves_avoided, cpu->fp_stats.saves_avoided + 1, __ATOMIC_RELAXED);
+	}
+
+	// 2. reuse the registers if they still contain the state of next
+	bool loaded = cpu->fp_owner == next && next->fp_cpu == cpu;
+	if (loaded) {
+		__atomic_store_n(&cpu->fp_stats.restores_avoided, cpu->fp_stats.restores_avoided + 1, __ATOMIC_RELAXED);
+	}
+	cpu_fp_set_user_access(loaded);
+}
+
+void sched_fpu_trap(void) {
+	// We only get here when the registers do not contain the state of the
+	// current thread, since otherwise we would have allowed user access
+	struct sched_cpu *cpu = __sched_this_cpu();
+	struct sched_thread *current = cpu->current;
+	KERNEL_ASSERT(!cpu_fp_user_access());
+	__sched_fpu_restore(&current->fpstate);
+	cpu->fp_owner = current;
+	current->fp_cpu = cpu;
+	__atomic_store_n(&cpu->fp_stats.restores, cpu->fp_stats.restores + 1, __ATOMIC_RELAXED);
+	cpu_fp_set_user_access(true);
+}
+
+void sched_fpu_stats(struct sched_fpu_stats *stats) {
+	KERNEL_ASSERT(stats != 0);
+	*stats = (struct sched_fpu_stats){};
+
+	// The counters only grow and each CPU updates its own with relaxed
+	// atomic stores, so we sum them without taking the spinlock
+	for (size_t id = 0; id < SMP_MAX_CPUS; id++) {
+		struct sched_fpu_stats *counters = &cpus[id].fp_stats;
+		stats->saves += __atomic_load_n(&counters->saves, __ATOMIC_RELAXED);
+		stats->saves_avoided += __atomic_load_n(&counters->saves_avoided, __ATOMIC_RELAXED);
+		stats->restores += __atomic_load_n(&counters->restores, __ATOMIC_RELAXED);
+		stats->restores_avoided += __atomic_load_n(&counters->restores_avoided, __ATOMIC_RELAXED);
+	}
+}
+
+// Helper function to switch this CPU to next and unlock the spinlock.
+//
+// Must be invoked while holding the spinlock with interrupts disabled.
+//
+// We hold the spinlock across the switch, so that no other CPU can resume
+// the previous thread until we have saved its context. The thread we switch
+// to releases the spinlock: either below, when it returns from its own call
+// to __sched_switch, or in __sched_trampoline, when it is a new thread.
+static void __switch_to_and_unlock(struct sched_cpu *cpu, struct sched_thread *next) {
+	// 1. Save the previous thread
+	struct sched_thread *prev = cpu->current;
+
+	// 2. Update current and remember where next runs
+	cpu->current = next;
+	cpu->rq.curr = (next != cpu->idle) ? &next->se : 0;
+	__atomic_store_n(&cpu->current_tid, next->id, __ATOMIC_RELAXED);
+	next->cpu = cpu->id;
+
+	// 3. Make sure we notice when a deadline thread exhausts its budget
+	// and when next exhausts the CPU quota of its process, even if the
+	// CPU would otherwise be tickless
+	if (next != prev && next->se.policy == SCHED_POLICY_DEADLINE) {
+		__sched_clock_kick_locked(cpu, next->se.exec_start_ns + (__duration64_t)next->se.dl_budget);
+	}
+	__sched_clock_kick_locked(cpu, __sched_quota_end(next));
+
+	// 4. do not perform any context switching if the two threads are equal
+	if (prev != next) {
+		// 4.1. check for invariants assumed by __sched_switch, including that
+		// we only hold the spinlock, since next would otherwise inherit the
+		// preemption disabled by the other spinlocks held by prev
+		static_assert(__builtin_offsetof(struct sched_thread, sp) == 0, "sp must be at offset 0");
+		KERNEL_ASSERT(smp_this_cpu()->preempt_count == 1);
+
+		// 4.2. Switch the user FP/SIMD state lazily
+		__sched_fpu_switch_locked(cpu, prev, next);
+
+		// 4.3. Use MD code to switch context
+		__sched_switch(prev, next);
+	}
+
+	// 5. Release the spinlock acquired by whoever switched to us, noting
+	// that we may now be running on another CPU
+	__sched_switch_finish();
+}
+
+[[noreturn]] void sched_thread_run(void) {
+	// Manually instantiate the idle thread of this CPU, which we do
+	// not queue, since it only runs when there's nothing else to run
+	local_irq_disable();
+	struct sched_thread *idle = __sched_thread_alloc(__idle_main, /* opaque */ 0, /* flags */ 0);
+	KERNEL_ASSERT(idle != 0);
+	spinlock_acquire(&lock);
+	KERNEL_ASSERT(__sched_thread_register_locked(idle));
+	struct sched_cpu *cpu = __sched_this_cpu();
+	printk("scheduler: cpu%lld: created idle thread with ID: %lld\n", cpu->id, idle->id);
+
+	// Manually set it as the currently running thread
+	cpu->idle = idle;
+	cpu->current = idle;
+	__atomic_store_n(&cpu->current_tid, idle->id, __ATOMIC_RELAXED);
+
+	// From now on, we can run and steal threads
+	cpu->online = true;
+
+	// Manually switch to its execution context holding the
+	// spinlock, which the idle thread releases when it starts
+	printk("scheduler: cpu%lld: transferring control to the idle thread\n", cpu->id);
+	__sched_switch(0, idle);
+	panic("unreachable");
+}
+
+// Takes the next thread of the busiest run queue of another CPU.
+//
+// Returns zero if no other CPU has runnable threads waiting.
+//
+// Must be invoked while holding the spinlock.
+static struct sched_thread *__sched_steal_locked(struct sched_cpu *cpu) {
+	// 1. find the CPU with the most queued threads we can steal
+	struct sched_cpu *busiest = 0;
+	for (size_t id = 0; id < SMP_MAX_CPUS; id++) {
+		struct sched_cpu *other = &cpus[id];
+		if (other == cpu || __sched_cpu_nr_stealable(other) == 0) {
+			continue;
+		}
+		if (busiest == 0 || __sched_cpu_nr_stealable(other) > __sched_cpu_nr_stealable(busiest)) {
+			busiest = other;
+		}
+	}
+	if (busiest == 0) {
+		return 0;
+	}
+
+	// 2. take the thread it would run next
+	struct sched_thread *thread = __sched_cpu_pop_locked(busiest, /* stealing */ true);
+	__sched_class_migrate_locked(thread, busiest, cpu);
+	return thread;
+}
+
+// Puts the thread that was running on the CPU back into the run queues.
+//
+// A runnable thread goes at the tail of its priority bucket, which gives us
+// round-robin among threads with equal priority, or into the fair queue
+// according to its virtual runtime. A SCHED_POLICY_FIFO thread that has been
+// preempted goes at the head of its bucket instead, since FIFO threads run
+// until they block or yield. A deadline thread goes back to the CPU owning
+// its reservation or waits for its next period if it exhausted its budget,
+// and so does any other thread whose process exhausted its CPU quota.
+//
+// Must be invoked while holding the spinlock.
+static void
+__sched_requeue_locked(struct sched_cpu *cpu, struct sched_thread *thread, bool preempted, __duration64_t now_ns) {
+	if (thread->se.policy == SCHED_POLICY_DEADLINE && (thread->se.dl_throttled || thread->dl_cpu != cpu->id)) {
+		__sched_dl_enqueue_locked(thread, 0, now_ns);
+		return;
+	}
+	if (thread->quota_throttled && __sched_quota_park_locked(cpu, thread, now_ns)) {
+		return;
+	}
+	__sched_cpu_push_locked(cpu, thread, preempted ? SCHED_ENQUEUE_PREEMPTED : 0, now_ns);
+}
+
+// Records that a thread is waiting for a CPU since now_ns.
+//
+// The wakeup flag indicates that it was not running before (i.e., it
+// woke up or started), so we measure its wakeup-to-run latency.
+//
+// Must be invoked while holding the spinlock.
+static inline void __sched_stats_queued_locked(struct sched_thread *thread, bool wakeup, __duration64_t now_ns) {
+	thread->queued_ns = now_ns;
+	thread->queued_wakeup = wakeup;
+}
+
+// Returns the latency histogram bucket for the given latency.
+static inline size_t __sched_latency_bucket(__duration64_t latency_ns) {
+	uint64_t usec = latency_ns / CLOCK_NSEC_PER_USEC;
+	size_t bucket = (usec == 0) ? 0 : (size_t)(64 - __builtin_clzll(usec));
+	return (bucket < SCHEDSTAT_LATENCY_BUCKETS) ? bucket : SCHEDSTAT_LATENCY_BUCKETS - 1;
+}
+
+// Updates the accounting when the CPU switches from prev to next at now_ns.
+//
+// Must be invoked while holding the spinlock.
+static void __sched_stats_switch_locked(struct sched_cpu *cpu,
+                                        struct sched_thread *prev,
+                                        struct sched_thread *next,
+                                        bool preempted,
+                                        __duration64_t now_ns) {
+	// 1. count why prev stopped running, unless it continues
+	if (prev != next) {
+		if (preempted && prev->state == SCHED_THREAD_STATE_RUNNABLE) {
+			prev->stats.nr_involuntary++;
+		} else {
+			prev->stats.nr_voluntary++;
+		}
+	}
+
+	// 2. charge next for the time it waited and record the latency of wakeups
+	if (next->queued_ns != 0) {
+		__duration64_t wait_ns = (now_ns > next->queued_ns) ? now_ns - next->queued_ns : 0;
+		next->stats.wait_ns += wait_ns;
+		if (next->queued_wakeup) {
+			uint64_t *bucket = &cpu->latency.buckets[__sched_latency_bucket(wait_ns)];
+			__atomic_store_n(bucket, *bucket + 1, __ATOMIC_RELAXED);
+			if (wait_ns > next->stats.max_latency_ns) {
+				next->stats.max_latency_ns = wait_ns;
+			}
+		}
+		next->queued_ns = 0;
 	}
-}
 
-// Helper function to unlock the spinlock and switch current to next.
-static void __unlock_and_switch_to(struct sched_thread *next) {
-	// 1. Save the previous thread
-	struct sched_thread *prev = current;
+	// 3. remember when and where next last ran
+	next->stats.last_run_ns = now_ns;
+	next->stats.last_cpu = cpu->id;
+}
 
-	// 2. Update current
-	current = next;
+// Function that selects the next thread to run on the given CPU or its idle thread.
+//
+// The preempted flag indicates that the current thread did not voluntarily yield.
+//
+// Must be invoked while holding the spinlock.
+static struct sched_thread *select_runnable(struct sched_cpu *cpu, bool preempted) {
+	// 1. ensure we have a idle thread
+	KERNEL_ASSERT(cpu->idle != 0);
 
-	// 3. Release the spinlock before switching
-	spinlock_release(&lock);
+	// 2. ensure we have a current thread
+	struct sched_thread *current = cpu->current;
+	KERNEL_ASSERT(current != 0);
 
-	// 4. do not perform any context switching if the two threads are equal
-	if (prev == next) {
-		return;
+	// 3. charge the current thread for the CPU time it consumed, telling
+	// the scheduling classes whether it is still runnable.
+	if (current->state != SCHED_THREAD_STATE_RUNNABLE) {
+		cpu->rq.curr = 0;
 	}
+	__duration64_t now_ns = clock_monotonic_ns();
+	__sched_update_current_locked(cpu, now_ns);
 
-	// 5. check for invariant assumed by __sched_switch
-	static_assert(__builtin_offsetof(struct sched_thread, sp) == 0, "sp must be at offset 0");
-
-	// 6. Use MD code to switch context
-	__sched_switch(prev, next);
-}
-
-[[noreturn]] void sched_thread_run(void) {
-	// Manually instantiate the idle thread
-	__thread_id_t ketid = 0;
-	__status_t rc = sched_thread_start(&ketid, __idle_main, /* opaque */ 0, /* flags */ 0);
-	printk("scheduler: created idle thread with ID: %lld\n", ketid);
-	KERNEL_ASSERT(rc == 0);
+	// 4. put the current thread back into the run queue.
+	//
+	// A blocked thread is already linked into its wait queue. The idle
+	// thread is never queued since we only run it as a fallback.
+	if (current != cpu->idle && current->state == SCHED_THREAD_STATE_RUNNABLE) {
+		KERNEL_ASSERT(!__sched_thread_queued(current));
+		__sched_stats_queued_locked(current, /* wakeup */ false, now_ns);
+		__sched_requeue_locked(cpu, current, preempted, now_ns);
+	}
 
-	// Ensure the idle thread is accessible
-	KERNEL_ASSERT(ketid >= 0 && ketid < MAX_THREADS);
-	idle_thread = &threads[ketid];
+	// 5. pick the next thread according to the policies.
+	struct sched_thread *next = __sched_cpu_pop_locked(cpu, /* stealing */ false);
 
-	// Manually set it as the currently running thread
-	printk("scheduler: setting the idle thread as the current thread\n");
-	current = idle_thread;
+	// 6. rather than idling, steal a thread from a busy CPU.
+	if (next == 0) {
+		next = __sched_steal_locked(cpu);
+	}
+	if (next == 0) {
+		next = cpu->idle;
+	}
 
-	// Manually switch to its execution context
-	printk("scheduler: transferring control to the idle thread\n");
-	__sched_switch(0, idle_thread);
-	panic("unreachable");
+	// 7. start accounting the CPU time of the next thread.
+	next->se.exec_start_ns = now_ns;
+	__sched_stats_switch_locked(cpu, current, next, preempted, now_ns);
+	return next;
 }
 
-// Function that selects the next thread to run or the idle thread.
+// Returns whether the given CPU is running its idle thread and has nothing queued.
 //
 // Must be invoked while holding the spinlock.
-static struct sched_thread *select_runnable(void) {
-	// 1. ensure we have a idle thread
-	KERNEL_ASSERT(idle_thread != 0);
+static inline bool __sched_cpu_idle_locked(struct sched_cpu *cpu) {
+	return cpu->online && cpu->current == cpu->idle && __sched_cpu_nr_queued(cpu) == 0;
+}
 
-	// 2. ensure we have a current thread
-	KERNEL_ASSERT(current != 0);
+static bool __sched_check_preempt_locked(struct sched_cpu *cpu, struct sched_thread *thread) {
+	// 1. the idle thread looks for work on its own
+	struct sched_thread *curr = cpu->current;
+	if (curr == 0 || curr == cpu->idle) {
+		return false;
+	}
 
-	// 3. grab the list of events and clear it
-	sched_channels_t channels = events;
-	events = 0;
+	// 2. a thread of a more important class always preempts, otherwise
+	// the class compares using up-to-date budgets and virtual runtimes
+	__sched_update_current_locked(cpu, clock_monotonic_ns());
+	bool preempt = sched_rq_wakeup_preempt(&cpu->rq, &curr->se, &thread->se);
+	if (preempt) {
+		__atomic_store_n(&cpu->need_sched, 1, __ATOMIC_RELEASE);
+	}
+	return preempt;
+}
 
-	// 4. Switch to a runnable thread using a ~fair round-robin scheduling.
-	//
-	// Algorithm: Round-robin through all thread slots using fair_id as cursor.
-	// The fair_id wraps around ensuring each thread gets considered in turn.
-	// Event-driven wakeup: blocked threads are awakened when their waited-for
-	// events (channels) occur, using bitwise AND between blockedby and events.
-	for (size_t idx = 0; idx < SCHED_MAX_THREADS; idx++) {
-		// 4.1. get the next thread we should consider for running.
-		struct sched_thread *next = &threads[fair_id];
-		fair_id = (fair_id == SCHED_MAX_THREADS - 1) ? 0 : fair_id + 1;
-
-		// 4.2. avoid giving CPU time to the idle thread.
-		if (next == idle_thread) {
-			continue;
-		}
+static void __sched_enqueue_locked(struct sched_thread *thread) {
+	// 0. deadline threads only run on the CPU owning their reservation
+	__duration64_t now_ns = clock_monotonic_ns();
+	__sched_stats_queued_locked(thread, /* wakeup */ true, now_ns);
+	if (thread->se.policy == SCHED_POLICY_DEADLINE) {
+		__sched_dl_enqueue_locked(thread, SCHED_ENQUEUE_WAKEUP, now_ns);
+		return;
+	}
 
-		// 4.3. see whether we need to wakeup this specific thread.
-		if (next->state == SCHED_THREAD_STATE_BLOCKED && (next->blockedby & channels) != 0) {
-			next->state = SCHED_THREAD_STATE_RUNNABLE;
-			next->blockedby = 0;
-			/* FALLTHROUGH */
-		}
+	// 1. a thread whose process exhausted its CPU quota waits for the next period
+	if (thread->quota_throttled && __sched_quota_park_locked(&cpus[thread->cpu], thread, now_ns)) {
+		return;
+	}
 
-		// 4.4. skip threads that are not marked as runnable.
-		if (next->state != SCHED_THREAD_STATE_RUNNABLE) {
-			continue;
+	// 2. prefer the previous CPU, then any idle CPU
+	struct sched_cpu *prev = &cpus[thread->cpu];
+	struct sched_cpu *target = prev;
+	for (size_t id = 0; id < SMP_MAX_CPUS && !__sched_cpu_idle_locked(target); id++) {
+		if (__sched_cpu_idle_locked(&cpus[id])) {
+			target = &cpus[id];
 		}
+	}
+
+	// 3. let the class move the thread to the target run queue (e.g., fair
+	// threads keep their lag relative to the target virtual clock)
+	__sched_class_migrate_locked(thread, prev, target);
 
-		// 4.5. return the candidate.
-		return next;
+	// 4. queue the thread, which gives a bounded credit to fair
+	// threads that have been sleeping, and let the CPU know
+	thread->cpu = target->id;
+	__sched_cpu_push_locked(target, thread, SCHED_ENQUEUE_WAKEUP, now_ns);
+	bool preempt = __sched_check_preempt_locked(target, thread);
+	__sched_cpu_notify_locked(target, preempt && __sched_thread_is_rt(thread));
+}
+
+// Makes a blocked thread runnable again.
+//
+// Must be invoked while holding the spinlock.
+static void __sched_thread_wakeup_locked(struct sched_thread *thread) {
+	KERNEL_ASSERT(thread->state == SCHED_THREAD_STATE_BLOCKED);
+	list_remove(&thread->se.rqnode);
+	thread->waitingon = 0;
+	thread->state = SCHED_THREAD_STATE_RUNNABLE;
+	__sched_enqueue_locked(thread);
+}
+
+// Wakes up at most count threads waiting on the given wait queue.
+//
+// Must be invoked while holding the spinlock.
+static size_t __sched_waitqueue_wake_locked(struct sched_waitqueue *wq, size_t count) {
+	// Bump the generation so concurrent waiters do not suspend
+	__atomic_store_n(&wq->generation, wq->generation + 1, __ATOMIC_RELEASE);
+
+	// Move the waiters to the run queue in FIFO order
+	size_t woken = 0;
+	for (; woken < count && !list_empty(&wq->waiters); woken++) {
+		struct list_node *node = list_front(&wq->waiters);
+		__sched_thread_wakeup_locked(list_entry(node, struct sched_thread, se.rqnode));
 	}
+	return woken;
+}
 
-	// 5. if we end up here, we return the idle thread.
-	return idle_thread;
+static void __sched_thread_timeout(void *opaque) {
+	// The thread may have been woken up already, in which case it
+	// is going to cancel this timer, so there is nothing to do.
+	struct sched_thread *thread = opaque;
+	uint64_t flags = __sched_lock();
+	if (thread->state == SCHED_THREAD_STATE_BLOCKED) {
+		__sched_thread_wakeup_locked(thread);
+	}
+	__sched_unlock(flags);
 }
 
-static inline void __sched_thread_yield(void) {
+static inline void __sched_thread_yield(bool preempted) {
 	// 1. Acquire the spinlock to prevent anyone else with messing with threads.
 	spinlock_acquire(&lock);
 
 	// 2. obtain the next thread we should run
-	struct sched_thread *next = select_runnable();
+	struct sched_cpu *cpu = __sched_this_cpu();
+	struct sched_thread *next = select_runnable(cpu, preempted);
 
 	// 3. ensure it is not NULL
 	KERNEL_ASSERT(next != 0);
 
 	// 4. perform the context switch proper
-	__unlock_and_switch_to(next);
+	__switch_to_and_unlock(cpu, next);
 }
 
 void sched_thread_yield(void) {
@@ -397,7 +1736,7 @@ void sched_thread_yield(void) {
 	local_irq_disable();
 
 	// Perform the actual switch
-	__sched_thread_yield();
+	__sched_thread_yield(/* preempted */ false);
 
 	// Re-enable interrupts when done
 	local_irq_enable();
@@ -406,118 +1745,231 @@ void sched_thread_yield(void) {
 [[noreturn]] void sched_thread_exit(void *retval) {
 	// 0. make sure the current invariant holds otherwise someone is
 	// calling sched_thread_exit before we have threads
+	struct sched_thread *current = __sched_current();
 	KERNEL_ASSERT(current != 0);
 
-	// 1. ensure no-one can modify the threads state
+	// 1. ensure no-one can modify the threads state, including freeing
+	// our memory and stack, until we have switched to another thread
+	local_irq_disable();
 	spinlock_acquire(&lock);
 
 	// 2. set the return value
 	current->retval = retval;
 
-	// 3. mark the thread as zombie or exited
+	// 3. release the CPU reservation of a deadline thread
+	if (current->se.policy == SCHED_POLICY_DEADLINE) {
+		__sched_dl_release_locked(current);
+	}
+
+	// 4. our exited children remain joinable by ID only
+	while (list_pop_front(&current->zombies) != 0) {
+		// nothing
+	}
+
+	// 5. mark the thread as zombie, waking up only the thread joining
+	// it or the parent, or let the next thread free it
+	struct sched_cpu *cpu = __sched_this_cpu();
 	if ((current->flags & SCHED_THREAD_FLAG_JOINABLE) != 0) {
 		current->state = SCHED_THREAD_STATE_EXITED;
-		events |= __SCHED_THREAD_WAIT_THREAD; // publish announcement
+		struct sched_thread *parent = __sched_thread_parent_locked(current);
+		if (parent != 0) {
+			list_push_back(&parent->zombies, &current->zombienode);
+		}
+		if (current->joiner != 0) {
+			__sched_waitqueue_wake_locked(&current->joiner->joinwq, SIZE_MAX);
+		} else if (parent != 0) {
+			__sched_waitqueue_wake_locked(&parent->joinwq, SIZE_MAX);
+		}
 	} else {
 		current->state = SCHED_THREAD_STATE_UNUSED;
+		__sched_thread_unregister_locked(current);
+		KERNEL_ASSERT(cpu->dead == 0);
+		cpu->dead = current;
 	}
 
-	// 4. allow others to access the thread
-	spinlock_release(&lock);
-
-	// 5. transfer the control to another thread
-	sched_thread_yield();
+	// 6. transfer the control to another thread, which releases the spinlock
+	__switch_to_and_unlock(cpu, select_runnable(cpu, /* preempted */ false));
 
-	// 6. ensure that we don't arrive here
+	// 7. ensure that we don't arrive here
 	panic("thread resumed execution after terminating");
 }
 
-__status_t sched_thread_join(__thread_id_t tid, void **retvalptr) {
-	KERNEL_ASSERT(current != 0);
+// Collects the return value of an exited joinable thread and reaps it.
+//
+// Must be invoked while holding the spinlock. Since lock-free lookups
+// may still reach the thread, free it using __sched_thread_free_deferred
+// after releasing the spinlock.
+static void __sched_thread_reap_locked(struct sched_thread *other, void **retvalptr) {
+	KERNEL_ASSERT(other->state == SCHED_THREAD_STATE_EXITED);
+	if (retvalptr != 0) {
+		*retvalptr = other->retval; // transfer ownership
+	}
+	other->state = SCHED_THREAD_STATE_UNUSED; // make a short funeral
+	if (list_linked(&other->zombienode)) {
+		list_remove(&other->zombienode);
+	}
+	struct sched_thread *parent = __sched_thread_parent_locked(other);
+	if (parent != 0) {
+		KERNEL_ASSERT(parent->nr_children > 0);
+		parent->nr_children--;
+	}
+	__sched_thread_unregister_locked(other);
+}
 
-	// Just avoid wasting time with out of bound thread IDs
-	if (tid < 0 || tid >= SCHED_MAX_THREADS) {
-		return -EINVAL;
+// Suspends the current thread on its join wait queue until a thread it
+// is joining exits or the deadline expires, releasing the spinlock while
+// waiting and acquiring it again before returning.
+//
+// Returns the interrupt state to pass to __sched_unlock.
+static uint64_t __sched_thread_join_wait(struct sched_thread *current, uint64_t flags, __duration64_t deadline_ns) {
+	// We read the generation while holding the lock so we cannot miss
+	// the exit, and the wait queue is ours, so it remains valid even
+	// if someone else reaps the thread we're joining meanwhile
+	uint64_t gen = current->joinwq.generation;
+	__sched_unlock(flags);
+	if (deadline_ns == UINT64_MAX) {
+		sched_waitqueue_wait(&current->joinwq, gen);
+	} else {
+		(void)sched_waitqueue_wait_deadline(&current->joinwq, gen, deadline_ns);
 	}
+	return __sched_lock();
+}
+
+__status_t sched_thread_join(__thread_id_t tid, void **retvalptr) {
+	return sched_thread_join_deadline(tid, retvalptr, UINT64_MAX);
+}
+
+__status_t sched_thread_join_deadline(__thread_id_t tid, void **retvalptr, __duration64_t deadline_ns) {
+	struct sched_thread *current = __sched_current();
+	KERNEL_ASSERT(current != 0);
 
 	// OK, let's bite the spinlock
-	spinlock_acquire(&lock);
+	uint64_t flags = __sched_lock();
 
-	__duration64_t oepoch = 0;
 	for (;;) {
 
 		// Join algorithm handles several race conditions:
 		//
-		// 1. Epoch tracking: Detects if target thread exited and slot was recycled
-		//    while we were sleeping (oepoch != other->epoch indicates recycling)
+		// 1. Lookup: Thread IDs are never reused, so we look up the thread
+		//    again after each wakeup, which detects whether someone else
+		//    has already joined the thread and freed it
 		//
-		// 2. Broadcast wakeup: We wait for ANY thread termination, not just target
-		//    (scales poorly but avoids complex per-thread wait queues)
+		// 2. Targeted wakeup: We register as the thread's joiner, so that
+		//    its exit only wakes us up, and we wait on our own wait queue,
+		//    which remains valid regardless of what happens to the thread
 		//
 		// 3. State transitions: RUNNABLE/BLOCKED -> wait, EXITED -> collect and cleanup,
-		//    UNUSED -> target never existed or was detached
+		//    not found -> target never existed or was detached
 		//
 		// 4. Detach race: Thread can detach itself (become non-joinable) while we wait
+		//
+		// 5. Timeout race: If the thread exits after the deadline expired
+		//    but before we acquire the spinlock again, the exit wins
 
 		// Do not assume the thread state is stable
 		// for example pthread_detach(self) can cause
 		// a thread that was awaitable to vanish
-		struct sched_thread *other = &threads[tid];
+		struct sched_thread *other = __sched_thread_find(tid);
+		if (other == 0 || other == current) {
+			__sched_unlock(flags);
+			return -EINVAL;
+		}
 		bool isjoinable = (other->flags & SCHED_THREAD_FLAG_JOINABLE) != 0;
-		oepoch = (oepoch == 0) ? other->epoch : oepoch;
 		switch (other->state) {
 
 		// Continue waiting for a blocked/running awaitable thread
 		case SCHED_THREAD_STATE_BLOCKED:
 		case SCHED_THREAD_STATE_RUNNABLE:
-			if (!isjoinable) {
-				spinlock_release(&lock);
+			// As for pthread_join, only a single thread can join a thread
+			if (!isjoinable || (other->joiner != 0 && other->joiner != current)) {
+				__sched_unlock(flags);
 				return -EINVAL;
 			}
 
-			// Await for *any* thread to terminate.
-			//
-			// Yeah, it does not scale well, but we need to start
-			// from something simple don't we?
-			spinlock_release(&lock);
-			sched_thread_suspend(__SCHED_THREAD_WAIT_THREAD);
-			spinlock_acquire(&lock);
-
-			// Detect *sad* cases in which we have slept so much or
-			// there was reaping contention and the actual thread
-			// we were tracking already sleeps with the fishes
-			if (oepoch != other->epoch) {
-				spinlock_release(&lock);
-				return -EINVAL;
+			// Give up once the deadline expires, unregistering as the joiner
+			if (deadline_ns != UINT64_MAX && clock_monotonic_ns() >= deadline_ns) {
+				other->joiner = 0;
+				__sched_unlock(flags);
+				return -ETIMEDOUT;
 			}
+
+			// Await for *this* thread to terminate.
+			other->joiner = current;
+			flags = __sched_thread_join_wait(current, flags, deadline_ns);
 			continue;
 
-		// OK, this is the case where we have fun
+		// OK, this is the case where we have fun. Holding the spinlock
+		// means the thread has completed switching away from its stack.
 		case SCHED_THREAD_STATE_EXITED:
-			KERNEL_ASSERT(isjoinable);                // must be the case
-			*retvalptr = other->retval;               // transfer ownership
-			other->state = SCHED_THREAD_STATE_UNUSED; // make a short funeral
-			spinlock_release(&lock);
+			KERNEL_ASSERT(isjoinable); // must be the case
+			__sched_thread_reap_locked(other, retvalptr);
+			__sched_unlock(flags);
+			__sched_thread_free_deferred(other);
 			return 0;
 
 		// Maybe it detached itself and exited WTF
 		default:
-			spinlock_release(&lock);
+			__sched_unlock(flags);
 			return -EINVAL;
 		}
 	}
 }
 
+__status_t sched_thread_join_any(__thread_id_t *tid, void **retvalptr, __duration64_t deadline_ns) {
+	struct sched_thread *current = __sched_current();
+	KERNEL_ASSERT(current != 0 && tid != 0);
+	*tid = 0;
+
+	uint64_t flags = __sched_lock();
+	for (;;) {
+		// 1. collect the first exited child nobody is joining, since the
+		// threads that are joining the others are going to collect them
+		for (struct list_node *node = current->zombies.next; node != &current->zombies; node = node->next) {
+			struct sched_thread *other = list_entry(node, struct sched_thread, zombienode);
+			if (other->joiner != 0) {
+				continue;
+			}
+			*tid = other->id;
+			__sched_thread_reap_locked(other, retvalptr);
+			__sched_unlock(flags);
+			__sched_thread_free_deferred(other);
+			return 0;
+		}
+
+		// 2. bail if there is nothing to wait for or the deadline expired
+		if (current->nr_children == 0) {
+			__sched_unlock(flags);
+			return -ECHILD;
+		}
+		if (deadline_ns != UINT64_MAX && clock_monotonic_ns() >= deadline_ns) {
+			__sched_unlock(flags);
+			return -ETIMEDOUT;
+		}
+
+		// 3. wait for a child nobody is joining to exit
+		flags = __sched_thread_join_wait(current, flags, deadline_ns);
+	}
+}
+
 [[noreturn]] void sched_return_to_user(uintptr_t raw_frame) {
 	// Ensure we have current
+	struct sched_thread *current = __sched_current();
 	KERNEL_ASSERT(current != 0);
 
 	// Save the raw frame of the thread we're going to suspend
 	current->trapframe = raw_frame;
 
+	// Charge a process with a CPU quota for the time it ran since the
+	// last clock interrupt, which asks to reschedule if it exhausted it
+	if (__sched_quota_process(current) != 0) {
+		uint64_t flags = __sched_lock();
+		__sched_update_current_locked(__sched_this_cpu(), clock_monotonic_ns());
+		__sched_unlock(flags);
+	}
+
 	// Check whether we should reschedule and switch if it's needed
 	if (__sched_should_reschedule()) {
-		__sched_thread_yield();
+		__sched_thread_yield(/* preempted */ true);
 	}
 
 	// Ensure we still have current
@@ -535,32 +1987,469 @@ __status_t sched_thread_join(__thread_id_t tid, void **retvalptr) {
 	__builtin_unreachable();
 }
 
-void sched_thread_maybe_yield(void) {
-	if (__sched_should_reschedule()) {
-		sched_thread_yield();
+// Returns the thread with the given ID, or zero if the thread does not
+// exist or is an idle thread, whose scheduling parameters are fixed.
+//
+// Must be invoked while holding the spinlock or within an RCU
+// read-side critical section.
+static struct sched_thread *__sched_thread_lookup(__thread_id_t tid) {
+	struct sched_thread *thread = __sched_thread_find(tid);
+	if (thread == 0 || thread->state == SCHED_THREAD_STATE_UNUSED || __sched_thread_is_idle(thread)) {
+		return 0;
 	}
+	return thread;
 }
 
-void sched_thread_suspend(sched_channels_t channels) {
-	KERNEL_ASSERT(current != 0);
-	current->state = SCHED_THREAD_STATE_BLOCKED;
-	current->blockedby = channels;
-	sched_thread_yield();
+__status_t sched_thread_set_priority(__thread_id_t tid, size_t prio) {
+	// Reject out of range values
+	if (prio >= SCHED_PRIO_LEVELS) {
+		return -EINVAL;
+	}
+
+	uint64_t flags = __sched_lock();
+	struct sched_thread *thread = __sched_thread_lookup(tid);
+	if (thread == 0) {
+		__sched_unlock(flags);
+		return -ESRCH;
+	}
+
+	// Requeue at the new priority if the thread is waiting to run
+	bool queued = __sched_thread_queued(thread);
+	struct sched_cpu *cpu = &cpus[thread->cpu];
+	if (queued) {
+		__sched_cpu_remove_locked(cpu, thread);
+	}
+	thread->se.prio = prio;
+	if (queued) {
+		__sched_cpu_push_locked(cpu, thread, 0, clock_monotonic_ns());
+	}
+	__sched_unlock(flags);
+	return 0;
 }
 
-void sched_thread_resume_all(sched_channels_t channels) {
-	spinlock_acquire(&lock);
-	events |= channels;
-	spinlock_release(&lock);
+__status_t sched_thread_set_policy(__thread_id_t tid, uint32_t policy) {
+	// Reject unknown policies and require a reservation for deadline threads
+	if (policy != SCHED_POLICY_RR && policy != SCHED_POLICY_FAIR && policy != SCHED_POLICY_FIFO) {
+		return -EINVAL;
+	}
+
+	uint64_t flags = __sched_lock();
+	struct sched_thread *thread = __sched_thread_lookup(tid);
+	if (thread == 0) {
+		__sched_unlock(flags);
+		return -ESRCH;
+	}
+
+	// Move the thread to the right queue if it is waiting to run
+	bool queued = __sched_thread_queued(thread);
+	struct sched_cpu *cpu = &cpus[thread->cpu];
+	if (queued) {
+		__sched_cpu_remove_locked(cpu, thread);
+	}
+
+	// A thread leaving the deadline policy releases its reservation
+	if (thread->se.policy == SCHED_POLICY_DEADLINE && __sched_dl_release_locked(thread)) {
+		queued = true;
+	}
+
+	// A thread joining another class starts according to its rules
+	// (e.g., a thread joining the fair policy starts at the virtual clock)
+	__duration64_t now_ns = clock_monotonic_ns();
+	if (policy != thread->se.policy) {
+		thread->se.policy = policy;
+		__sched_class_attach_locked(cpu, thread, now_ns);
+	}
+	if (queued) {
+		__sched_cpu_push_locked(cpu, thread, 0, now_ns);
+	}
+	__sched_unlock(flags);
+	return 0;
 }
 
-void __sched_thread_sleep(__duration64_t jiffies) {
-	__duration64_t start = __sched_jiffies(__ATOMIC_RELAXED);
-	for (;;) {
-		sched_thread_suspend(SCHED_THREAD_WAIT_TIMER);
-		__duration64_t current = __sched_jiffies(__ATOMIC_RELAXED);
-		if (current - start >= jiffies) {
-			return;
+__status_t sched_thread_set_deadline(__thread_id_t tid, const struct sched_deadline_params *params) {
+	// 1. reject invalid reservations
+	KERNEL_ASSERT(params != 0);
+	if (params->runtime_ns == 0 || params->runtime_ns > params->deadline_ns ||
+	    params->deadline_ns > params->period_ns || params->period_ns > SCHED_DEADLINE_PERIOD_MAX) {
+		return -EINVAL;
+	}
+	uint64_t bw = (params->runtime_ns << SCHED_DL_BW_SHIFT) / params->period_ns;
+
+	uint64_t flags = __sched_lock();
+	struct sched_thread *thread = __sched_thread_lookup(tid);
+	if (thread == 0) {
+		__sched_unlock(flags);
+		return -ESRCH;
+	}
+
+	// 2. admission control: choose the least loaded CPU that can accommodate
+	// the reservation, not counting the thread's own previous reservation
+	struct sched_cpu *target = 0;
+	uint64_t target_bw = 0;
+	for (size_t id = 0; id < SMP_MAX_CPUS; id++) {
+		struct sched_cpu *cpu = &cpus[id];
+		if (!cpu->online) {
+			continue;
+		}
+		uint64_t cpu_bw = cpu->dl_bw;
+		if (thread->se.policy == SCHED_POLICY_DEADLINE && thread->dl_cpu == id) {
+			cpu_bw -= thread->dl_bw;
+		}
+		if (cpu_bw + bw > SCHED_DL_BW_LIMIT) {
+			continue;
+		}
+		if (target == 0 || cpu_bw < target_bw) {
+			target = cpu;
+			target_bw = cpu_bw;
+		}
+	}
+	if (target == 0) {
+		__sched_unlock(flags);
+		return -EBUSY;
+	}
+
+	// 3. charge a running thread under its previous policy and take a
+	// waiting thread out of the queues of its previous policy
+	__duration64_t now_ns = clock_monotonic_ns();
+	struct sched_cpu *cpu = &cpus[thread->cpu];
+	if (cpu->current == thread) {
+		__sched_update_current_locked(cpu, now_ns);
+	}
+	bool queued = __sched_thread_queued(thread);
+	if (queued) {
+		__sched_cpu_remove_locked(cpu, thread);
+	}
+	if (thread->se.policy == SCHED_POLICY_DEADLINE && __sched_dl_release_locked(thread)) {
+		queued = true;
+	}
+
+	// The reservation exempts the thread from the CPU quota of its process
+	// and the deadline queues use the node of the quota throttled queue
+	if (__sched_quota_unpark_locked(thread)) {
+		queued = true;
+	}
+
+	// 4. install the reservation, whose class starts a new period now
+	thread->se.policy = SCHED_POLICY_DEADLINE;
+	thread->dl_params = *params;
+	thread->se.dl_params = &thread->dl_params;
+	thread->dl_bw = bw;
+	thread->dl_cpu = target->id;
+	target->dl_bw += bw;
+	__sched_class_attach_locked(target, thread, now_ns);
+
+	// 5. queue a waiting thread on its new CPU, while a thread running
+	// on another CPU migrates as soon as it reschedules
+	if (queued) {
+		__sched_dl_enqueue_locked(thread, 0, now_ns);
+	} else if (cpu->current == thread && cpu != target) {
+		__atomic_store_n(&cpu->need_sched, 1, __ATOMIC_RELEASE);
+		__sched_cpu_notify_locked(cpu, /* force */ true);
+	} else if (cpu->current == thread) {
+		__sched_cpu_arm_locked(cpu, now_ns + thread->dl_params.runtime_ns);
+	}
+	__sched_unlock(flags);
+	return 0;
+}
+
+__status_t sched_thread_set_nice(__thread_id_t tid, int32_t nice) {
+	// Reject out of range values
+	if (nice < SCHED_NICE_MIN || nice > SCHED_NICE_MAX) {
+		return -EINVAL;
+	}
+
+	uint64_t flags = __sched_lock();
+	struct sched_thread *thread = __sched_thread_lookup(tid);
+	if (thread == 0) {
+		__sched_unlock(flags);
+		return -ESRCH;
+	}
+
+	// Charge a running thread at its old weight before changing it. The fair
+	// queue is ordered by virtual runtime, so queued threads stay where they are.
+	struct sched_cpu *cpu = &cpus[thread->cpu];
+	if (cpu->current == thread) {
+		__sched_update_current_locked(cpu, clock_monotonic_ns());
+	}
+	thread->nice = nice;
+	thread->se.weight = sched_fair_weight(nice);
+	__sched_unlock(flags);
+	return 0;
+}
+
+__status_t sched_thread_get_nice(__thread_id_t tid, int32_t *nice) {
+	KERNEL_ASSERT(nice != 0);
+	rcu_read_lock();
+	struct sched_thread *thread = __sched_thread_lookup(tid);
+	if (thread == 0) {
+		rcu_read_unlock();
+		return -ESRCH;
+	}
+	*nice = __atomic_load_n(&thread->nice, __ATOMIC_RELAXED);
+	rcu_read_unlock();
+	return 0;
+}
+
+__status_t sched_process_set_quota(__thread_id_t tid, const struct cpuquota *quota) {
+	// 1. reject invalid limits
+	KERNEL_ASSERT(quota != 0);
+	if (quota->quota_ns != 0 && (quota->quota_ns > quota->period_ns || quota->period_ns < CPUQUOTA_PERIOD_MIN ||
+	                             quota->period_ns > CPUQUOTA_PERIOD_MAX)) {
+		return -EINVAL;
+	}
+
+	uint64_t flags = __sched_lock();
+	struct sched_thread *thread = __sched_thread_lookup(tid);
+	if (thread == 0 || thread->__proc == 0) {
+		__sched_unlock(flags);
+		return -ESRCH;
+	}
+
+	// 2. charge a running thread under the previous limit and
+	// take a throttled thread out of the quota throttled queue
+	__duration64_t now_ns = clock_monotonic_ns();
+	struct sched_cpu *cpu = &cpus[thread->cpu];
+	if (cpu->current == thread) {
+		__sched_update_current_locked(cpu, now_ns);
+	}
+	bool parked = __sched_quota_unpark_locked(thread);
+
+	// 3. install the limit starting a new period now
+	struct sched_process *proc = thread->__proc;
+	proc->quota_ns = quota->quota_ns;
+	proc->quota_period_ns = (quota->quota_ns != 0) ? quota->period_ns : 0;
+	__sched_quota_new_period(proc, now_ns);
+
+	// 4. queue a throttled thread again, or make sure the clock
+	// interrupt of its CPU enforces the new limit of a running thread
+	if (parked) {
+		__sched_cpu_push_locked(cpu, thread, 0, now_ns);
+		__sched_cpu_notify_locked(cpu, __sched_check_preempt_locked(cpu, thread));
+	} else if (cpu->current == thread && __sched_quota_process(thread) != 0) {
+		__sched_cpu_arm_locked(cpu, now_ns + quota->quota_ns);
+	}
+	__sched_unlock(flags);
+	return 0;
+}
+
+__status_t sched_process_get_quota(__thread_id_t tid, struct cpuquota *quota) {
+	KERNEL_ASSERT(quota != 0);
+	*quota = (struct cpuquota){};
+	uint64_t flags = __sched_lock();
+	struct sched_thread *thread = __sched_thread_lookup(tid);
+	if (thread == 0 || thread->__proc == 0) {
+		__sched_unlock(flags);
+		return -ESRCH;
+	}
+	quota->quota_ns = thread->__proc->quota_ns;
+	quota->period_ns = thread->__proc->quota_period_ns;
+	__sched_unlock(flags);
+	return 0;
+}
+
+__status_t sched_thread_get_stats(__thread_id_t tid, struct schedstat_thread *stats) {
+	KERNEL_ASSERT(stats != 0);
+	*stats = (struct schedstat_thread){};
+	uint64_t flags = __sched_lock();
+	struct sched_thread *thread = __sched_thread_lookup(tid);
+	if (thread == 0) {
+		__sched_unlock(flags);
+		return -ESRCH;
+	}
+
+	// Include the CPU time the thread consumed since we last charged it
+	struct sched_cpu *cpu = &cpus[thread->cpu];
+	if (cpu->current == thread) {
+		__sched_update_current_locked(cpu, clock_monotonic_ns());
+	}
+	*stats = thread->stats;
+	__sched_unlock(flags);
+	return 0;
+}
+
+void sched_latency_histogram(struct schedstat_latency *hist) {
+	KERNEL_ASSERT(hist != 0);
+	*hist = (struct schedstat_latency){};
+
+	// Like sched_fpu_stats, we sum the per-CPU buckets without
+	// taking the spinlock, since they only grow
+	for (size_t id = 0; id < SMP_MAX_CPUS; id++) {
+		for (size_t idx = 0; idx < SCHEDSTAT_LATENCY_BUCKETS; idx++) {
+			hist->buckets[idx] += __atomic_load_n(&cpus[id].latency.buckets[idx], __ATOMIC_RELAXED);
+		}
+	}
+}
+
+__status_t sched_thread_stack_usage(__thread_id_t tid, size_t *usage) {
+	KERNEL_ASSERT(usage != 0);
+	*usage = 0;
+	rcu_read_lock();
+	struct sched_thread *thread = __sched_thread_lookup(tid);
+	if (thread == 0) {
+		rcu_read_unlock();
+		return -ESRCH;
+	}
+	*usage = __sched_stack_usage(thread->stack);
+	rcu_read_unlock();
+	return 0;
+}
+
+size_t sched_stack_max_usage(void) {
+	return __atomic_load_n(&stack_max_usage, __ATOMIC_RELAXED);
+}
+
+size_t sched_stack_size(void) {
+	return SCHED_THREAD_STACK_SIZE;
+}
+
+bool sched_thread_stack_overflowed(uintptr_t addr) {
+	// We may be on a CPU that has not started scheduling yet
+	struct sched_cpu *cpu = __sched_this_cpu();
+	if (cpu == 0 || cpu->current == 0) {
+		return false;
+	}
+	struct sched_thread *current = cpu->current;
+	uintptr_t guard = (uintptr_t)current->stack - SCHED_THREAD_GUARD_PAGES * PAGE_SIZE;
+	return addr >= guard && addr < (uintptr_t)current->stack;
+}
+
+__thread_id_t sched_thread_self(void) {
+	KERNEL_ASSERT(__sched_current() != 0);
+	return __sched_current()->id;
+}
+
+__thread_id_t sched_thread_current_id(void) {
+	// We may be on a CPU that has not started scheduling yet
+	uint64_t flags = local_irq_save();
+	struct sched_cpu *cpu = __sched_this_cpu();
+	__thread_id_t tid = (cpu != 0 && cpu->current != 0) ? cpu->current->id : 0;
+	local_irq_restore(flags);
+	return tid;
+}
+
+bool sched_thread_running(__thread_id_t tid) {
+	for (size_t id = 0; id < SMP_MAX_CPUS; id++) {
+		if (__atomic_load_n(&cpus[id].current_tid, __ATOMIC_RELAXED) == tid) {
+			return true;
 		}
 	}
+	return false;
+}
+
+// Switches to another thread if this CPU should reschedule and preemption is enabled.
+//
+// Must be invoked with interrupts disabled.
+static inline void __sched_preempt(void) {
+	if (smp_this_cpu()->preempt_count == 0 && __sched_should_reschedule()) {
+		__sched_thread_yield(/* preempted */ true);
+	}
+}
+
+void __preempt_schedule(void) {
+	// We check the flag with interrupts disabled, so that we do
+	// not migrate and consume the flag of another CPU
+	local_irq_disable();
+	__sched_preempt();
+	local_irq_enable();
+}
+
+void sched_preempt_irq(void) {
+	// An interrupt that arrived while preemption was enabled
+	// cannot have interrupted a read-side critical section
+	if (smp_this_cpu()->preempt_count == 0) {
+		rcu_quiescent_state();
+	}
+
+	// We switch on the stack of the interrupted thread, which resumes
+	// returning from the interrupt when we switch back to it
+	__sched_preempt();
+}
+
+void sched_thread_maybe_yield(void) {
+	__preempt_schedule();
+}
+
+// Suspends the current thread on the wait queue until it is woken up
+// or the monotonic clock reaches the given deadline.
+static void __sched_waitqueue_wait(struct sched_waitqueue *wq, uint64_t generation, __duration64_t deadline_ns) {
+	// 1. disable interrupts and acquire the spinlock so that no-one
+	// can wake up the queue while we're linking ourselves into it
+	local_irq_disable();
+	spinlock_acquire(&lock);
+
+	// 2. make sure we are not called before we have threads or by the
+	// idle thread, which must always remain runnable.
+	struct sched_cpu *cpu = __sched_this_cpu();
+	struct sched_thread *current = cpu->current;
+	KERNEL_ASSERT(current != 0 && current != cpu->idle);
+
+	// 3. bail if someone woke up the queue after the caller prepared or
+	// if the deadline has expired. The timers run only after the monotonic
+	// clock reaches their deadline, so checking here under the spinlock
+	// ensures we cannot miss a timeout that expired before we linked ourselves.
+	if (wq->generation != generation || clock_monotonic_ns() >= deadline_ns) {
+		spinlock_release(&lock);
+		local_irq_enable();
+		return;
+	}
+
+	// 4. link the current thread into the wait queue
+	current->state = SCHED_THREAD_STATE_BLOCKED;
+	current->waitingon = wq;
+	list_push_back(&wq->waiters, &current->se.rqnode);
+
+	// 5. transfer the control to another thread
+	__switch_to_and_unlock(cpu, select_runnable(cpu, /* preempted */ false));
+
+	// 6. re-enable interrupts when we've been woken up
+	local_irq_enable();
+}
+
+void sched_waitqueue_wait(struct sched_waitqueue *wq, uint64_t generation) {
+	__sched_waitqueue_wait(wq, generation, UINT64_MAX);
+}
+
+__status_t sched_waitqueue_wait_deadline(struct sched_waitqueue *wq, uint64_t generation, __duration64_t deadline_ns) {
+	// 1. make sure we are not called before we have threads
+	struct sched_thread *current = __sched_current();
+	KERNEL_ASSERT(current != 0 && !__sched_thread_is_idle(current));
+
+	// 2. arm the timer that wakes us up when the deadline expires
+	sched_hrtimer_start(&current->timeout, deadline_ns);
+
+	// 3. wait for either the wakeup or the timeout
+	__sched_waitqueue_wait(wq, generation, deadline_ns);
+
+	// 4. disarm the timer in case someone else woke us up, making sure
+	// its callback is not using the thread, which may exit and be freed
+	sched_hrtimer_cancel_sync(&current->timeout);
+
+	// 5. tell the caller whether the deadline expired
+	return (clock_monotonic_ns() >= deadline_ns) ? -ETIMEDOUT : 0;
+}
+
+size_t sched_waitqueue_wake_one(struct sched_waitqueue *wq) {
+	uint64_t flags = __sched_lock();
+	size_t woken = __sched_waitqueue_wake_locked(wq, 1);
+	__sched_unlock(flags);
+	return woken;
+}
+
+size_t sched_waitqueue_wake_all(struct sched_waitqueue *wq) {
+	uint64_t flags = __sched_lock();
+	size_t woken = __sched_waitqueue_wake_locked(wq, SIZE_MAX);
+	__sched_unlock(flags);
+	return woken;
+}
+
+void sched_thread_nanosleep(__duration64_t nanosec) {
+	// Nobody wakes up this queue, so only our own timeout
+	// timer causes us to resume execution.
+	struct sched_waitqueue wq;
+	sched_waitqueue_init(&wq);
+	__duration64_t now = clock_monotonic_ns();
+	__duration64_t deadline = (nanosec < UINT64_MAX - now) ? now + nanosec : UINT64_MAX;
+	while (sched_waitqueue_wait_deadline(&wq, 0, deadline) == 0) {
+		// spurious wakeup
+	}
 }
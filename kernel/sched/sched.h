@@ -4,14 +4,22 @@
 #ifndef KERNEL_SCHED_SCHED_H
 #define KERNEL_SCHED_SCHED_H
 
-#include <kernel/exec/load.h> // for struct load_program
+#include <kernel/exec/load.h>      // for struct load_program
+#include <kernel/sched/runqueue.h> // for SCHED_RUNQUEUE_NPRIO
 
-#include <sys/cdefs.h> // for __BEGIN_DECLS
-#include <sys/param.h> // for HZ
-#include <sys/types.h> // for __status_t
+#include <sys/cdefs.h>     // for __BEGIN_DECLS
+#include <sys/cpuquota.h>  // for struct cpuquota
+#include <sys/param.h>     // for HZ
+#include <sys/schedstat.h> // for struct schedstat_thread
+#include <sys/types.h>     // for __status_t
 
 __BEGIN_DECLS
 
+// Initialize the scheduler data structures.
+//
+// Called by the boot subsystem before creating any thread.
+void sched_init_early(void) __NOEXCEPT;
+
 // Interrupt service routine for the scheduler clock.
 //
 // Called from the generic IRQ handler.
@@ -20,6 +28,12 @@ __BEGIN_DECLS
 // perform all the related scheduler bookkeping.
 void sched_clock_isr(void) __NOEXCEPT;
 
+// Interrupt service routine for the reschedule IPI.
+//
+// Called from the generic IRQ handler when another CPU
+// queued a thread for this CPU or armed a timer.
+void sched_ipi_isr(void) __NOEXCEPT;
+
 // Initialize the timer to interrupt every HZ.
 //
 // Called by the IRQ subsystem.
@@ -33,6 +47,9 @@ void sched_clock_init_irqs(void) __NOEXCEPT;
 // The thread is attached to a user process instance.
 #define SCHED_THREAD_FLAG_PROCESS (1 << 1)
 
+// The thread starts with the SCHED_POLICY_FIFO policy and the default priority.
+#define SCHED_THREAD_FLAG_FIFO (1 << 2)
+
 // The type of the main function implementing a kernel thread.
 typedef void(sched_thread_main_t)(void *opaque);
 
@@ -43,7 +60,8 @@ typedef void(sched_thread_main_t)(void *opaque);
 // You SHOULD transfer ownership of `opaque` to the thread.
 //
 // The zero flags create a detached thread. The SCHED_THREAD_FLAG_JOINABLE flag
-// creates a thread that you must explicitly join.
+// creates a thread that you must explicitly join. The SCHED_THREAD_FLAG_FIFO
+// flag creates a real-time thread that preempts all the normal threads.
 //
 // Returns a negative errno value on failure and zero on success.
 //
@@ -90,20 +108,250 @@ void sched_thread_yield(void) __NOEXCEPT;
 // Waits for the given thread to terminate.
 //
 // Fails immediately returning `-EINVAL` if the given thread ID is
-// invalid or the thread is actually not joinable.
+// invalid, the thread is actually not joinable, or another thread
+// is already joining it.
 //
 // In all other cases, the current thread is suspended until the
-// thread with the given ID calls sched_pthread_exit.
+// thread with the given ID calls sched_pthread_exit, which only
+// wakes up the thread joining it.
 //
 // When the current thread resumes, it collects the retval, of which
-// it takes memory ownership, and the other thread is reaped, while
-// sched_thread_join returns `0` to its caller.
+// it takes memory ownership unless retvalptr is zero, and the other
+// thread is reaped, while sched_thread_join returns `0` to its caller.
 //
 // When the other thread has already terminated, this function may
 // potentially sleep awaiting for the notification depending on what
 // happens inside the scheduler and within the IRQs.
 __status_t sched_thread_join(__thread_id_t tid, void **retvalptr) __NOEXCEPT;
 
+// Like sched_thread_join but gives up waiting when the monotonic
+// clock (see clock_monotonic_ns) reaches the given deadline.
+//
+// Returns `-ETIMEDOUT` if the deadline has expired, in which case the
+// thread remains joinable. UINT64_MAX means waiting without a deadline.
+__status_t sched_thread_join_deadline(__thread_id_t tid, void **retvalptr, __duration64_t deadline_ns) __NOEXCEPT;
+
+// Waits for any joinable thread started by the current thread to
+// terminate and reaps it, except for the threads that someone is
+// joining using sched_thread_join.
+//
+// On success, returns `0` and sets *tid to the ID of the thread we
+// reaped and *retvalptr (unless zero) to its retval, as for sched_thread_join.
+//
+// Returns `-ECHILD` if the current thread has no joinable thread left
+// to join, and `-ETIMEDOUT` if the monotonic clock reaches the given
+// deadline. UINT64_MAX means waiting without a deadline.
+//
+// The *tid return argument must be nonnull.
+__status_t sched_thread_join_any(__thread_id_t *tid, void **retvalptr, __duration64_t deadline_ns) __NOEXCEPT;
+
+// Number of thread priority levels.
+#define SCHED_PRIO_LEVELS SCHED_RUNQUEUE_NPRIO
+
+// The highest thread priority.
+#define SCHED_PRIO_MAX 0
+
+// The lowest thread priority.
+#define SCHED_PRIO_MIN (SCHED_PRIO_LEVELS - 1)
+
+// The priority assigned to newly created threads.
+#define SCHED_PRIO_DEFAULT (SCHED_PRIO_LEVELS / 2)
+
+// Sets the priority of the given thread.
+//
+// Lower values mean higher priority. Runnable threads with higher priority
+// always run before runnable threads with lower priority, while threads
+// with equal priority share the CPU in round-robin order.
+//
+// The priority only matters for threads using SCHED_POLICY_FIFO and SCHED_POLICY_RR.
+//
+// Returns `-EINVAL` if the priority is out of range, `-ESRCH` if the
+// thread does not exist, and zero on success.
+__status_t sched_thread_set_priority(__thread_id_t tid, size_t prio) __NOEXCEPT;
+
+// Policy running threads in priority order and round-robin among equal priorities.
+//
+// Runnable threads using this policy always run before SCHED_POLICY_FAIR threads.
+#define SCHED_POLICY_RR 0
+
+// Policy sharing the CPU among threads in proportion to their nice-derived weight.
+//
+// The scheduler tracks the CPU time each thread consumed, scaled by the inverse
+// of its weight (i.e., the virtual runtime), and runs the thread that lags behind
+// the most. Threads waking up after sleeping are placed slightly ahead of the
+// others, so interactive threads preempt CPU-bound ones.
+#define SCHED_POLICY_FAIR 1
+
+// Real-time policy running threads in priority order until they block or yield.
+//
+// Runnable threads using this policy always run before SCHED_POLICY_RR and
+// SCHED_POLICY_FAIR threads and are not time sliced, so a thread preempted
+// by a more important thread resumes before its peers with equal priority.
+#define SCHED_POLICY_FIFO 2
+
+// Real-time policy running the thread with the earliest absolute deadline.
+//
+// Each thread reserves a CPU budget within each period (see the
+// sched_thread_set_deadline function), which is also the only way to
+// select this policy. Runnable threads using this policy run before
+// all the other threads, unless they have exhausted their budget, in
+// which case they wait for the next period (i.e., they are throttled).
+#define SCHED_POLICY_DEADLINE 3
+
+// The policy assigned to newly created threads.
+//
+// Define it to SCHED_POLICY_RR when building to compare the two policies.
+#ifndef SCHED_POLICY_DEFAULT
+#define SCHED_POLICY_DEFAULT SCHED_POLICY_FAIR
+#endif
+
+// Sets the scheduling policy of the given thread.
+//
+// Leaving SCHED_POLICY_DEADLINE releases the thread's reservation.
+//
+// Returns `-EINVAL` if the policy is unknown or is SCHED_POLICY_DEADLINE,
+// `-ESRCH` if the thread does not exist, and zero on success.
+__status_t sched_thread_set_policy(__thread_id_t tid, uint32_t policy) __NOEXCEPT;
+
+// The CPU reservation of a SCHED_POLICY_DEADLINE thread.
+//
+// Every period_ns, the thread may consume runtime_ns of CPU time, which
+// the scheduler guarantees to provide within deadline_ns from the start
+// of the period, provided that the thread is runnable.
+struct sched_deadline_params {
+	__duration64_t runtime_ns;
+	__duration64_t deadline_ns;
+	__duration64_t period_ns;
+};
+
+// The longest period of a SCHED_POLICY_DEADLINE thread.
+#define SCHED_DEADLINE_PERIOD_MAX (1ULL << 40)
+
+// Switches the given thread to SCHED_POLICY_DEADLINE with the given reservation.
+//
+// We perform admission control by assigning the thread to the least loaded
+// CPU whose reserved utilization remains below a fixed bound, and the thread
+// only runs there from then on, so that the reservations of each CPU are
+// guaranteed by the earliest-deadline-first ordering.
+//
+// Returns `-EINVAL` unless 0 < runtime_ns <= deadline_ns <= period_ns <=
+// SCHED_DEADLINE_PERIOD_MAX, `-ESRCH` if the thread does not exist, `-EBUSY`
+// if no CPU can accommodate the reservation, and zero on success.
+__status_t sched_thread_set_deadline(__thread_id_t tid, const struct sched_deadline_params *params) __NOEXCEPT;
+
+// The nice value giving a thread the largest CPU share.
+#define SCHED_NICE_MIN (-20)
+
+// The nice value giving a thread the smallest CPU share.
+#define SCHED_NICE_MAX 19
+
+// The nice value assigned to newly created threads.
+#define SCHED_NICE_DEFAULT 0
+
+// Sets the nice value of the given thread.
+//
+// Each nice level changes the CPU share of a SCHED_POLICY_FAIR thread
+// by roughly 10% relative to a thread with the default nice value.
+//
+// Returns `-EINVAL` if nice is out of range, `-ESRCH` if the
+// thread does not exist, and zero on success.
+__status_t sched_thread_set_nice(__thread_id_t tid, int32_t nice) __NOEXCEPT;
+
+// Gets the nice value of the given thread.
+//
+// Returns `-ESRCH` if the thread does not exist and zero on success.
+__status_t sched_thread_get_nice(__thread_id_t tid, int32_t *nice) __NOEXCEPT;
+
+// Sets the CPU bandwidth limit of the user process whose thread has the given ID.
+//
+// The threads of a process that exhausts its quota do not run until its next
+// period begins, which the clock interrupt of the CPU on which they ran
+// enforces. SCHED_POLICY_DEADLINE threads are exempt, since their reservation
+// already bounds their CPU time.
+//
+// Returns `-EINVAL` if the limit is invalid (see `./include/sys/cpuquota.h`),
+// `-ESRCH` if the thread does not exist or is not a user process, and zero
+// on success.
+__status_t sched_process_set_quota(__thread_id_t tid, const struct cpuquota *quota) __NOEXCEPT;
+
+// Gets the CPU bandwidth limit of the user process whose thread has the given ID.
+//
+// Returns `-ESRCH` if the thread does not exist or is not a user
+// process and zero on success.
+__status_t sched_process_get_quota(__thread_id_t tid, struct cpuquota *quota) __NOEXCEPT;
+
+// Gets the scheduler accounting of the given thread.
+//
+// Returns `-ESRCH` if the thread does not exist and zero on success.
+__status_t sched_thread_get_stats(__thread_id_t tid, struct schedstat_thread *stats) __NOEXCEPT;
+
+// Gets the wakeup-to-run latency histogram summed over all the CPUs.
+//
+// We update the histogram when switching to a thread that woke up or
+// started, so it includes the time spent selecting and switching.
+void sched_latency_histogram(struct schedstat_latency *hist) __NOEXCEPT;
+
+// Gets how many bytes of its kernel stack the given thread has used so far.
+//
+// We fill the unused part of the stacks with a known pattern and look for
+// the deepest word that does not contain it, so this is a high-water mark.
+//
+// Returns `-ESRCH` if the thread does not exist and zero on success.
+__status_t sched_thread_stack_usage(__thread_id_t tid, size_t *usage) __NOEXCEPT;
+
+// Returns the deepest usage in bytes of the kernel stacks of the threads that
+// have exited so far, which, along with sched_stack_size, tells us whether
+// we can safely shrink the kernel stacks.
+size_t sched_stack_max_usage(void) __NOEXCEPT;
+
+// Returns the size in bytes of the kernel stack of each thread.
+size_t sched_stack_size(void) __NOEXCEPT;
+
+// Returns whether addr belongs to the guard pages below the kernel
+// stack of the current thread, which means the stack has overflowed.
+//
+// Called by the trap subsystem when handling fatal kernel exceptions.
+bool sched_thread_stack_overflowed(uintptr_t addr) __NOEXCEPT;
+
+// Counters describing how often we switched the user FP/SIMD state.
+struct sched_fpu_stats {
+	// Number of times we saved the state of a thread we switched away from.
+	uint64_t saves;
+
+	// Number of times we did not need to save the state when switching
+	// away from a thread, since it did not use FP/SIMD in its time slice.
+	uint64_t saves_avoided;
+
+	// Number of times we loaded the state of a thread using FP/SIMD.
+	uint64_t restores;
+
+	// Number of times we switched to a thread whose state was still loaded.
+	uint64_t restores_avoided;
+};
+
+// Gets the FP/SIMD switching counters summed over all the CPUs.
+void sched_fpu_stats(struct sched_fpu_stats *stats) __NOEXCEPT;
+
+// Loads the FP/SIMD state of the current thread and allows it to use FP/SIMD.
+//
+// Called by the trap subsystem with interrupts disabled when a user
+// thread uses FP/SIMD for the first time during its time slice.
+void sched_fpu_trap(void) __NOEXCEPT;
+
+// Returns the ID of the current thread.
+__thread_id_t sched_thread_self(void) __NOEXCEPT;
+
+// Like sched_thread_self but returns zero when this CPU is not running
+// threads yet (e.g., during early boot), rather than panicking.
+__thread_id_t sched_thread_current_id(void) __NOEXCEPT;
+
+// Returns whether the given thread is running on some CPU.
+//
+// We do not hold the spinlock, so the result may already be stale when
+// we return and callers should use it only as a hint (e.g., to decide
+// whether to spin waiting for the thread to release a lock).
+bool sched_thread_running(__thread_id_t tid) __NOEXCEPT;
+
 // Opaque representation of a kernel thread.
 struct sched_thread;
 
@@ -120,9 +368,10 @@ __status_t sched_current_process_page_table(struct vm_root_pt *table) __NOEXCEPT
 //
 // The control will constantly switch between runnable threads.
 //
-// Called by the late boot process.
+// Called by the late boot process of each CPU, which creates the
+// CPU idle thread and starts running and stealing threads.
 //
-// Make sure this function is called just once.
+// Make sure this function is called just once per CPU.
 [[noreturn]] void sched_thread_run(void) __NOEXCEPT;
 
 // Return to userspace possibly switching to another process.
@@ -139,17 +388,26 @@ __status_t sched_current_process_page_table(struct vm_root_pt *table) __NOEXCEPT
 // from userspace from such a context.
 [[noreturn]] void sched_return_to_user(uintptr_t raw_frame) __NOEXCEPT;
 
+// Switches to another thread when returning from an interrupt that asked
+// this CPU to reschedule, unless the interrupted code disabled preemption
+// (see `./kernel/core/preempt.h`), which makes the kernel preemptible.
+//
+// Called by the trap subsystem with interrupts disabled after handling
+// an interrupt, regardless of whether we interrupted user or kernel code.
+void sched_preempt_irq(void) __NOEXCEPT;
+
 // Call this function from kernel threads to ensure that the scheduler
 // has a chance to schedule another process when needed.
 //
 // The general idea is that the clock ticker sets an atomic flag
 // indicating the need to reschedule and device interrupt handlers
 // may also set the same or similar flags indicating that someone
-// needs to wakeup to perform some action. However, especially when
-// servicing interrupts at kernel level, it is not viable to run
-// the scheduler directly. Instead, by sprinkling our kernel threads
-// code with invocations of this function, we naturally provide the
-// ability to change the kernel focus and do other stuff.
+// needs to wakeup to perform some action. The kernel is preemptible,
+// so we already switch when returning from such interrupts (see
+// sched_preempt_irq) unless the interrupted code holds a spinlock,
+// in which case we switch when it releases the last spinlock. This
+// function is still useful to switch as soon as possible in code
+// that has been running with interrupts disabled.
 //
 // The rule of thumb of using this function is the following:
 //
@@ -171,75 +429,31 @@ __status_t sched_current_process_page_table(struct vm_root_pt *table) __NOEXCEPT
 // as cooperative synchronization points.
 void sched_thread_maybe_yield(void) __NOEXCEPT;
 
-// The thread is waiting for the UART to become readable.
-#define SCHED_THREAD_WAIT_UART_READABLE (1 << 0)
-
-// The thread is waiting for the UART to become writable.
-#define SCHED_THREAD_WAIT_UART_WRITABLE (1 << 1)
-
-// The thread is waiting on a timeer to expire.
-#define SCHED_THREAD_WAIT_TIMER (1 << 2)
-
-// The thread is waiting on another thread to terminate.
-//
-// Used by the scheduler internals.
-//
-// Do not use outside of this subsystem.
-#define __SCHED_THREAD_WAIT_THREAD (1 << 3)
-
-// Type representing channels on which a kernel thread may suspend.
-//
-// This type is 64-bit wide regardless of the word size so that, with the current
-// bitmask, approach, we can model at least 64 event sources.
-typedef uint64_t sched_channels_t;
-
-// This function suspends the current thread until one of the
-// given channels (e.g., SCHED_THREAD_WAIT_UART_READABLE) becomes
-// available. Channels are a bitmask of possible event sources.
-//
-// This function MUST be called whenever it would be safe to
-// call the sched_thread_maybe_yield function.
-void sched_thread_suspend(sched_channels_t channels) __NOEXCEPT;
-
-// This function updates the bitmask of events occurred since
-// the last scheduler invocation. The next cooperative multitasking
-// point inside the kernel will unblock all the threads blocked by
-// the events accumulated inside the bitmask and clear it.
-//
-// Upon scheduling, the threads will run again. Spurious wakeups
-// are possible. Therefore, a thread will need to check whether the
-// condition it was blocked on was satisfied or not. If not, the
-// thread should suspend itself again.
+// Returns the number of clock ticks since the system has booted.
 //
-// This function is typically called from interrupt context.
-void sched_thread_resume_all(sched_channels_t channels) __NOEXCEPT;
-
-// Put the given thread to sleep for the given amount of jiffies.
-//
-// Safe to call whenever you can call sched_thread_suspend.
-//
-// Has a private-like name because usually you want to use higher-level APIs.
-void __sched_thread_sleep(__duration64_t jiffies) __NOEXCEPT;
+// Safe to call from any context.
+__duration64_t sched_jiffies(void) __NOEXCEPT;
 
 // Put the current thread to sleep for the given amount of nanoseconds.
 //
-// Safe to call whenever you can call sched_thread_suspend.
-static inline void sched_thread_nanosleep(__duration64_t nanosec) __NOEXCEPT {
-	return __sched_thread_sleep((nanosec * HZ) / (1000 * 1000 * 1000));
-}
+// The thread resumes with the resolution of the hardware counter rather
+// than with jiffy granularity (see clock_monotonic_ns).
+//
+// Safe to call whenever you can call sched_waitqueue_wait.
+void sched_thread_nanosleep(__duration64_t nanosec) __NOEXCEPT;
 
 // Put the current thread to sleep for the given amount of milliseconds.
 //
-// Safe to call whenever you can call sched_thread_suspend.
+// Safe to call whenever you can call sched_waitqueue_wait.
 static inline void sched_thread_millisleep(__duration64_t millisec) __NOEXCEPT {
-	return __sched_thread_sleep((millisec * HZ) / 1000);
+	return sched_thread_nanosleep(millisec * 1000 * 1000);
 }
 
 // Put the current thread to sleep for the given amount of seconds.
 //
-// Safe to call whenever you can call sched_thread_suspend.
+// Safe to call whenever you can call sched_waitqueue_wait.
 static inline void sched_thread_sleep(__duration64_t sec) __NOEXCEPT {
-	return __sched_thread_sleep(sec * HZ);
+	return sched_thread_nanosleep(sec * 1000 * 1000 * 1000);
 }
 
 __END_DECLS
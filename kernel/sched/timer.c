@@ -0,0 +1,341 @@
+// File: kernel/sched/timer.c
+// Purpose: hierarchical timer wheel for one-shot kernel timers.
+// SPDX-License-Identifier: MIT
+
+#include <kernel/asm/asm.h>       // for cpu_relax
+#include <kernel/clock/clock.h>   // for CLOCK_NSEC_PER_JIFFY
+#include <kernel/core/assert.h>   // for KERNEL_ASSERT
+#include <kernel/core/list.h>     // for struct list_node
+#include <kernel/core/softirq.h>  // for softirq_register
+#include <kernel/core/spinlock.h> // for struct spinlock
+#include <kernel/sched/timer.h>   // the subsystem's API
+
+#include <sys/types.h> // for __duration64_t
+
+// Number of bits of the expiration jiffy consumed by each level.
+#define TIMER_WHEEL_BITS 6
+
+// Number of slots in each level.
+//
+// This value MUST be equal to the number of bits in the occupancy bitmap.
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+
+// Mask to extract a slot index.
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SLOTS - 1)
+
+// Number of levels in the wheel.
+//
+// Level L has a granularity of 64^L jiffies, so with HZ=100 the four levels
+// cover ~0.6 s, ~41 s, ~44 min and ~1.9 days respectively. Timers further
+// in the future are parked in the last level and cascaded again later.
+#define TIMER_WHEEL_LEVELS 4
+
+// The number of jiffies covered by the first n levels.
+#define TIMER_WHEEL_SPAN(n) (1ULL << ((n) * TIMER_WHEEL_BITS))
+
+// Hierarchical timer wheel.
+//
+// Each level is an array of slots containing timers in no particular order.
+// Level 0 has one slot per jiffy. A slot of level L > 0 contains the timers
+// expiring within the corresponding 64^L-jiffies window, which we move
+// ("cascade") to the lower levels when the clock enters such a window. Each
+// timer is thus touched at most once per level, and a clock tick only visits
+// the slot of level 0 for the current jiffy, plus, once every 64 jiffies,
+// the slot that needs to cascade.
+struct timer_wheel {
+	// The first jiffy we have not processed yet.
+	__duration64_t clock;
+
+	// Number of pending timers.
+	size_t nr_pending;
+
+	// For each level, bit N is set iff slots[level][N] is not empty.
+	uint64_t occupied[TIMER_WHEEL_LEVELS];
+
+	// The slots containing the pending timers.
+	struct list_node slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+};
+
+// The timer wheel driven by the scheduler clock.
+static struct timer_wheel wheel;
+
+// Spinlock protecting the wheel and the timers it contains.
+static struct spinlock lock = SPINLOCK_INITIALIZER;
+
+// The timer whose callback is running or zero.
+static struct sched_timer *running;
+
+// Acquires the spinlock from any context disabling interrupts.
+//
+// Returns the interrupt state to pass to __timer_unlock.
+static inline uint64_t __timer_lock(void) {
+	return spinlock_acquire_irqsave(&lock);
+}
+
+// Releases the spinlock and restores the interrupt state.
+static inline void __timer_unlock(uint64_t flags) {
+	spinlock_release_irqrestore(&lock, flags);
+}
+
+// Expires the timers that are due in the SOFTIRQ_TIMER softirq.
+static void __sched_timer_softirq(void) {
+	__sched_timer_run(clock_jiffies());
+}
+
+void __sched_timer_init_early(void) {
+	softirq_register(SOFTIRQ_TIMER, __sched_timer_softirq);
+	for (size_t level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		for (size_t slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+			list_init(&wheel.slots[level][slot]);
+		}
+	}
+}
+
+void sched_timer_init(struct sched_timer *timer, sched_timer_func_t *func, void *opaque) {
+	KERNEL_ASSERT(timer != 0 && func != 0);
+	list_init(&timer->node);
+	timer->expires = 0;
+	timer->func = func;
+	timer->opaque = opaque;
+}
+
+// Returns the slot of the given level containing the given jiffy.
+static inline size_t __timer_slot(__duration64_t when, size_t level) {
+	return (size_t)((when >> (level * TIMER_WHEEL_BITS)) & TIMER_WHEEL_MASK);
+}
+
+// Links the timer into the slot corresponding to its deadline.
+//
+// Must be invoked while holding the spinlock.
+static void __timer_enqueue_locked(struct sched_timer *timer) {
+	// 1. deadlines in the past expire when processing the current jiffy
+	__duration64_t when = timer->expires;
+	if (when < wheel.clock) {
+		when = wheel.clock;
+	}
+
+	// 2. park deadlines beyond the wheel range in the last level
+	__duration64_t delta = when - wheel.clock;
+	if (delta >= TIMER_WHEEL_SPAN(TIMER_WHEEL_LEVELS)) {
+		when = wheel.clock + TIMER_WHEEL_SPAN(TIMER_WHEEL_LEVELS) - 1;
+		delta = when - wheel.clock;
+	}
+
+	// 3. the level is the smallest one whose range includes delta
+	size_t level = 0;
+	while (delta >= TIMER_WHEEL_SPAN(level + 1)) {
+		level++;
+	}
+
+	// 4. link into the slot and mark it as occupied
+	size_t slot = __timer_slot(when, level);
+	list_push_back(&wheel.slots[level][slot], &timer->node);
+	wheel.occupied[level] |= (1ULL << slot);
+	wheel.nr_pending++;
+}
+
+// Unlinks a pending timer from its slot.
+//
+// Must be invoked while holding the spinlock.
+static void __timer_dequeue_locked(struct sched_timer *timer) {
+	// Removing makes the node self-linked, so check whether the
+	// list head is now self-linked by looking at the neighbour
+	struct list_node *next = timer->node.next;
+	list_remove(&timer->node);
+	wheel.nr_pending--;
+
+	// Clear the occupancy bit if we emptied a slot
+	if (!list_empty(next)) {
+		return;
+	}
+	for (size_t level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		struct list_node *base = &wheel.slots[level][0];
+		if (next >= base && next < base + TIMER_WHEEL_SLOTS) {
+			wheel.occupied[level] &= ~(1ULL << (size_t)(next - base));
+			return;
+		}
+	}
+}
+
+void sched_timer_start(struct sched_timer *timer, __duration64_t expires) {
+	KERNEL_ASSERT(timer != 0 && timer->func != 0);
+	uint64_t flags = __timer_lock();
+	if (list_linked(&timer->node)) {
+		__timer_dequeue_locked(timer);
+	}
+	timer->expires = expires;
+	__timer_enqueue_locked(timer);
+	__timer_unlock(flags);
+
+	// The clock interrupt may be stopped or programmed for later
+	__duration64_t limit = UINT64_MAX / CLOCK_NSEC_PER_JIFFY;
+	__sched_clock_timer_armed((expires < limit) ? expires * CLOCK_NSEC_PER_JIFFY : UINT64_MAX);
+}
+
+bool sched_timer_cancel(struct sched_timer *timer) {
+	KERNEL_ASSERT(timer != 0);
+	uint64_t flags = __timer_lock();
+	bool pending = list_linked(&timer->node);
+	if (pending) {
+		__timer_dequeue_locked(timer);
+	}
+	__timer_unlock(flags);
+	return pending;
+}
+
+bool sched_timer_cancel_sync(struct sched_timer *timer) {
+	KERNEL_ASSERT(timer != 0);
+	for (;;) {
+		uint64_t flags = __timer_lock();
+		bool pending = list_linked(&timer->node);
+		if (pending) {
+			__timer_dequeue_locked(timer);
+		}
+		bool busy = (running == timer);
+		__timer_unlock(flags);
+		if (!busy) {
+			return pending;
+		}
+		// The callback is running in the softirq of another CPU, which
+		// could only be ours if we were in interrupt context, since the
+		// softirq runs with preemption disabled
+		cpu_relax();
+	}
+}
+
+// Moves the timers in the given slot to the given list.
+//
+// The timers remain pending, so that sched_timer_cancel can still
+// unlink them from the destination list.
+//
+// Must be invoked while holding the spinlock.
+static void __timer_splice_locked(size_t level, size_t slot, struct list_node *dest) {
+	struct list_node *head = &wheel.slots[level][slot];
+	while (!list_empty(head)) {
+		list_push_back(dest, list_pop_front(head));
+	}
+	wheel.occupied[level] &= ~(1ULL << slot);
+}
+
+// Redistributes the timers of the slot of the given level that
+// corresponds to the current jiffy into the lower levels.
+//
+// Returns whether the current jiffy is also the start of a window
+// of the next level, which therefore needs to cascade as well.
+//
+// Must be invoked while holding the spinlock.
+static bool __timer_cascade_locked(size_t level) {
+	// 1. detach the slot so that timers that map again to the same
+	// slot (because they are exactly 64^(L+1) jiffies away) do not
+	// cause us to loop forever
+	struct list_node pending = LIST_INITIALIZER(pending);
+	size_t slot = __timer_slot(wheel.clock, level);
+	__timer_splice_locked(level, slot, &pending);
+
+	// 2. re-insert each timer according to its actual deadline
+	while (!list_empty(&pending)) {
+		struct list_node *node = list_pop_front(&pending);
+		wheel.nr_pending--;
+		__timer_enqueue_locked(list_entry(node, struct sched_timer, node));
+	}
+	return slot == 0;
+}
+
+// Returns the first window of the given level that starts at or after
+// the wheel clock. A window of level L is 64^L jiffies wide.
+//
+// Must be invoked while holding the spinlock.
+static __duration64_t __timer_next_window_locked(size_t level) {
+	size_t shift = level * TIMER_WHEEL_BITS;
+	__duration64_t window = wheel.clock >> shift;
+	if ((window << shift) != wheel.clock) {
+		window++;
+	}
+	return window;
+}
+
+// Returns the first jiffy at or after the wheel clock at which a level has
+// timers to expire or to cascade, or UINT64_MAX when no timer is pending.
+//
+// Must be invoked while holding the spinlock.
+static __duration64_t __timer_next_expiry_locked(void) {
+	__duration64_t next = UINT64_MAX;
+	for (size_t level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+		// 1. skip levels without timers
+		uint64_t bitmap = wheel.occupied[level];
+		if (bitmap == 0) {
+			continue;
+		}
+
+		// 2. rotate the bitmap so bit 0 corresponds to the next window we
+		// will process, hence the first set bit is the closest window with
+		// timers, which is the earliest time at which this level has work
+		__duration64_t window = __timer_next_window_locked(level);
+		size_t first = (size_t)(window & TIMER_WHEEL_MASK);
+		uint64_t rotated = (bitmap >> first) | (first != 0 ? bitmap << (TIMER_WHEEL_SLOTS - first) : 0);
+		window += (__duration64_t)__builtin_ctzll(rotated);
+
+		// 3. convert the window back to jiffies
+		__duration64_t deadline = window << (level * TIMER_WHEEL_BITS);
+		if (deadline < next) {
+			next = deadline;
+		}
+	}
+	return next;
+}
+
+void __sched_timer_run(__duration64_t now) {
+	struct list_node expired = LIST_INITIALIZER(expired);
+	uint64_t flags = __timer_lock();
+
+	// 1. process each jiffy up to and including now
+	while (wheel.clock <= now) {
+		// 1.1. nothing to do if there are no timers
+		if (wheel.nr_pending == 0) {
+			wheel.clock = now + 1;
+			break;
+		}
+
+		// 1.2. cascade the higher levels when entering their windows
+		if (__timer_slot(wheel.clock, 0) == 0) {
+			for (size_t level = 1; level < TIMER_WHEEL_LEVELS && __timer_cascade_locked(level); level++) {
+				// nothing
+			}
+		}
+
+		// 1.3. collect the timers expiring at this jiffy
+		__timer_splice_locked(0, __timer_slot(wheel.clock, 0), &expired);
+		wheel.clock++;
+
+		// 1.4. jump to the next jiffy with timers to expire or cascade,
+		// since the slots in between are empty, so that the cost of catching
+		// up after a long tickless sleep tracks the number of occupied slots
+		// rather than the number of elapsed jiffies
+		__duration64_t next = __timer_next_expiry_locked();
+		wheel.clock = (next <= now) ? next : now + 1;
+	}
+
+	// 2. invoke the callbacks without holding the spinlock, so that they
+	// can rearm timers or wake up threads. We pop each timer while holding
+	// the lock so that a concurrent cancel either sees it pending and
+	// prevents the callback, or sees it expired.
+	while (!list_empty(&expired)) {
+		struct sched_timer *timer = list_entry(list_pop_front(&expired), struct sched_timer, node);
+		wheel.nr_pending--;
+		sched_timer_func_t *func = timer->func;
+		void *opaque = timer->opaque;
+		running = timer;
+		__timer_unlock(flags);
+		func(opaque);
+		flags = __timer_lock();
+		running = 0;
+	}
+	__timer_unlock(flags);
+}
+
+__duration64_t sched_timer_next_expiry(void) {
+	uint64_t flags = __timer_lock();
+	__duration64_t next = __timer_next_expiry_locked();
+	__timer_unlock(flags);
+	return next;
+}
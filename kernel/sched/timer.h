@@ -0,0 +1,107 @@
+// File: kernel/sched/timer.h
+// Purpose: one-shot kernel timers driven by the scheduler clock.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_SCHED_TIMER_H
+#define KERNEL_SCHED_TIMER_H
+
+#include <kernel/core/list.h> // for struct list_node
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+#include <sys/types.h> // for __duration64_t
+
+__BEGIN_DECLS
+
+// The type of the function invoked when a timer expires.
+typedef void(sched_timer_func_t)(void *opaque);
+
+// One-shot timer expiring at a given jiffy.
+//
+// Timers live inside a hierarchical timer wheel, so arming, cancelling
+// and expiring a timer are constant-time operations and the clock tick
+// only touches the timers that are actually due.
+//
+// Initialize using sched_timer_init.
+//
+// The timer subsystem protects the fields, so do not access them
+// directly and use the functions below.
+struct sched_timer {
+	// Links the timer into its wheel slot.
+	struct list_node node;
+
+	// The absolute jiffy at which the timer expires.
+	__duration64_t expires;
+
+	// The function to invoke when the timer expires.
+	sched_timer_func_t *func;
+
+	// The opaque argument for func.
+	void *opaque;
+};
+
+// Initialize a timer before using it.
+//
+// You retain ownership of opaque.
+void sched_timer_init(struct sched_timer *timer, sched_timer_func_t *func, void *opaque) __NOEXCEPT;
+
+// Arms the timer to expire at the given absolute jiffy.
+//
+// If the timer is already pending, it is re-armed with the new deadline. If
+// the deadline is in the past, the timer expires at the next clock tick.
+//
+// The timer function runs in the SOFTIRQ_TIMER softirq (see
+// `./kernel/core/softirq.h`), therefore it MUST NOT block.
+//
+// Safe to call from any context.
+void sched_timer_start(struct sched_timer *timer, __duration64_t expires) __NOEXCEPT;
+
+// Disarms the timer.
+//
+// Returns whether the timer was pending. When the return value is false,
+// the timer has already expired, or it was not armed.
+//
+// Safe to call from any context.
+bool sched_timer_cancel(struct sched_timer *timer) __NOEXCEPT;
+
+// Disarms the timer and waits for its callback to complete if it is running.
+//
+// Use this function before freeing the memory the callback uses.
+//
+// Returns whether the timer was pending, like sched_timer_cancel.
+//
+// MUST NOT be called by the callback of the timer itself or from interrupt
+// context, which could have interrupted the softirq running the callback.
+bool sched_timer_cancel_sync(struct sched_timer *timer) __NOEXCEPT;
+
+// Returns the absolute jiffy at which the first pending timer could expire.
+//
+// The returned value may be earlier than the actual expiration, because timers
+// far in the future are only tracked with coarse granularity, but it is never
+// later. Returns UINT64_MAX when no timer is pending.
+__duration64_t sched_timer_next_expiry(void) __NOEXCEPT;
+
+// Notifies the scheduler clock that we armed a timer expiring at the
+// given monotonic time, so that it reprograms the clock if needed.
+//
+// Implemented by the scheduler.
+//
+// Do not use outside of this subsystem.
+void __sched_clock_timer_armed(__duration64_t expires_ns) __NOEXCEPT;
+
+// Initialize the timer wheel.
+//
+// Called by sched_init_early.
+//
+// Do not use outside of this subsystem.
+void __sched_timer_init_early(void) __NOEXCEPT;
+
+// Expires all the timers whose deadline is not after now.
+//
+// Called by the SOFTIRQ_TIMER softirq, which the scheduler
+// clock interrupt handler raises.
+//
+// Do not use outside of this subsystem.
+void __sched_timer_run(__duration64_t now) __NOEXCEPT;
+
+__END_DECLS
+
+#endif // KERNEL_SCHED_TIMER_H
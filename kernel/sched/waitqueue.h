@@ -0,0 +1,104 @@
+// File: kernel/sched/waitqueue.h
+// Purpose: queues of threads waiting for an event.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_SCHED_WAITQUEUE_H
+#define KERNEL_SCHED_WAITQUEUE_H
+
+#include <kernel/core/list.h> // for struct list_node
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+#include <sys/types.h> // for uint64_t
+
+__BEGIN_DECLS
+
+// Queue of threads waiting for an event.
+//
+// The subsystem that generates the event (e.g., a device driver) owns
+// the wait queue and wakes it up when the event occurs. Waking up only
+// touches the threads linked into this specific queue.
+//
+// Initialize using sched_waitqueue_init or SCHED_WAITQUEUE_INITIALIZER.
+//
+// The scheduler spinlock protects the fields, so do not access
+// them directly and use the functions below.
+struct sched_waitqueue {
+	// Threads waiting on this queue in FIFO order.
+	struct list_node waiters;
+
+	// Incremented every time someone wakes up the queue.
+	uint64_t generation;
+};
+
+// Use this macro to statically initialize a wait queue.
+#define SCHED_WAITQUEUE_INITIALIZER(name) {.waiters = LIST_INITIALIZER((name).waiters), .generation = 0}
+
+// Initialize the wait queue before using it.
+static inline void sched_waitqueue_init(struct sched_waitqueue *wq) __NOEXCEPT {
+	list_init(&wq->waiters);
+	wq->generation = 0;
+}
+
+// Returns the current wait queue generation.
+//
+// Call this function *before* checking the condition you want to wait
+// for and pass the result to sched_waitqueue_wait. If a wakeup occurs
+// after you checked the condition but before you actually suspend, then
+// sched_waitqueue_wait returns immediately, so wakeups cannot be lost.
+//
+// The typical usage pattern is:
+//
+//	for (;;) {
+//		uint64_t gen = sched_waitqueue_prepare(&wq);
+//		if (condition()) {
+//			break;
+//		}
+//		sched_waitqueue_wait(&wq, gen);
+//	}
+//
+// Safe to call from any context.
+static inline uint64_t sched_waitqueue_prepare(struct sched_waitqueue *wq) __NOEXCEPT {
+	return __atomic_load_n(&wq->generation, __ATOMIC_ACQUIRE);
+}
+
+// Suspends the current thread on the wait queue.
+//
+// Returns immediately if the queue has been woken up since the
+// sched_waitqueue_prepare call that returned the given generation.
+//
+// Spurious wakeups are possible. Therefore, a thread will need to check
+// whether the condition it was waiting for is satisfied or not. If not,
+// the thread should wait again.
+//
+// This function MUST be called whenever it would be safe to
+// call the sched_thread_maybe_yield function.
+void sched_waitqueue_wait(struct sched_waitqueue *wq, uint64_t generation) __NOEXCEPT;
+
+// Like sched_waitqueue_wait but gives up waiting when the monotonic
+// clock (see clock_monotonic_ns) reaches the given deadline.
+//
+// Returns `-ETIMEDOUT` if the deadline has expired and zero otherwise.
+//
+// Spurious wakeups are possible, as for sched_waitqueue_wait.
+//
+// This function MUST be called whenever it would be safe to
+// call the sched_thread_maybe_yield function.
+__status_t sched_waitqueue_wait_deadline(struct sched_waitqueue *wq, uint64_t generation,
+					 __duration64_t deadline_ns) __NOEXCEPT;
+
+// Wakes up the thread that has been waiting on the queue for longer.
+//
+// Returns the number of threads woken up (i.e., zero or one).
+//
+// Safe to call from interrupt context.
+size_t sched_waitqueue_wake_one(struct sched_waitqueue *wq) __NOEXCEPT;
+
+// Wakes up all the threads waiting on the queue.
+//
+// Returns the number of threads woken up.
+//
+// Safe to call from interrupt context.
+size_t sched_waitqueue_wake_all(struct sched_waitqueue *wq) __NOEXCEPT;
+
+__END_DECLS
+
+#endif // KERNEL_SCHED_WAITQUEUE_H
@@ -0,0 +1,243 @@
+// File: kernel/sched/workqueue.c
+// Purpose: deferred work executed by a pool of kernel worker threads.
+// SPDX-License-Identifier: MIT
+
+#include <kernel/clock/clock.h>     // for clock_jiffies
+#include <kernel/core/assert.h>     // for KERNEL_ASSERT
+#include <kernel/core/list.h>       // for struct list_node
+#include <kernel/core/printk.h>     // for printk
+#include <kernel/core/spinlock.h>   // for struct spinlock
+#include <kernel/sched/sched.h>     // for sched_thread_start
+#include <kernel/sched/timer.h>     // for sched_timer_start
+#include <kernel/sched/waitqueue.h> // for struct sched_waitqueue
+#include <kernel/sched/workqueue.h> // the subsystem's API
+
+#include <sys/errno.h> // for ETIMEDOUT
+#include <sys/types.h> // for size_t
+
+// Number of workers we start initially and never let exit.
+#define WORKQUEUE_MIN_WORKERS 1
+
+// Maximum number of workers, which bounds how many thread slots the
+// workqueue may use, and hence how many work items run concurrently.
+#define WORKQUEUE_MAX_WORKERS 8
+
+// How long an idle worker waits for work before exiting, if another
+// worker is idle and we have more than WORKQUEUE_MIN_WORKERS workers.
+#define WORKQUEUE_IDLE_TIMEOUT_NS 1000000000ULL
+
+// The pool of worker threads and the work items they must run.
+struct workqueue_pool {
+	// Pending work items in FIFO order.
+	struct list_node pending;
+
+	// Number of worker threads, including those we are starting.
+	size_t nr_workers;
+
+	// Number of worker threads waiting for work.
+	size_t nr_idle;
+
+	// Wait queue on which the idle workers wait for work.
+	struct sched_waitqueue idlewq;
+};
+
+// The global pool of worker threads.
+static struct workqueue_pool pool = {
+	.pending = LIST_INITIALIZER(pool.pending),
+	.nr_workers = 0,
+	.nr_idle = 0,
+	.idlewq = SCHED_WAITQUEUE_INITIALIZER(pool.idlewq),
+};
+
+// Spinlock protecting the pool and the work items.
+static struct spinlock lock = SPINLOCK_INITIALIZER;
+
+// Acquires the spinlock from any context disabling interrupts.
+//
+// Returns the interrupt state to pass to __workqueue_unlock.
+static inline uint64_t __workqueue_lock(void) {
+	return spinlock_acquire_irqsave(&lock);
+}
+
+// Releases the spinlock and restores the interrupt state.
+static inline void __workqueue_unlock(uint64_t flags) {
+	spinlock_release_irqrestore(&lock, flags);
+}
+
+// Links the work item into the pending queue and wakes up an idle worker.
+static void __workqueue_enqueue_locked(struct sched_work *work) {
+	list_push_back(&pool.pending, &work->node);
+	if (pool.nr_idle > 0) {
+		sched_waitqueue_wake_one(&pool.idlewq);
+	}
+}
+
+// Main of the worker threads.
+static void __workqueue_worker_main(void *opaque);
+
+// Starts a new worker thread unless we have reached the maximum.
+//
+// We account for the new worker before starting it, so that concurrent
+// callers cannot exceed the maximum, and undo that on failure.
+//
+// Must be invoked holding the spinlock, which we release to start the
+// thread and acquire again before returning, updating *flags.
+static void __workqueue_spawn_locked(uint64_t *flags) {
+	if (pool.nr_workers >= WORKQUEUE_MAX_WORKERS) {
+		return;
+	}
+	pool.nr_workers++;
+	__workqueue_unlock(*flags);
+
+	__thread_id_t tid = 0;
+	__status_t rc = sched_thread_start(&tid, __workqueue_worker_main, 0, 0);
+
+	*flags = __workqueue_lock();
+	if (rc != 0) {
+		printk("workqueue: cannot start worker: %lld\n", rc);
+		pool.nr_workers--;
+	}
+}
+
+static void __workqueue_worker_main(void *opaque) {
+	(void)opaque;
+	uint64_t flags = __workqueue_lock();
+	for (;;) {
+		// 1. if there is work, take the oldest item and run it
+		if (!list_empty(&pool.pending)) {
+			struct sched_work *work = list_entry(list_pop_front(&pool.pending), struct sched_work, node);
+			work->pending = false;
+			sched_work_func_t *func = work->func;
+			void *arg = work->opaque;
+
+			// Keep a worker idle while we are busy, so that the next
+			// work item does not wait for this one to complete
+			if (pool.nr_idle == 0) {
+				__workqueue_spawn_locked(&flags);
+			}
+			__workqueue_unlock(flags);
+
+			// The work item may free itself, so do not touch it
+			func(arg);
+
+			flags = __workqueue_lock();
+			continue;
+		}
+
+		// 2. otherwise, wait for work or for the idle timeout. Holding
+		// the spinlock while preparing ensures that __workqueue_enqueue_locked
+		// wakes us up if it queues work after we checked the queue.
+		pool.nr_idle++;
+		uint64_t gen = sched_waitqueue_prepare(&pool.idlewq);
+		__workqueue_unlock(flags);
+		__duration64_t deadline_ns = clock_monotonic_ns() + WORKQUEUE_IDLE_TIMEOUT_NS;
+		__status_t rc = sched_waitqueue_wait_deadline(&pool.idlewq, gen, deadline_ns);
+		flags = __workqueue_lock();
+		pool.nr_idle--;
+
+		// 3. exit if we have been idle for long enough and another
+		// worker is idle, so that the pool shrinks as load decreases
+		if (rc == -ETIMEDOUT && list_empty(&pool.pending) && pool.nr_idle > 0 &&
+		    pool.nr_workers > WORKQUEUE_MIN_WORKERS) {
+			pool.nr_workers--;
+			__workqueue_unlock(flags);
+			return;
+		}
+	}
+}
+
+bool sched_work_queue(struct sched_work *work) {
+	KERNEL_ASSERT(work != 0 && work->func != 0);
+	uint64_t flags = __workqueue_lock();
+	bool queued = !work->pending;
+	if (queued) {
+		work->pending = true;
+		__workqueue_enqueue_locked(work);
+	}
+	__workqueue_unlock(flags);
+	return queued;
+}
+
+bool sched_work_cancel(struct sched_work *work) {
+	KERNEL_ASSERT(work != 0);
+	uint64_t flags = __workqueue_lock();
+	bool pending = work->pending;
+	if (list_linked(&work->node)) {
+		list_remove(&work->node);
+	}
+	work->pending = false;
+	__workqueue_unlock(flags);
+	return pending;
+}
+
+// Queues the delayed work item when its timer expires.
+//
+// Runs in the SOFTIRQ_TIMER softirq.
+static void __workqueue_delayed_timer(void *opaque) {
+	struct sched_delayed_work *dwork = (struct sched_delayed_work *)opaque;
+	uint64_t flags = __workqueue_lock();
+
+	// Someone may have cancelled and queued the work item again after the
+	// timer expired but before we acquired the spinlock, in which case the
+	// timer is armed again with a later deadline, and we must wait for it.
+	if (dwork->work.pending && !list_linked(&dwork->work.node) && dwork->timer.expires <= clock_jiffies()) {
+		__workqueue_enqueue_locked(&dwork->work);
+	}
+	__workqueue_unlock(flags);
+}
+
+void sched_delayed_work_init(struct sched_delayed_work *dwork, sched_work_func_t *func, void *opaque) {
+	KERNEL_ASSERT(dwork != 0 && func != 0);
+	sched_work_init(&dwork->work, func, opaque);
+	sched_timer_init(&dwork->timer, __workqueue_delayed_timer, dwork);
+}
+
+bool sched_delayed_work_queue(struct sched_delayed_work *dwork, __duration64_t delay) {
+	KERNEL_ASSERT(dwork != 0 && dwork->work.func != 0);
+	uint64_t flags = __workqueue_lock();
+	bool queued = !dwork->work.pending;
+	if (queued) {
+		dwork->work.pending = true;
+		if (delay == 0) {
+			__workqueue_enqueue_locked(&dwork->work);
+		} else {
+			// The timer wheel has its own spinlock, which we always
+			// acquire after ours, and it releases that spinlock
+			// before invoking __workqueue_delayed_timer
+			sched_timer_start(&dwork->timer, clock_jiffies() + delay);
+		}
+	}
+	__workqueue_unlock(flags);
+	return queued;
+}
+
+bool sched_delayed_work_cancel(struct sched_delayed_work *dwork) {
+	// 1. wait for a timer callback that is about to queue the work item,
+	// which needs our spinlock, so we cannot hold it while waiting
+	KERNEL_ASSERT(dwork != 0);
+	(void)sched_timer_cancel_sync(&dwork->timer);
+
+	// 2. unqueue the work item, disarming the timer again in case
+	// someone queued the work item while we were waiting
+	uint64_t flags = __workqueue_lock();
+	(void)sched_timer_cancel(&dwork->timer);
+	bool pending = dwork->work.pending;
+	if (list_linked(&dwork->work.node)) {
+		list_remove(&dwork->work.node);
+	}
+	dwork->work.pending = false;
+	__workqueue_unlock(flags);
+	return pending;
+}
+
+void sched_workqueue_init(void) {
+	uint64_t flags = __workqueue_lock();
+	while (pool.nr_workers < WORKQUEUE_MIN_WORKERS) {
+		size_t before = pool.nr_workers;
+		__workqueue_spawn_locked(&flags);
+		if (pool.nr_workers == before) {
+			break;
+		}
+	}
+	__workqueue_unlock(flags);
+}
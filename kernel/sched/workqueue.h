@@ -0,0 +1,130 @@
+// File: kernel/sched/workqueue.h
+// Purpose: deferred work executed by a pool of kernel worker threads.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_SCHED_WORKQUEUE_H
+#define KERNEL_SCHED_WORKQUEUE_H
+
+#include <kernel/core/list.h>   // for struct list_node
+#include <kernel/sched/timer.h> // for struct sched_timer
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+#include <sys/types.h> // for __duration64_t
+
+__BEGIN_DECLS
+
+// The type of the function invoked to perform a work item.
+typedef void(sched_work_func_t)(void *opaque);
+
+// Work item executed asynchronously by a worker thread.
+//
+// The workqueue runs work items in FIFO order on a pool of worker
+// threads that grows when all the workers are busy, up to a maximum,
+// and shrinks when workers remain idle. Queueing a work item is thus
+// much cheaper than starting a thread, and it cannot fail.
+//
+// Initialize using sched_work_init or SCHED_WORK_INITIALIZER.
+//
+// The workqueue protects the fields, so do not access
+// them directly and use the functions below.
+struct sched_work {
+	// Links the work item into the queue of pending work.
+	struct list_node node;
+
+	// The function to invoke.
+	sched_work_func_t *func;
+
+	// The opaque argument for func.
+	void *opaque;
+
+	// Whether the work item is queued and did not start running yet.
+	bool pending;
+};
+
+// Use this macro to statically initialize a work item.
+#define SCHED_WORK_INITIALIZER(name, fn, arg)                                                                \
+	{.node = LIST_INITIALIZER((name).node), .func = (fn), .opaque = (arg), .pending = false}
+
+// Initialize a work item before using it.
+//
+// You retain ownership of opaque.
+static inline void sched_work_init(struct sched_work *work, sched_work_func_t *func, void *opaque) __NOEXCEPT {
+	list_init(&work->node);
+	work->func = func;
+	work->opaque = opaque;
+	work->pending = false;
+}
+
+// Work item executed by a worker thread after a delay.
+//
+// Initialize using sched_delayed_work_init.
+//
+// The workqueue protects the fields, so do not access
+// them directly and use the functions below.
+struct sched_delayed_work {
+	// The work item to queue when the timer expires.
+	struct sched_work work;
+
+	// The timer delaying the work item.
+	struct sched_timer timer;
+};
+
+// Initialize a delayed work item before using it.
+//
+// You retain ownership of opaque.
+void sched_delayed_work_init(struct sched_delayed_work *dwork, sched_work_func_t *func, void *opaque) __NOEXCEPT;
+
+// Queues the work item for execution by a worker thread.
+//
+// Returns false if the work item was already pending, in which case it
+// is going to run only once. Once a worker starts running the work item,
+// the work item is not pending anymore, hence it can queue itself again.
+//
+// The work item MUST remain valid until it has run or you have
+// cancelled it. The workqueue does not touch the work item after
+// its function returns, so the function may free it.
+//
+// Safe to call from any context.
+bool sched_work_queue(struct sched_work *work) __NOEXCEPT;
+
+// Removes a pending work item from the queue.
+//
+// Returns whether the work item was pending. When the return value is false,
+// the work item has already started running (and may still be running), or
+// it was not queued.
+//
+// Safe to call from any context.
+bool sched_work_cancel(struct sched_work *work) __NOEXCEPT;
+
+// Queues the delayed work item for execution once the given number of
+// jiffies (see `./kernel/clock/clock.h`) have elapsed.
+//
+// A zero delay queues the work item right away.
+//
+// Returns false if the work item was already pending, in which case
+// we neither queue it again nor change its delay.
+//
+// Safe to call from any context.
+bool sched_delayed_work_queue(struct sched_delayed_work *dwork, __duration64_t delay) __NOEXCEPT;
+
+// Cancels a pending delayed work item, regardless of whether its
+// timer has expired already.
+//
+// Returns whether the work item was pending, as for sched_work_cancel.
+//
+// When we return, the timer callback is not running anymore, so you may
+// free dwork once the work item has also stopped running, unless someone
+// else may queue it again.
+//
+// MUST NOT be called from interrupt context (see sched_timer_cancel_sync).
+bool sched_delayed_work_cancel(struct sched_delayed_work *dwork) __NOEXCEPT;
+
+// Starts the initial worker threads.
+//
+// Work queued before this function runs remains pending until then.
+//
+// Must be invoked from a kernel thread.
+void sched_workqueue_init(void) __NOEXCEPT;
+
+__END_DECLS
+
+#endif // KERNEL_SCHED_WORKQUEUE_H
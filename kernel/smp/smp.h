@@ -0,0 +1,115 @@
+// File: kernel/smp/smp.h
+// Purpose: symmetric multiprocessing bring-up and per-CPU state.
+// SPDX-License-Identifier: MIT
+#ifndef KERNEL_SMP_SMP_H
+#define KERNEL_SMP_SMP_H
+
+#include <kernel/asm/asm.h> // for cpu_local_base
+
+#include <sys/cdefs.h> // for __BEGIN_DECLS
+#include <sys/param.h> // for SMP_MAX_CPUS
+#include <sys/types.h> // for size_t
+
+__BEGIN_DECLS
+
+// Forward declaration of the scheduler per-CPU state.
+struct sched_cpu;
+
+// Per-CPU state.
+//
+// Each CPU reaches its own state through the cpu_local_base register
+// (i.e., TPIDR_EL1 on ARM64), so smp_this_cpu is a single load.
+struct smp_cpu {
+	// The registers a secondary CPU loads before enabling the MMU.
+	//
+	// CAUTION: the boot code reads these fields with the MMU
+	// and the caches disabled, using fixed offsets. Keep in sync
+	// with `./kernel/boot/boot_arm64.S`.
+	uintptr_t boot_stack_top;
+	uint64_t boot_mair;
+	uint64_t boot_tcr;
+	uint64_t boot_ttbr0;
+	uint64_t boot_sctlr;
+
+	// The stack on which we handle fatal kernel exceptions, which
+	// we cannot handle on the current stack since it may have
+	// overflowed into its guard page.
+	//
+	// CAUTION: the trap code reads this field using a fixed
+	// offset. Keep in sync with `./kernel/trap/handle_arm64.S`.
+	uintptr_t fault_stack_top;
+
+	// The logical CPU ID, which indexes smp_cpus.
+	size_t id;
+
+	// The hardware affinity identifying the CPU.
+	uint64_t mpidr;
+
+	// Whether the CPU has completed its bring-up.
+	bool online;
+
+	// The scheduler state of this CPU.
+	//
+	// Owned by the scheduler, which sets it in sched_init_early.
+	struct sched_cpu *sched;
+
+	// How many times the code running on this CPU has disabled preemption.
+	//
+	// See `./kernel/core/preempt.h`.
+	uint64_t preempt_count;
+};
+
+// Ensure the offsets assumed by the boot code are still valid.
+static_assert(__builtin_offsetof(struct smp_cpu, boot_stack_top) == 0, "boot_stack_top offset");
+static_assert(__builtin_offsetof(struct smp_cpu, boot_mair) == 8, "boot_mair offset");
+static_assert(__builtin_offsetof(struct smp_cpu, boot_tcr) == 16, "boot_tcr offset");
+static_assert(__builtin_offsetof(struct smp_cpu, boot_ttbr0) == 24, "boot_ttbr0 offset");
+static_assert(__builtin_offsetof(struct smp_cpu, boot_sctlr) == 32, "boot_sctlr offset");
+static_assert(__builtin_offsetof(struct smp_cpu, fault_stack_top) == 40, "fault_stack_top offset");
+
+// The state of all the possible CPUs.
+//
+// Use smp_cpu and smp_this_cpu instead of accessing this directly.
+extern struct smp_cpu __smp_cpus[SMP_MAX_CPUS];
+
+// Initialize the boot CPU state.
+//
+// Called by the boot subsystem before any code uses smp_this_cpu.
+void smp_init_early(void) __NOEXCEPT;
+
+// Starts the secondary CPUs and waits for them to come online.
+//
+// Called by the kernel init thread after the IRQs have been initialized.
+void smp_start_secondaries(void) __NOEXCEPT;
+
+// Initialize the state of a secondary CPU.
+//
+// Called by the secondary CPU boot code after enabling the MMU.
+void smp_init_secondary(struct smp_cpu *cpu) __NOEXCEPT;
+
+// Returns the state of the given CPU.
+static inline struct smp_cpu *smp_cpu(size_t id) __NOEXCEPT {
+	return &__smp_cpus[id];
+}
+
+// Returns the state of the CPU we're running on.
+//
+// The caller must not migrate to another CPU while using the return
+// value, which holds with interrupts or preemption disabled.
+static inline struct smp_cpu *smp_this_cpu(void) __NOEXCEPT {
+	return (struct smp_cpu *)cpu_local_base();
+}
+
+// Returns the logical ID of the CPU we're running on.
+static inline size_t smp_cpu_id(void) __NOEXCEPT {
+	return smp_this_cpu()->id;
+}
+
+// Returns whether the given CPU is online.
+static inline bool smp_cpu_online(size_t id) __NOEXCEPT {
+	return __atomic_load_n(&__smp_cpus[id].online, __ATOMIC_ACQUIRE);
+}
+
+__END_DECLS
+
+#endif // KERNEL_SMP_SMP_H
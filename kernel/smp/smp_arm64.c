@@ -0,0 +1,129 @@
+// File: kernel/smp/smp_arm64.c
+// Purpose: ARM64 secondary CPUs bring-up using PSCI.
+// SPDX-License-Identifier: MIT
+
+#include <kernel/asm/arm64.h>   // for mrs_mpidr_el1
+#include <kernel/boot/boot.h>   // for __boot_secondary
+#include <kernel/clock/clock.h> // for clock_monotonic_ns
+#include <kernel/core/assert.h> // for KERNEL_ASSERT
+#include <kernel/core/printk.h> // for printk
+#include <kernel/mm/vm.h>       // for vm_kernel_root_pt
+#include <kernel/smp/smp.h>     // the subsystem's API
+
+#include <sys/param.h> // for SMP_MAX_CPUS
+#include <sys/types.h> // for uint64_t
+
+// PSCI CPU_ON function ID using the SMC64 calling convention.
+#define PSCI_CPU_ON 0xC4000003ULL
+
+// PSCI return value indicating success.
+#define PSCI_SUCCESS 0
+
+// PSCI return value indicating the target CPU does not exist.
+#define PSCI_INVALID_PARAMETERS -2
+
+// PSCI return value indicating the target CPU is already on.
+#define PSCI_ALREADY_ON -4
+
+// Mask of the affinity fields of MPIDR_EL1.
+#define MPIDR_AFFINITY_MASK 0xFF00FFFFFFULL
+
+// The size in bytes of the stack a secondary CPU uses until it
+// switches to its idle thread, which never switches back.
+#define SMP_BOOT_STACK_SIZE 16384
+
+// The size in bytes of the stack on which a CPU handles fatal kernel exceptions.
+#define SMP_FAULT_STACK_SIZE 4096
+
+// How long we wait for a secondary CPU to come online.
+#define SMP_BOOT_TIMEOUT_NS CLOCK_NSEC_PER_SEC
+
+struct smp_cpu __smp_cpus[SMP_MAX_CPUS];
+
+// The statically-allocated boot stacks of the secondary CPUs.
+static alignas(16) uint8_t boot_stacks[SMP_MAX_CPUS][SMP_BOOT_STACK_SIZE];
+
+// The statically-allocated stacks for handling fatal kernel exceptions.
+static alignas(16) uint8_t fault_stacks[SMP_MAX_CPUS][SMP_FAULT_STACK_SIZE];
+
+void smp_init_early(void) {
+	for (size_t id = 0; id < SMP_MAX_CPUS; id++) {
+		__smp_cpus[id].id = id;
+		__smp_cpus[id].fault_stack_top = (uintptr_t)&fault_stacks[id][SMP_FAULT_STACK_SIZE];
+	}
+	struct smp_cpu *cpu = &__smp_cpus[0];
+	cpu->mpidr = mrs_mpidr_el1() & MPIDR_AFFINITY_MASK;
+	cpu->online = true;
+	cpu_set_local_base((uintptr_t)cpu);
+}
+
+void smp_init_secondary(struct smp_cpu *cpu) {
+	KERNEL_ASSERT(cpu >= &__smp_cpus[1] && cpu < &__smp_cpus[SMP_MAX_CPUS]);
+	cpu_set_local_base((uintptr_t)cpu);
+	KERNEL_ASSERT((mrs_mpidr_el1() & MPIDR_AFFINITY_MASK) == cpu->mpidr);
+	__atomic_store_n(&cpu->online, true, __ATOMIC_RELEASE);
+}
+
+// Invokes PSCI through the hypervisor conduit used by QEMU virt.
+static int64_t __psci_call(uint64_t fn, uint64_t arg0, uint64_t arg1, uint64_t arg2) {
+	register uint64_t x0 __asm__("x0") = fn;
+	register uint64_t x1 __asm__("x1") = arg0;
+	register uint64_t x2 __asm__("x2") = arg1;
+	register uint64_t x3 __asm__("x3") = arg2;
+	__asm__ volatile("hvc #0"
+	                 : "+r"(x0), "+r"(x1), "+r"(x2), "+r"(x3)
+	                 :
+	                 : "x4", "x5", "x6", "x7", "x8", "x9", "x10", "x11", "x12", "x13", "x14", "x15", "x16", "x17",
+	                   "memory");
+	return (int64_t)x0;
+}
+
+// Starts the given secondary CPU and waits for it to come online.
+//
+// Returns false if the CPU does not exist or failed to start.
+static bool __smp_start_cpu(struct smp_cpu *cpu) {
+	// 1. QEMU virt numbers the CPUs of the first cluster using Aff0
+	cpu->mpidr = cpu->id;
+
+	// 2. record the registers the CPU needs to join our address space
+	cpu->boot_stack_top = (uintptr_t)&boot_stacks[cpu->id][SMP_BOOT_STACK_SIZE];
+	cpu->boot_mair = mrs_mair_el1();
+	cpu->boot_tcr = mrs_tcr_el1();
+	cpu->boot_ttbr0 = vm_kernel_root_pt().table;
+	cpu->boot_sctlr = mrs_sctlr_el1();
+
+	// 3. the CPU reads its state with the caches disabled
+	dcache_clean_inval_range((uintptr_t)cpu, (uintptr_t)(cpu + 1));
+
+	// 4. ask the firmware to start the CPU at the boot entry point,
+	// which is also its physical address since we identity map
+	int64_t rc = __psci_call(PSCI_CPU_ON, cpu->mpidr, (uintptr_t)__boot_secondary, (uintptr_t)cpu);
+	if (rc == PSCI_INVALID_PARAMETERS) {
+		return false;
+	}
+	if (rc != PSCI_SUCCESS && rc != PSCI_ALREADY_ON) {
+		printk("smp: cannot start cpu%lld: %lld\n", cpu->id, rc);
+		return false;
+	}
+
+	// 5. wait for the CPU to complete its bring-up
+	__duration64_t deadline = clock_monotonic_ns() + SMP_BOOT_TIMEOUT_NS;
+	while (!smp_cpu_online(cpu->id)) {
+		if (clock_monotonic_ns() >= deadline) {
+			printk("smp: cpu%lld did not come online\n", cpu->id);
+			return false;
+		}
+	}
+	printk("smp: cpu%lld is online (mpidr 0x%llx)\n", cpu->id, cpu->mpidr);
+	return true;
+}
+
+void smp_start_secondaries(void) {
+	// We stop at the first missing CPU, which also
+	// takes care of QEMU running with fewer CPUs
+	size_t count = 1;
+	for (; count < SMP_MAX_CPUS && __smp_start_cpu(&__smp_cpus[count]); count++) {
+		// nothing
+	}
+	printk("smp: %lld CPU(s) online\n", count);
+}
@@ -0,0 +1,48 @@
+// File: kernel/syscall/cpuquota.c
+// Purpose: implement the cpuquota_get and cpuquota_set syscalls
+// SPDX-License-Identifier: MIT
+
+#include <kernel/sched/sched.h> // for sched_process_set_quota
+#include <kernel/syscall/io.h>  // for copy_from_user
+
+#include <sys/cpuquota.h> // for cpuquota_get
+#include <sys/errno.h>    // for EINVAL
+#include <sys/types.h>    // for ssize_t
+
+// Maps the pid argument to a thread ID.
+static inline __thread_id_t __cpuquota_thread(int pid) {
+	return (pid == 0) ? sched_thread_self() : (__thread_id_t)pid;
+}
+
+// Implement the cpuquota_get system call.
+int cpuquota_get(int pid, struct cpuquota *user_quota) {
+	if (pid < 0) {
+		return -EINVAL;
+	}
+	struct cpuquota quota = {0};
+	__status_t rc = sched_process_get_quota(__cpuquota_thread(pid), &quota);
+	if (rc != 0) {
+		return (int)rc;
+	}
+	ssize_t rv = copy_to_user((char *)user_quota, (const char *)&quota, sizeof(quota));
+	if (rv < 0) {
+		return (int)rv;
+	}
+	return ((size_t)rv == sizeof(quota)) ? 0 : -EFAULT;
+}
+
+// Implement the cpuquota_set system call.
+int cpuquota_set(int pid, const struct cpuquota *user_quota) {
+	if (pid < 0) {
+		return -EINVAL;
+	}
+	struct cpuquota quota = {0};
+	ssize_t rv = copy_from_user((char *)&quota, (const char *)user_quota, sizeof(quota));
+	if (rv < 0) {
+		return (int)rv;
+	}
+	if ((size_t)rv != sizeof(quota)) {
+		return -EFAULT;
+	}
+	return (int)sched_process_set_quota(__cpuquota_thread(pid), &quota);
+}
@@ -0,0 +1,157 @@
+// File: kernel/syscall/futex.c
+// Purpose: implement the futex_wait and futex_wake syscalls
+// SPDX-License-Identifier: MIT
+
+#include <kernel/clock/clock.h>     // for clock_monotonic_ns
+#include <kernel/core/list.h>       // for struct list_node
+#include <kernel/core/spinlock.h>   // for struct spinlock
+#include <kernel/mm/vm.h>           // for vm_user_virt_to_phys
+#include <kernel/sched/sched.h>     // for sched_current_process_page_table
+#include <kernel/sched/waitqueue.h> // for struct sched_waitqueue
+
+#include <sys/errno.h> // for EAGAIN
+#include <sys/futex.h> // for futex_wait
+#include <sys/types.h> // for uint32_t
+
+// Number of buckets of the futex hash table (must be a power of two).
+#define FUTEX_HASH_SIZE 64
+
+// A thread waiting on a futex.
+//
+// The waiter lives on the kernel stack of the waiting thread, which
+// removes itself from the bucket before returning. It has its own
+// wait queue, so that waking a futex only touches its waiters, even
+// though several futexes may share the same bucket.
+struct futex_waiter {
+	// The physical address of the futex word.
+	uintptr_t key;
+
+	// Node linking the waiter into the bucket.
+	struct list_node node;
+
+	// The wait queue on which the thread suspends.
+	struct sched_waitqueue wq;
+};
+
+// A bucket of the futex hash table.
+struct futex_bucket {
+	// The waiters of the futexes in this bucket in FIFO order.
+	struct list_node waiters;
+
+	// Spinlock protecting the bucket and its waiters.
+	struct spinlock lock;
+};
+
+// The futex hash table.
+static struct futex_bucket buckets[FUTEX_HASH_SIZE];
+
+// Returns the bucket for the given physical address holding its spinlock.
+static struct futex_bucket *__futex_lock_bucket(uintptr_t key) {
+	// Mix the page number with the word offset, since futexes
+	// tend to be at the same offset of different pages
+	uintptr_t hash = (key >> 2) ^ (key >> 12);
+	struct futex_bucket *bucket = &buckets[hash & (FUTEX_HASH_SIZE - 1)];
+
+	// Zero-initialized memory is an unlocked spinlock, so we
+	// initialize the list on first use holding the spinlock
+	spinlock_acquire(&bucket->lock);
+	if (bucket->waiters.next == 0) {
+		list_init(&bucket->waiters);
+	}
+	return bucket;
+}
+
+// Maps the address of a futex word to its physical address.
+static int __futex_key(uintptr_t *key, uint32_t *uaddr) {
+	*key = 0;
+	if (((uintptr_t)uaddr & (sizeof(*uaddr) - 1)) != 0) {
+		return -EINVAL;
+	}
+	struct vm_root_pt table = {0};
+	__status_t rc = sched_current_process_page_table(&table);
+	if (rc != 0) {
+		return (int)rc;
+	}
+	rc = vm_user_virt_to_phys(key, table, (uintptr_t)uaddr, 0);
+	return (rc != 0) ? -EFAULT : 0;
+}
+
+// Implement the futex_wait system call.
+int futex_wait(uint32_t *uaddr, uint32_t val, uint64_t timeout_ns) {
+	// 1. compute the deadline before doing any work
+	__duration64_t deadline_ns = UINT64_MAX;
+	if (timeout_ns != 0) {
+		__duration64_t now_ns = clock_monotonic_ns();
+		deadline_ns = (timeout_ns < UINT64_MAX - now_ns) ? now_ns + timeout_ns : UINT64_MAX;
+	}
+
+	// 2. find the physical address of the word
+	uintptr_t key = 0;
+	int rc = __futex_key(&key, uaddr);
+	if (rc != 0) {
+		return rc;
+	}
+
+	// 3. prepare the wait queue before checking the word, so that a
+	// wakeup occurring right after we link ourselves is not lost
+	struct futex_waiter waiter = {.key = key};
+	list_init(&waiter.node);
+	sched_waitqueue_init(&waiter.wq);
+	uint64_t gen = sched_waitqueue_prepare(&waiter.wq);
+
+	// 4. check the word, which we read through the identity mapping, and
+	// link ourselves while holding the spinlock futex_wake needs to find us
+	struct futex_bucket *bucket = __futex_lock_bucket(key);
+	if (__atomic_load_n((uint32_t *)key, __ATOMIC_SEQ_CST) != val) {
+		spinlock_release(&bucket->lock);
+		return -EAGAIN;
+	}
+	list_push_back(&bucket->waiters, &waiter.node);
+	spinlock_release(&bucket->lock);
+
+	// 5. suspend until futex_wake wakes us or the deadline expires
+	bool expired = false;
+	if (deadline_ns == UINT64_MAX) {
+		sched_waitqueue_wait(&waiter.wq, gen);
+	} else {
+		expired = sched_waitqueue_wait_deadline(&waiter.wq, gen, deadline_ns) == -ETIMEDOUT;
+	}
+
+	// 6. unlink ourselves unless futex_wake did, in which case the wakeup
+	// wins over the timeout, since otherwise we would lose it. Holding the
+	// spinlock also ensures futex_wake is done using our stack.
+	spinlock_acquire(&bucket->lock);
+	bool woken = !list_linked(&waiter.node);
+	if (!woken) {
+		list_remove(&waiter.node);
+	}
+	spinlock_release(&bucket->lock);
+	return (woken || !expired) ? 0 : -ETIMEDOUT;
+}
+
+// Implement the futex_wake system call.
+int futex_wake(uint32_t *uaddr, int count) {
+	// 1. find the futex
+	uintptr_t key = 0;
+	int rc = __futex_key(&key, uaddr);
+	if (rc != 0) {
+		return rc;
+	}
+
+	// 2. wake up the oldest waiters of this futex
+	int woken = 0;
+	struct futex_bucket *bucket = __futex_lock_bucket(key);
+	struct list_node *node = bucket->waiters.next;
+	while (node != &bucket->waiters && woken < count) {
+		struct futex_waiter *waiter = list_entry(node, struct futex_waiter, node);
+		node = node->next;
+		if (waiter->key != key) {
+			continue;
+		}
+		list_remove(&waiter->node);
+		sched_waitqueue_wake_one(&waiter->wq);
+		woken++;
+	}
+	spinlock_release(&bucket->lock);
+	return woken;
+}
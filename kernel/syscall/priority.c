@@ -0,0 +1,43 @@
+// File: kernel/syscall/priority.c
+// Purpose: implement the getpriority and setpriority syscalls
+// SPDX-License-Identifier: MIT
+
+#include <kernel/sched/sched.h> // for sched_thread_set_nice
+
+#include <sys/errno.h>    // for EINVAL
+#include <sys/resource.h> // for getpriority
+#include <sys/types.h>    // for int32_t
+
+// Maps the who argument to a thread ID.
+static inline __thread_id_t __priority_thread(int who) {
+	return (who == 0) ? sched_thread_self() : (__thread_id_t)who;
+}
+
+// Implement the getpriority system call.
+int getpriority(int which, int who) {
+	// We only support targeting threads
+	if (which != PRIO_PROCESS || who < 0) {
+		return -EINVAL;
+	}
+
+	// Bias the result so that it does not look like an errno value
+	int32_t nice = 0;
+	__status_t rc = sched_thread_get_nice(__priority_thread(who), &nice);
+	if (rc != 0) {
+		return (int)rc;
+	}
+	return 20 - nice;
+}
+
+// Implement the setpriority system call.
+int setpriority(int which, int who, int prio) {
+	// We only support targeting threads
+	if (which != PRIO_PROCESS || who < 0) {
+		return -EINVAL;
+	}
+
+	// Like Linux, clamp rather than reject out of range values
+	prio = (prio < PRIO_MIN) ? PRIO_MIN : prio;
+	prio = (prio > PRIO_MAX) ? PRIO_MAX : prio;
+	return (int)sched_thread_set_nice(__priority_thread(who), prio);
+}
@@ -0,0 +1,40 @@
+// File: kernel/syscall/schedstat.c
+// Purpose: implement the schedstat_thread and schedstat_latency syscalls
+// SPDX-License-Identifier: MIT
+
+#include <kernel/sched/sched.h> // for sched_thread_get_stats
+#include <kernel/syscall/io.h>  // for copy_to_user
+
+#include <sys/errno.h>     // for EINVAL
+#include <sys/schedstat.h> // for schedstat_thread
+#include <sys/types.h>     // for ssize_t
+
+// Copies a whole struct to userspace.
+static inline int __schedstat_copyout(void *user_dst, const void *src, size_t count) {
+	ssize_t rv = copy_to_user((char *)user_dst, (const char *)src, count);
+	if (rv < 0) {
+		return (int)rv;
+	}
+	return ((size_t)rv == count) ? 0 : -EFAULT;
+}
+
+// Implement the schedstat_thread system call.
+int schedstat_thread(int tid, struct schedstat_thread *user_stats) {
+	if (tid < 0) {
+		return -EINVAL;
+	}
+	struct schedstat_thread stats = {0};
+	__thread_id_t target = (tid == 0) ? sched_thread_self() : (__thread_id_t)tid;
+	__status_t rc = sched_thread_get_stats(target, &stats);
+	if (rc != 0) {
+		return (int)rc;
+	}
+	return __schedstat_copyout(user_stats, &stats, sizeof(stats));
+}
+
+// Implement the schedstat_latency system call.
+int schedstat_latency(struct schedstat_latency *user_hist) {
+	struct schedstat_latency hist = {0};
+	sched_latency_histogram(&hist);
+	return __schedstat_copyout(user_hist, &hist, sizeof(hist));
+}
@@ -2,9 +2,13 @@
 // Purpose: implement the syscall function
 // SPDX-License-Identifier: MIT
 
-#include <sys/errno.h>	 // for ENOSYS
-#include <sys/syscall.h> // for SYS_write
-#include <sys/types.h>	 // for uintptr_t
+#include <sys/cpuquota.h>  // for cpuquota_get
+#include <sys/errno.h>     // for ENOSYS
+#include <sys/futex.h>     // for futex_wait
+#include <sys/resource.h>  // for getpriority
+#include <sys/schedstat.h> // for schedstat_thread
+#include <sys/syscall.h>   // for SYS_write
+#include <sys/types.h>     // for uintptr_t
 
 #include <unistd.h> // for syscall
 
@@ -21,6 +25,30 @@ syscall(uintptr_t num, uintptr_t a0, uintptr_t a1, uintptr_t a2, uintptr_t a3, u
 	case SYS_write:
 		return (intptr_t)write((int)a0, (const char *)a1, (size_t)a2);
 
+	case SYS_getpriority:
+		return (intptr_t)getpriority((int)a0, (int)a1);
+
+	case SYS_setpriority:
+		return (intptr_t)setpriority((int)a0, (int)a1, (int)a2);
+
+	case SYS_schedstat_thread:
+		return (intptr_t)schedstat_thread((int)a0, (struct schedstat_thread *)a1);
+
+	case SYS_schedstat_latency:
+		return (intptr_t)schedstat_latency((struct schedstat_latency *)a0);
+
+	case SYS_futex_wait:
+		return (intptr_t)futex_wait((uint32_t *)a0, (uint32_t)a1, (uint64_t)a2);
+
+	case SYS_futex_wake:
+		return (intptr_t)futex_wake((uint32_t *)a0, (int)a1);
+
+	case SYS_cpuquota_get:
+		return (intptr_t)cpuquota_get((int)a0, (struct cpuquota *)a1);
+
+	case SYS_cpuquota_set:
+		return (intptr_t)cpuquota_set((int)a0, (const struct cpuquota *)a1);
+
 	default:
 		return -ENOSYS;
 	}
@@ -27,6 +27,20 @@ void trap_init_mm(struct vm_root_pt root);
 // Must be invoked after trap_init_mm.
 void trap_init_irqs(void);
 
+// Initialize interrupt handling on a secondary CPU.
+//
+// Called by the boot process of each secondary CPU.
+//
+// Must be invoked after trap_init_irqs has run on the boot CPU.
+void trap_init_irqs_secondary(void);
+
+// Interrupts the given CPU so that it reconsiders what to run.
+//
+// Called by the scheduler.
+//
+// Safe to call from any context.
+void trap_send_reschedule_ipi(size_t cpu);
+
 // Function that returns from the trap restoring the previous context.
 //
 // Called by the scheduler to switch the context.
@@ -5,9 +5,10 @@
 #include <kernel/asm/arm64.h>           // for msr_vbar_el1
 #include <kernel/boot/boot.h>           // for __vectors_el1
 #include <kernel/core/printk.h>         // for printk
+#include <kernel/core/softirq.h>        // for softirq_irq_enter
 #include <kernel/drivers/gicv2_arm64.h> // for struct gicv2_device
 #include <kernel/mm/vm.h>               // for struct vm_root_pt
-#include <kernel/sched/sched.h>         // for sched_clock_init_irqs
+#include <kernel/sched/sched.h>         // for sched_preempt_irq
 #include <kernel/trap/trap.h>           // for trap_init_mm
 #include <kernel/trap/trap_arm64.h>     // for struct trap_frame
 #include <kernel/tty/uart.h>            // for uart_init_irqs
@@ -22,6 +23,9 @@
 // Base and limit memory addresses for the GICD.
 #define GICD_BASE 0x08000000UL
 
+// The SGI we use to ask another CPU to reschedule
+#define IRQ_SGI_RESCHED 0u
+
 // The ARM Generic Timer (physical EL1) PPI is INTID 30 on GIC (per-cpu)
 #define IRQ_PPI_CNTP 30u
 
@@ -43,6 +47,10 @@ static inline void __enable_timer_irq(void) {
 	gicv2_enable_ppi(&irq0, IRQ_PPI_CNTP, 0x80);
 }
 
+static inline void __enable_resched_irq(void) {
+	gicv2_enable_sgi(&irq0, IRQ_SGI_RESCHED, 0x80);
+}
+
 static inline void __enable_uart_irq(void) {
 	gicv2_enable_spi_level_cpu0(&irq0, UART0_INTID, 0x80);
 }
@@ -57,6 +65,7 @@ void trap_init_irqs(void) {
 
 	// Program devices (group/prio/route/trigger and set-enable)
 	__enable_timer_irq();
+	__enable_resched_irq();
 	__enable_uart_irq();
 
 	// Re-enable interrupt controller
@@ -67,6 +76,26 @@ void trap_init_irqs(void) {
 	uart_init_irqs();
 }
 
+void trap_init_irqs_secondary(void) {
+	// Set the vector interrupt table
+	msr_vbar_el1((uint64_t)__vectors_el1);
+	isb();
+
+	// Program the banked per-CPU interrupts
+	__enable_timer_irq();
+	__enable_resched_irq();
+
+	// Enable our CPU interface, the distributor is already enabled
+	gicv2_enable_cpu_interface(&irq0);
+
+	// Start the clock of this CPU
+	sched_clock_init_irqs();
+}
+
+void trap_send_reschedule_ipi(size_t cpu) {
+	gicv2_send_sgi(&irq0, IRQ_SGI_RESCHED, cpu);
+}
+
 void __trap_isr(struct trap_frame *frame) {
 	(void)frame;
 
@@ -77,12 +106,17 @@ void __trap_isr(struct trap_frame *frame) {
 		return;
 	}
 
-	// Handle each IRQ type
+	// Handle each IRQ type, deferring the bulk of the work
+	softirq_irq_enter();
 	switch (irqid) {
 	case IRQ_PPI_CNTP:
 		sched_clock_isr();
 		break;
 
+	case IRQ_SGI_RESCHED:
+		sched_ipi_isr();
+		break;
+
 	case UART0_INTID:
 		uart_isr();
 		break;
@@ -90,9 +124,22 @@ void __trap_isr(struct trap_frame *frame) {
 
 	// We're done handling this interrupt
 	gicv2_end_of_interrupt(&irq0, iar);
+
+	// Run the deferred work with interrupts enabled
+	softirq_irq_exit();
+
+	// Switch to another thread if the interrupt made it more important
+	sched_preempt_irq();
 }
 
 void __trap_ssr(struct trap_frame *frame, uint64_t esr, uint64_t far) {
+	// Handle the first FP/SIMD instruction of the time slice, which
+	// we execute again when returning to userspace
+	if ((esr >> 26) == 0x07) {
+		sched_fpu_trap();
+		return;
+	}
+
 	// Handle cases where the instruction is not an SVC
 	if ((esr >> 26) != 0x15) {
 		panic("unhandled exception: FRAME=0x%llx ESR=0x%llx FAR=0x%llx\n", frame, esr, far);
@@ -111,6 +158,13 @@ void __trap_ssr(struct trap_frame *frame, uint64_t esr, uint64_t far) {
 	    frame->x[5]);
 }
 
+[[noreturn]] void __trap_kernel_fault(uint64_t esr, uint64_t far, uintptr_t elr, uintptr_t sp) {
+	if (sched_thread_stack_overflowed(far)) {
+		panic("kernel stack overflow: ELR=0x%llx SP=0x%llx FAR=0x%llx\n", elr, sp, far);
+	}
+	panic("unhandled kernel exception: ESR=0x%llx FAR=0x%llx ELR=0x%llx SP=0x%llx\n", esr, far, elr, sp);
+}
+
 [[noreturn]] void trap_restore_user_and_eret(uintptr_t frame) {
 	__trap_restore_user_and_eret(frame);
 }
@@ -125,20 +179,10 @@ void trap_dump_frame(uintptr_t frame, const char *context) {
 
 	printk("sp_el0 = 0x%llx\n", tp->sp_el0);
 
-	for (size_t idx = 0; idx < sizeof(tp->q) / sizeof(tp->q[0]); idx++) {
-		uint64_t high = (uint64_t)(tp->q[idx] >> 64);
-		uint64_t low = (uint64_t)(tp->q[idx] & UINT64_MAX);
-		printk("q[%d] = 0x%llx 0x%llx\n", idx, high, low);
-	}
-
 	printk("elr_el1 = 0x%llx\n", tp->elr_el1);
 
 	printk("spsr_el1 = 0x%llx\n", tp->spsr_el1);
 
-	printk("fpcr = 0x%llx\n", tp->fpcr);
-
-	printk("fpsr = 0x%llx\n", tp->fpsr);
-
 	printk("ttbr0_el1 = 0x%llx\n", tp->ttbr0_el1);
 
 	printk("__unused_padding = 0x%llx\n", tp->__unused_padding);
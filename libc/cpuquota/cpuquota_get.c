@@ -0,0 +1,12 @@
+// File: libc/cpuquota/cpuquota_get.c
+// Purpose: cpuquota_get(2)
+// SPDX-License-Identifier: MIT
+
+#include <sys/cpuquota.h> // for cpuquota_get
+#include <sys/syscall.h>  // for SYS_cpuquota_get
+#include <sys/types.h>    // for uintptr_t
+#include <unistd.h>       // for syscall
+
+int cpuquota_get(int pid, struct cpuquota *quota) {
+	return (int)syscall(SYS_cpuquota_get, (uintptr_t)pid, (uintptr_t)quota, 0, 0, 0, 0);
+}
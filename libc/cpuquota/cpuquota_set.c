@@ -0,0 +1,12 @@
+// File: libc/cpuquota/cpuquota_set.c
+// Purpose: cpuquota_set(2)
+// SPDX-License-Identifier: MIT
+
+#include <sys/cpuquota.h> // for cpuquota_set
+#include <sys/syscall.h>  // for SYS_cpuquota_set
+#include <sys/types.h>    // for uintptr_t
+#include <unistd.h>       // for syscall
+
+int cpuquota_set(int pid, const struct cpuquota *quota) {
+	return (int)syscall(SYS_cpuquota_set, (uintptr_t)pid, (uintptr_t)quota, 0, 0, 0, 0);
+}
@@ -0,0 +1,12 @@
+// File: libc/futex/futex_wait.c
+// Purpose: futex_wait(2)
+// SPDX-License-Identifier: MIT
+
+#include <sys/futex.h>   // for futex_wait
+#include <sys/syscall.h> // for SYS_futex_wait
+#include <sys/types.h>   // for uintptr_t
+#include <unistd.h>      // for syscall
+
+int futex_wait(uint32_t *uaddr, uint32_t val, uint64_t timeout_ns) {
+	return (int)syscall(SYS_futex_wait, (uintptr_t)uaddr, (uintptr_t)val, (uintptr_t)timeout_ns, 0, 0, 0);
+}
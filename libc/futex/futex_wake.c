@@ -0,0 +1,12 @@
+// File: libc/futex/futex_wake.c
+// Purpose: futex_wake(2)
+// SPDX-License-Identifier: MIT
+
+#include <sys/futex.h>   // for futex_wake
+#include <sys/syscall.h> // for SYS_futex_wake
+#include <sys/types.h>   // for uintptr_t
+#include <unistd.h>      // for syscall
+
+int futex_wake(uint32_t *uaddr, int count) {
+	return (int)syscall(SYS_futex_wake, (uintptr_t)uaddr, (uintptr_t)count, 0, 0, 0, 0);
+}
@@ -0,0 +1,17 @@
+// File: libc/resource/getpriority.c
+// Purpose: getpriority(2)
+// SPDX-License-Identifier: MIT
+
+#include <sys/resource.h> // for getpriority
+#include <sys/syscall.h>  // for SYS_getpriority
+#include <sys/types.h>    // for intptr_t
+#include <unistd.h>       // for syscall
+
+int getpriority(int which, int who) {
+	// The kernel returns 20 - nice to avoid confusion with errors
+	intptr_t rv = syscall(SYS_getpriority, (uintptr_t)which, (uintptr_t)who, 0, 0, 0, 0);
+	if (rv < 0) {
+		return -1;
+	}
+	return 20 - (int)rv;
+}
@@ -0,0 +1,12 @@
+// File: libc/resource/setpriority.c
+// Purpose: setpriority(2)
+// SPDX-License-Identifier: MIT
+
+#include <sys/resource.h> // for setpriority
+#include <sys/syscall.h>  // for SYS_setpriority
+#include <sys/types.h>    // for uintptr_t
+#include <unistd.h>       // for syscall
+
+int setpriority(int which, int who, int prio) {
+	return (int)syscall(SYS_setpriority, (uintptr_t)which, (uintptr_t)who, (uintptr_t)prio, 0, 0, 0);
+}
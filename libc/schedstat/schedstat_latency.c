@@ -0,0 +1,12 @@
+// File: libc/schedstat/schedstat_latency.c
+// Purpose: schedstat_latency(2)
+// SPDX-License-Identifier: MIT
+
+#include <sys/schedstat.h> // for schedstat_latency
+#include <sys/syscall.h>   // for SYS_schedstat_latency
+#include <sys/types.h>     // for uintptr_t
+#include <unistd.h>        // for syscall
+
+int schedstat_latency(struct schedstat_latency *hist) {
+	return (int)syscall(SYS_schedstat_latency, (uintptr_t)hist, 0, 0, 0, 0, 0);
+}
@@ -0,0 +1,12 @@
+// File: libc/schedstat/schedstat_thread.c
+// Purpose: schedstat_thread(2)
+// SPDX-License-Identifier: MIT
+
+#include <sys/schedstat.h> // for schedstat_thread
+#include <sys/syscall.h>   // for SYS_schedstat_thread
+#include <sys/types.h>     // for uintptr_t
+#include <unistd.h>        // for syscall
+
+int schedstat_thread(int tid, struct schedstat_thread *stats) {
+	return (int)syscall(SYS_schedstat_thread, (uintptr_t)tid, (uintptr_t)stats, 0, 0, 0, 0);
+}
@@ -0,0 +1,191 @@
+// File: tools/schedsim/cpu.c
+// Purpose: simulated CPU driving the kernel scheduling classes.
+// SPDX-License-Identifier: MIT
+
+#include <kernel/core/assert.h> // for KERNEL_ASSERT
+#include <kernel/core/list.h>   // for list_entry
+#include <kernel/sched/class.h> // for struct sched_rq
+#include <kernel/sched/sched.h> // for struct sched_deadline_params
+
+#include <sys/types.h> // for size_t
+
+#include "schedsim.h" // the subsystem's API
+
+// We build this file with the kernel headers, link it with the scheduling
+// classes from `./kernel/sched`, and mirror what `./kernel/sched/sched.c`
+// does on a single CPU, so the decisions are the same the kernel would make.
+//
+// We do not simulate work stealing, admission control, or CPU quotas, which
+// belong to the mechanism rather than to the policies.
+
+// A simulated thread.
+struct schedsim_thread {
+	// The part of the thread the scheduling classes use.
+	struct sched_entity se;
+
+	// The reservation of a SCHED_POLICY_DEADLINE thread.
+	struct sched_deadline_params dl_params;
+
+	// Whether the thread is runnable.
+	bool runnable;
+};
+
+// The simulated threads.
+static struct schedsim_thread threads[SCHEDSIM_MAX_THREADS];
+
+// Number of simulated threads.
+static size_t nr_threads;
+
+// The run queue of the simulated CPU.
+static struct sched_rq rq;
+
+// The running thread or zero when the CPU is idle.
+static struct schedsim_thread *current;
+
+// Whether the running thread must stop running.
+static bool need_sched;
+
+// Returns the thread containing the given entity.
+static inline struct schedsim_thread *__schedsim_thread_of(struct sched_entity *se) {
+	return list_entry(se, struct schedsim_thread, se);
+}
+
+// Returns the thread with the given ID.
+static inline struct schedsim_thread *__schedsim_thread(int tid) {
+	KERNEL_ASSERT(tid >= 0 && (size_t)tid < nr_threads);
+	return &threads[tid];
+}
+
+// Charges the running thread for the CPU time it consumed since we last did it.
+static void __schedsim_update_current(unsigned long long now_ns) {
+	if (current == 0) {
+		return;
+	}
+	struct sched_entity *se = &current->se;
+	__duration64_t delta_ns = (now_ns > se->exec_start_ns) ? now_ns - se->exec_start_ns : 0;
+	se->exec_start_ns = now_ns;
+	if (sched_class_of(se)->tick(&rq, se, delta_ns, now_ns)) {
+		need_sched = true;
+	}
+}
+
+void schedsim_init(void) {
+	nr_threads = 0;
+	sched_rq_init(&rq);
+	current = 0;
+	need_sched = false;
+}
+
+int schedsim_create(const struct schedsim_params *params) {
+	// 1. validate the parameters like the system calls do
+	if (nr_threads >= SCHEDSIM_MAX_THREADS || params->policy > SCHED_POLICY_DEADLINE) {
+		return -1;
+	}
+	if (params->nice < SCHED_NICE_MIN || params->nice > SCHED_NICE_MAX || params->prio >= SCHED_PRIO_LEVELS) {
+		return -1;
+	}
+	if (params->policy == SCHED_POLICY_DEADLINE &&
+	    (params->runtime_ns == 0 || params->runtime_ns > params->deadline_ns ||
+	     params->deadline_ns > params->period_ns)) {
+		return -1;
+	}
+
+	// 2. initialize the thread as blocked
+	struct schedsim_thread *thread = &threads[nr_threads];
+	sched_entity_init(&thread->se, params->policy, params->prio, params->nice);
+	thread->dl_params.runtime_ns = params->runtime_ns;
+	thread->dl_params.deadline_ns = params->deadline_ns;
+	thread->dl_params.period_ns = params->period_ns;
+	if (params->policy == SCHED_POLICY_DEADLINE) {
+		thread->se.dl_params = &thread->dl_params;
+	}
+	thread->runnable = false;
+
+	// 3. join the class, like sched_thread_start does
+	const struct sched_class *class = sched_class_of(&thread->se);
+	if (class->attach != 0) {
+		class->attach(&rq, &thread->se, 0);
+	}
+	return (int)nr_threads++;
+}
+
+unsigned schedsim_weight(int tid) {
+	return __schedsim_thread(tid)->se.weight;
+}
+
+const char *schedsim_policy_name(int tid) {
+	return sched_class_of(&__schedsim_thread(tid)->se)->name;
+}
+
+bool schedsim_wakeup(int tid, unsigned long long now_ns) {
+	// 1. queue the thread, unless its class parks it
+	struct schedsim_thread *thread = __schedsim_thread(tid);
+	KERNEL_ASSERT(!thread->runnable);
+	thread->runnable = true;
+	if (!sched_class_of(&thread->se)->enqueue(&rq, &thread->se, SCHED_ENQUEUE_WAKEUP, now_ns)) {
+		return need_sched;
+	}
+
+	// 2. the idle CPU looks for work on its own
+	if (current == 0) {
+		return true;
+	}
+
+	// 3. compare using up-to-date budgets and virtual runtimes
+	__schedsim_update_current(now_ns);
+	if (sched_rq_wakeup_preempt(&rq, &current->se, &thread->se)) {
+		need_sched = true;
+	}
+	return need_sched;
+}
+
+bool schedsim_tick(unsigned long long now_ns) {
+	__schedsim_update_current(now_ns);
+	if (sched_rq_replenish(&rq, now_ns)) {
+		need_sched = true;
+	}
+	return need_sched;
+}
+
+int schedsim_schedule(unsigned long long now_ns, bool block, bool preempted) {
+	// 1. charge the running thread, telling the classes whether it is still runnable
+	if (current != 0 && block) {
+		rq.curr = 0;
+	}
+	__schedsim_update_current(now_ns);
+
+	// 2. put the running thread back into the run queue, where the class may park it
+	if (current != 0) {
+		if (block) {
+			current->runnable = false;
+		} else {
+			__flags32_t flags = preempted ? SCHED_ENQUEUE_PREEMPTED : 0;
+			(void)sched_class_of(&current->se)->enqueue(&rq, &current->se, flags, now_ns);
+		}
+	}
+
+	// 3. pick the next thread according to the policies
+	struct sched_entity *se = sched_rq_pick_next(&rq, /* stealing */ false);
+	current = (se != 0) ? __schedsim_thread_of(se) : 0;
+	rq.curr = se;
+	need_sched = false;
+	if (current == 0) {
+		return SCHEDSIM_IDLE;
+	}
+	current->se.exec_start_ns = now_ns;
+	return (int)(current - threads);
+}
+
+unsigned schedsim_nr_queued(void) {
+	return (unsigned)sched_rq_nr_queued(&rq);
+}
+
+unsigned long long schedsim_next_event(void) {
+	return sched_rq_next_event(&rq);
+}
+
+[[noreturn]] void panic(const char *fmt, ...) {
+	__builtin_va_list ap;
+	__builtin_va_start(ap, fmt);
+	schedsim_vpanic(fmt, ap);
+}
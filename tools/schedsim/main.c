@@ -0,0 +1,552 @@
+// File: tools/schedsim/main.c
+// Purpose: driver replaying wake/sleep traces through the simulated CPU.
+// SPDX-License-Identifier: MIT
+
+// We build with -std=c23, which hides the POSIX declarations (e.g.,
+// clock_gettime and CLOCK_MONOTONIC) unless we explicitly ask for them.
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdarg.h>  // for va_list
+#include <stdbool.h> // for bool
+#include <stdio.h>   // for fprintf
+#include <stdlib.h>  // for exit
+#include <string.h>  // for strcmp
+#include <time.h>    // for clock_gettime
+
+#include "schedsim.h" // the subsystem's API
+
+// A trace describes the threads and when each of them wakes up to run for
+// how long, using the following line-oriented format, where `#` begins a
+// comment and all the times are in microseconds:
+//
+//	thread NAME fair NICE
+//	thread NAME fifo PRIO
+//	thread NAME rr PRIO
+//	thread NAME deadline RUNTIME DEADLINE PERIOD
+//	wake NAME AT BURST
+//	end AT
+//
+// A thread that is still running its previous burst when it should wake up
+// again wakes up as soon as it blocks. Without `end`, we stop when all the
+// bursts have completed. We simulate the clock interrupt firing at each
+// jiffy while threads share the CPU and when the classes need it, like the
+// kernel does, and measure the wakeup-to-run latency of each wakeup, the CPU
+// time of each thread, and the wall-clock cost of each scheduling decision.
+
+// The policy names, matching the SCHED_POLICY_xxx constants.
+static const char *const policies[] = {"rr", "fair", "fifo", "deadline"};
+
+// Number of policies.
+#define NR_POLICIES (sizeof(policies) / sizeof(policies[0]))
+
+// The duration of a jiffy, which must match HZ in `./include/sys/param.h`.
+#define JIFFY_NS 10000000ULL
+
+// Nanoseconds in a microsecond.
+#define NSEC_PER_USEC 1000ULL
+
+// Value of a time that never comes.
+#define NEVER (~0ULL)
+
+// A growable array of samples.
+struct samples {
+	unsigned long long *values;
+	size_t count;
+	size_t capacity;
+};
+
+// A wakeup read from the trace.
+struct wake {
+	// The thread waking up.
+	size_t thread;
+
+	// When the thread should wake up.
+	unsigned long long at_ns;
+
+	// For how long the thread runs before blocking again.
+	unsigned long long burst_ns;
+
+	// The line number, which keeps sorting stable.
+	size_t line;
+
+	// The following wakeup of the same thread or -1.
+	long next;
+};
+
+// A thread read from the trace.
+struct thread {
+	// The name of the thread.
+	char name[32];
+
+	// The ID of the thread in the simulated CPU.
+	int tid;
+
+	// The next wakeup of the thread or -1.
+	long next;
+
+	// Whether the thread is runnable, either running or waiting to run.
+	bool active;
+
+	// The CPU time left in the current burst.
+	unsigned long long remaining_ns;
+
+	// When the thread woke up, if it did not run since.
+	unsigned long long woken_ns;
+
+	// When the thread first woke up.
+	unsigned long long first_ns;
+
+	// Whether the thread blocked before the end of the simulation.
+	bool blocked;
+
+	// The CPU time consumed by the thread.
+	unsigned long long cpu_ns;
+
+	// Number of times the thread started running.
+	unsigned long long nr_switches;
+
+	// The wakeup-to-run latencies of the thread.
+	struct samples latency;
+};
+
+// The threads read from the trace.
+static struct thread threads[SCHEDSIM_MAX_THREADS];
+
+// Number of threads read from the trace.
+static size_t nr_threads;
+
+// The wakeups read from the trace.
+static struct wake *wakes;
+
+// Number of wakeups read from the trace.
+static size_t nr_wakes;
+
+// When the simulation ends or NEVER.
+static unsigned long long end_ns = NEVER;
+
+// The wall-clock cost of the scheduling decisions.
+static struct samples cost_wakeup;
+static struct samples cost_tick;
+static struct samples cost_schedule;
+
+[[noreturn]] void schedsim_vpanic(const char *fmt, va_list ap) {
+	fprintf(stderr, "schedsim: panic: ");
+	vfprintf(stderr, fmt, ap);
+	abort();
+}
+
+// Prints the given message and exits with failure.
+[[noreturn]] static void fatal(const char *fmt, ...) {
+	va_list ap;
+	va_start(ap, fmt);
+	fprintf(stderr, "schedsim: ");
+	vfprintf(stderr, fmt, ap);
+	fprintf(stderr, "\n");
+	va_end(ap);
+	exit(1);
+}
+
+// Appends a value to the given samples.
+static void samples_add(struct samples *samples, unsigned long long value) {
+	if (samples->count >= samples->capacity) {
+		samples->capacity = (samples->capacity == 0) ? 64 : samples->capacity * 2;
+		samples->values = realloc(samples->values, samples->capacity * sizeof(samples->values[0]));
+		if (samples->values == 0) {
+			fatal("out of memory");
+		}
+	}
+	samples->values[samples->count++] = value;
+}
+
+static int compare_values(const void *a, const void *b) {
+	unsigned long long va = *(const unsigned long long *)a;
+	unsigned long long vb = *(const unsigned long long *)b;
+	return (va > vb) - (va < vb);
+}
+
+// Sorts the samples, which we must do before computing percentiles.
+static void samples_sort(struct samples *samples) {
+	qsort(samples->values, samples->count, sizeof(samples->values[0]), compare_values);
+}
+
+// Returns the given percentile of sorted samples using the nearest-rank method.
+static unsigned long long samples_percentile(const struct samples *samples, double percentile) {
+	if (samples->count == 0) {
+		return 0;
+	}
+	size_t rank = (size_t)(percentile / 100.0 * (double)samples->count + 0.999999);
+	return samples->values[(rank > 0) ? rank - 1 : 0];
+}
+
+// Returns the monotonic wall-clock time in nanoseconds.
+static unsigned long long wallclock_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + (unsigned long long)ts.tv_nsec;
+}
+
+// Returns the index of the thread with the given name or -1.
+static long find_thread(const char *name) {
+	for (size_t idx = 0; idx < nr_threads; idx++) {
+		if (strcmp(threads[idx].name, name) == 0) {
+			return (long)idx;
+		}
+	}
+	return -1;
+}
+
+// Parses a line of the trace.
+static void parse_line(const char *path, size_t line, char *text) {
+	// 1. skip comments and empty lines
+	char *comment = strchr(text, '#');
+	if (comment != 0) {
+		*comment = '\0';
+	}
+	char verb[16], name[32], policy[16];
+	if (sscanf(text, "%15s", verb) != 1) {
+		return;
+	}
+
+	// 2. create a thread
+	if (strcmp(verb, "thread") == 0) {
+		struct schedsim_params params = {0};
+		long long a = 0, b = 0, c = 0;
+		int count = sscanf(text, "%*s %31s %15s %lld %lld %lld", name, policy, &a, &b, &c);
+		for (params.policy = 0; params.policy < NR_POLICIES; params.policy++) {
+			if (count >= 2 && strcmp(policy, policies[params.policy]) == 0) {
+				break;
+			}
+		}
+		bool fair = params.policy < NR_POLICIES && strcmp(policy, "fair") == 0;
+		bool deadline = params.policy < NR_POLICIES && strcmp(policy, "deadline") == 0;
+		bool negative = !fair && (a < 0 || b < 0 || c < 0);
+		if (params.policy >= NR_POLICIES || count != (deadline ? 5 : 3) || negative) {
+			fatal("%s:%zu: invalid thread", path, line);
+		}
+		if (find_thread(name) >= 0 || nr_threads >= SCHEDSIM_MAX_THREADS) {
+			fatal("%s:%zu: duplicate thread or too many threads", path, line);
+		}
+		if (fair) {
+			params.nice = (int)a;
+		} else if (!deadline) {
+			params.prio = (unsigned)a;
+		} else {
+			params.runtime_ns = (unsigned long long)a * NSEC_PER_USEC;
+			params.deadline_ns = (unsigned long long)b * NSEC_PER_USEC;
+			params.period_ns = (unsigned long long)c * NSEC_PER_USEC;
+		}
+		struct thread *thread = &threads[nr_threads];
+		snprintf(thread->name, sizeof(thread->name), "%s", name);
+		thread->tid = schedsim_create(&params);
+		if (thread->tid < 0) {
+			fatal("%s:%zu: invalid scheduling parameters", path, line);
+		}
+		thread->next = -1;
+		thread->first_ns = NEVER;
+		thread->woken_ns = NEVER;
+		nr_threads++;
+		return;
+	}
+
+	// 3. record a wakeup
+	if (strcmp(verb, "wake") == 0) {
+		unsigned long long at = 0, burst = 0;
+		if (sscanf(text, "%*s %31s %llu %llu", name, &at, &burst) != 3 || burst == 0) {
+			fatal("%s:%zu: invalid wake", path, line);
+		}
+		long thread = find_thread(name);
+		if (thread < 0) {
+			fatal("%s:%zu: unknown thread: %s", path, line, name);
+		}
+		wakes = realloc(wakes, (nr_wakes + 1) * sizeof(wakes[0]));
+		if (wakes == 0) {
+			fatal("out of memory");
+		}
+		wakes[nr_wakes++] = (struct wake){
+		    .thread = (size_t)thread,
+		    .at_ns = at * NSEC_PER_USEC,
+		    .burst_ns = burst * NSEC_PER_USEC,
+		    .line = line,
+		    .next = -1,
+		};
+		return;
+	}
+
+	// 4. set the end of the simulation
+	unsigned long long at = 0;
+	if (strcmp(verb, "end") == 0 && sscanf(text, "%*s %llu", &at) == 1) {
+		end_ns = at * NSEC_PER_USEC;
+		return;
+	}
+	fatal("%s:%zu: invalid line", path, line);
+}
+
+static int compare_wakes(const void *a, const void *b) {
+	const struct wake *wa = a;
+	const struct wake *wb = b;
+	if (wa->at_ns != wb->at_ns) {
+		return (wa->at_ns > wb->at_ns) - (wa->at_ns < wb->at_ns);
+	}
+	return (wa->line > wb->line) - (wa->line < wb->line);
+}
+
+// Reads the trace and links the wakeups of each thread in time order.
+static void load_trace(const char *path) {
+	// 1. parse the lines
+	FILE *fp = (strcmp(path, "-") == 0) ? stdin : fopen(path, "r");
+	if (fp == 0) {
+		fatal("cannot open %s", path);
+	}
+	char text[512];
+	for (size_t line = 1; fgets(text, sizeof(text), fp) != 0; line++) {
+		parse_line(path, line, text);
+	}
+	if (fp != stdin) {
+		fclose(fp);
+	}
+
+	// 2. link the wakeups of each thread, from the last one backwards
+	qsort(wakes, nr_wakes, sizeof(wakes[0]), compare_wakes);
+	for (size_t idx = nr_wakes; idx > 0; idx--) {
+		struct wake *wake = &wakes[idx - 1];
+		wake->next = threads[wake->thread].next;
+		threads[wake->thread].next = (long)(idx - 1);
+	}
+}
+
+// Invokes schedsim_schedule and measures its cost.
+static long schedule(long current, unsigned long long now_ns, bool block, bool preempted) {
+	// 1. switch away from the running thread
+	unsigned long long t0 = wallclock_ns();
+	int tid = schedsim_schedule(now_ns, block, preempted);
+	samples_add(&cost_schedule, wallclock_ns() - t0);
+
+	// 2. account for the next thread, knowing that we create the threads
+	// in the same order as the simulated CPU assigns their IDs
+	long next = (tid == SCHEDSIM_IDLE) ? -1 : (long)tid;
+	if (next >= 0) {
+		struct thread *thread = &threads[next];
+		if (next != current) {
+			thread->nr_switches++;
+		}
+		if (thread->woken_ns != NEVER) {
+			samples_add(&thread->latency, now_ns - thread->woken_ns);
+			thread->woken_ns = NEVER;
+		}
+	}
+	return next;
+}
+
+// Replays the trace, simulating the CPU from time zero.
+static unsigned long long replay(void) {
+	unsigned long long now_ns = 0;
+	long current = -1;
+	for (;;) {
+		// 1. find the next event: a thread waking up, the running thread
+		// blocking, the end of a time slice, or a class needing the clock
+		unsigned long long next_ns = end_ns;
+		for (size_t idx = 0; idx < nr_threads; idx++) {
+			struct thread *thread = &threads[idx];
+			if (!thread->active && thread->next >= 0) {
+				unsigned long long at_ns = wakes[thread->next].at_ns;
+				next_ns = (at_ns < next_ns) ? at_ns : next_ns;
+			}
+		}
+		if (current >= 0) {
+			unsigned long long block_ns = now_ns + threads[current].remaining_ns;
+			next_ns = (block_ns < next_ns) ? block_ns : next_ns;
+			unsigned long long slice_ns = (now_ns / JIFFY_NS + 1) * JIFFY_NS;
+			if (schedsim_nr_queued() > 0 && slice_ns < next_ns) {
+				next_ns = slice_ns;
+			}
+		}
+		unsigned long long event_ns = schedsim_next_event();
+		next_ns = (event_ns < next_ns) ? event_ns : next_ns;
+		if (next_ns == NEVER) {
+			return now_ns;
+		}
+		next_ns = (next_ns > now_ns) ? next_ns : now_ns;
+
+		// 2. run the current thread until then
+		if (current >= 0) {
+			threads[current].cpu_ns += next_ns - now_ns;
+			threads[current].remaining_ns -= next_ns - now_ns;
+		}
+		now_ns = next_ns;
+		if (now_ns >= end_ns) {
+			return now_ns;
+		}
+
+		// 3. the clock interrupt charges the running thread and replenishes
+		unsigned long long t0 = wallclock_ns();
+		bool resched = schedsim_tick(now_ns);
+		samples_add(&cost_tick, wallclock_ns() - t0);
+
+		// 4. the running thread blocks when its burst completes
+		if (current >= 0 && threads[current].remaining_ns == 0) {
+			threads[current].active = false;
+			threads[current].blocked = true;
+			current = schedule(current, now_ns, /* block */ true, /* preempted */ false);
+			resched = false;
+		}
+
+		// 5. wake up the threads whose time has come
+		for (size_t idx = 0; idx < nr_threads; idx++) {
+			struct thread *thread = &threads[idx];
+			if (thread->active || thread->next < 0 || wakes[thread->next].at_ns > now_ns) {
+				continue;
+			}
+			thread->active = true;
+			thread->remaining_ns = wakes[thread->next].burst_ns;
+			thread->next = wakes[thread->next].next;
+			thread->woken_ns = now_ns;
+			thread->first_ns = (thread->first_ns == NEVER) ? now_ns : thread->first_ns;
+			t0 = wallclock_ns();
+			resched = schedsim_wakeup(thread->tid, now_ns) || resched;
+			samples_add(&cost_wakeup, wallclock_ns() - t0);
+		}
+
+		// 6. threads sharing the CPU get a time slice of one jiffy
+		if (current >= 0 && now_ns % JIFFY_NS == 0 && schedsim_nr_queued() > 0) {
+			resched = true;
+		}
+
+		// 7. reschedule if needed, which an idle CPU does when work arrives
+		if (resched || (current < 0 && schedsim_nr_queued() > 0)) {
+			current = schedule(current, now_ns, /* block */ false, /* preempted */ current >= 0);
+		}
+	}
+}
+
+// Prints the results of the simulation that ended at end.
+static void report(unsigned long long end) {
+	// 1. print the per-thread statistics
+	unsigned long long busy_ns = 0;
+	size_t nr_wakeups = 0;
+	struct samples all = {0};
+	printf("%-16s %-8s %12s %7s %8s %9s %10s %10s %10s %10s\n", "thread", "policy", "cpu_ms", "share",
+	       "wakeups", "switches", "lat_p50_us", "lat_p90_us", "lat_p99_us", "lat_max_us");
+	for (size_t idx = 0; idx < nr_threads; idx++) {
+		struct thread *thread = &threads[idx];
+		samples_sort(&thread->latency);
+		for (size_t sample = 0; sample < thread->latency.count; sample++) {
+			samples_add(&all, thread->latency.values[sample]);
+		}
+		busy_ns += thread->cpu_ns;
+		nr_wakeups += thread->latency.count;
+		printf("%-16s %-8s %12.3f %6.2f%% %8zu %9llu %10.1f %10.1f %10.1f %10.1f\n", thread->name,
+		       schedsim_policy_name(thread->tid), (double)thread->cpu_ns / 1e6,
+		       (end > 0) ? 100.0 * (double)thread->cpu_ns / (double)end : 0.0, thread->latency.count,
+		       thread->nr_switches, (double)samples_percentile(&thread->latency, 50) / 1e3,
+		       (double)samples_percentile(&thread->latency, 90) / 1e3,
+		       (double)samples_percentile(&thread->latency, 99) / 1e3,
+		       (double)samples_percentile(&thread->latency, 100) / 1e3);
+	}
+	printf("\nsimulated %.3f ms, %zu threads, %zu wakeups, %.2f%% idle\n", (double)end / 1e6, nr_threads,
+	       nr_wakeups, (end > 0) ? 100.0 * (double)(end - busy_ns) / (double)end : 0.0);
+
+	// 2. print the latency percentiles of all the wakeups
+	samples_sort(&all);
+	printf("latency_us: p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+	       (double)samples_percentile(&all, 50) / 1e3, (double)samples_percentile(&all, 90) / 1e3,
+	       (double)samples_percentile(&all, 99) / 1e3, (double)samples_percentile(&all, 99.9) / 1e3,
+	       (double)samples_percentile(&all, 100) / 1e3);
+
+	// 3. compute the Jain's index of the CPU time per unit of weight of the
+	// fair threads that were runnable since their first wakeup, which is one
+	// when they share the CPU in proportion to their weight
+	double sum = 0, sumsq = 0;
+	size_t count = 0;
+	for (size_t idx = 0; idx < nr_threads; idx++) {
+		struct thread *thread = &threads[idx];
+		bool fair = strcmp(schedsim_policy_name(thread->tid), "fair") == 0;
+		if (!fair || thread->blocked || thread->first_ns >= end) {
+			continue;
+		}
+		double share = (double)thread->cpu_ns / (double)(end - thread->first_ns) / schedsim_weight(thread->tid);
+		sum += share;
+		sumsq += share * share;
+		count++;
+	}
+	if (count > 0) {
+		printf("fairness: %.4f (Jain's index over %zu always-runnable fair threads)\n",
+		       sum * sum / ((double)count * sumsq), count);
+	} else {
+		printf("fairness: n/a (no always-runnable fair threads)\n");
+	}
+
+	// 4. print the cost of the decisions
+	struct {
+		const char *name;
+		struct samples *samples;
+	} costs[] = {{"wakeup", &cost_wakeup}, {"tick", &cost_tick}, {"schedule", &cost_schedule}};
+	for (size_t idx = 0; idx < sizeof(costs) / sizeof(costs[0]); idx++) {
+		struct samples *samples = costs[idx].samples;
+		samples_sort(samples);
+		printf("cost_ns: %-8s calls %zu p50 %llu p99 %llu max %llu\n", costs[idx].name, samples->count,
+		       samples_percentile(samples, 50), samples_percentile(samples, 99),
+		       samples_percentile(samples, 100));
+	}
+	free(all.values);
+}
+
+// Returns a pseudo-random number using xorshift64*.
+static unsigned long long xrand(unsigned long long *state) {
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545F4914F6CDD1DULL;
+}
+
+// Returns a pseudo-random number uniformly distributed around the given mean.
+static unsigned long long xrand_around(unsigned long long *state, unsigned long long mean) {
+	return 1 + xrand(state) % (2 * mean);
+}
+
+// Writes a synthetic trace to the standard output.
+//
+// It mixes CPU-bound fair threads with different nice values, interactive
+// fair threads, a periodic SCHED_POLICY_RR thread, and a periodic
+// SCHED_POLICY_DEADLINE thread, running for five seconds.
+static void generate(unsigned long long seed) {
+	unsigned long long state = (seed != 0) ? seed : 1;
+	unsigned long long duration = 5000000;
+	printf("# synthetic trace (seed %llu), times in microseconds\n", seed);
+	printf("thread hog-n-5 fair -5\nthread hog-n0 fair 0\nthread hog-n5 fair 5\n");
+	for (int idx = 0; idx < 4; idx++) {
+		printf("thread ui%d fair 0\n", idx);
+	}
+	printf("thread audio rr 10\nthread video deadline 3000 10000 10000\n");
+	printf("wake hog-n-5 0 %llu\nwake hog-n0 0 %llu\nwake hog-n5 0 %llu\n", duration, duration, duration);
+	for (int idx = 0; idx < 4; idx++) {
+		unsigned long long at = xrand_around(&state, 8000);
+		while (at < duration) {
+			unsigned long long burst = xrand_around(&state, 500);
+			printf("wake ui%d %llu %llu\n", idx, at, burst);
+			at += burst + xrand_around(&state, 8000);
+		}
+	}
+	for (unsigned long long at = 0; at < duration; at += 20000) {
+		printf("wake audio %llu %llu\n", at + xrand(&state) % 1000, 1000 + xrand(&state) % 500);
+	}
+	for (unsigned long long at = 0; at < duration; at += 10000) {
+		printf("wake video %llu %llu\n", at, 1500 + xrand(&state) % 1000);
+	}
+	printf("end %llu\n", duration);
+}
+
+int main(int argc, char **argv) {
+	if (argc == 3 && strcmp(argv[1], "-g") == 0) {
+		generate(strtoull(argv[2], 0, 10));
+		return 0;
+	}
+	if (argc != 2 || (argv[1][0] == '-' && argv[1][1] != '\0')) {
+		fprintf(stderr, "usage: schedsim TRACE     replays the trace ('-' for stdin)\n");
+		fprintf(stderr, "       schedsim -g SEED   writes a synthetic trace to stdout\n");
+		return 2;
+	}
+	schedsim_init();
+	load_trace(argv[1]);
+	report(replay());
+	return 0;
+}
@@ -0,0 +1,76 @@
+// File: tools/schedsim/schedsim.h
+// Purpose: interface between the simulator driver and the simulated CPU.
+// SPDX-License-Identifier: MIT
+#ifndef TOOLS_SCHEDSIM_SCHEDSIM_H
+#define TOOLS_SCHEDSIM_SCHEDSIM_H
+
+// The simulated CPU (see `cpu.c`) builds with the kernel headers, and
+// the driver (see `main.c`) builds with the host headers, which disagree
+// on the definition of types such as size_t, so this header only uses
+// the builtin types, with times in nanoseconds.
+
+// Value returned by schedsim_schedule when the CPU runs its idle thread.
+#define SCHEDSIM_IDLE (-1)
+
+// Maximum number of simulated threads.
+#define SCHEDSIM_MAX_THREADS 1024
+
+// The scheduling parameters of a simulated thread.
+struct schedsim_params {
+	// The scheduling policy (one of SCHED_POLICY_xxx constants).
+	unsigned policy;
+
+	// The priority of a SCHED_POLICY_FIFO or SCHED_POLICY_RR thread.
+	unsigned prio;
+
+	// The nice value of a SCHED_POLICY_FAIR thread.
+	int nice;
+
+	// The reservation of a SCHED_POLICY_DEADLINE thread.
+	unsigned long long runtime_ns;
+	unsigned long long deadline_ns;
+	unsigned long long period_ns;
+};
+
+// Initializes the simulated CPU, which starts idle at time zero.
+void schedsim_init(void);
+
+// Creates a blocked thread and returns its ID or -1 on invalid parameters.
+int schedsim_create(const struct schedsim_params *params);
+
+// Returns the fair-share weight of the given thread.
+unsigned schedsim_weight(int tid);
+
+// Returns the name of the policy of the given thread.
+const char *schedsim_policy_name(int tid);
+
+// Makes a blocked thread runnable at now_ns.
+//
+// Returns whether the CPU must reschedule.
+bool schedsim_wakeup(int tid, unsigned long long now_ns);
+
+// Charges the running thread until now_ns and makes runnable the threads
+// whose class parked them until now_ns, like the clock interrupt does.
+//
+// Returns whether the CPU must reschedule.
+bool schedsim_tick(unsigned long long now_ns);
+
+// Switches away from the running thread at now_ns and returns the thread
+// to run next or SCHEDSIM_IDLE.
+//
+// The running thread blocks when block is true and otherwise remains
+// runnable, in which case preempted tells whether a more important
+// thread preempted it (as opposed to yielding at the end of its slice).
+int schedsim_schedule(unsigned long long now_ns, bool block, bool preempted);
+
+// Returns the number of runnable threads waiting to run.
+unsigned schedsim_nr_queued(void);
+
+// Returns the earliest time at which the classes need the clock
+// interrupt to fire or ~0ULL.
+unsigned long long schedsim_next_event(void);
+
+// Prints the given message and aborts the simulator.
+[[noreturn]] void schedsim_vpanic(const char *fmt, __builtin_va_list ap);
+
+#endif // TOOLS_SCHEDSIM_SCHEDSIM_H